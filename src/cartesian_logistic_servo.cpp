@@ -30,10 +30,12 @@ CartesianLogisticServo::CartesianLogisticServo(std::string const& name) :
   ,root_link_("")
   ,tip_link_("")
   ,target_frame_("")
+  ,tf_period_(0.005)
   // Working variables
   ,n_dof_(0)
+  ,tf_cache_(name)
+  ,target_frame_handle_(0)
   ,ros_publish_throttle_(0.02)
-  ,warn_flag_(false)
   ,max_linear_rate_(0.0)
   ,max_angular_rate_(0.0)
 {
@@ -49,6 +51,8 @@ CartesianLogisticServo::CartesianLogisticServo(std::string const& name) :
     .doc("The tip link for the controller.");
   this->addProperty("target_frame",target_frame_)
     .doc("The target frame to track with tip_link.");
+  this->addProperty("tf_period",tf_period_)
+    .doc("The period, in seconds, at which the target frame is looked up outside of the realtime thread.");
   this->addProperty("max_linear_rate",max_linear_rate_);
   this->addProperty("max_linear_error",max_linear_error_);
   this->addProperty("max_angular_rate",max_angular_rate_);
@@ -78,6 +82,7 @@ bool CartesianLogisticServo::configureHook()
   rosparam->getComponentPrivate("max_angular_error");
   rosparam->getComponentPrivate("linear_p_gain");
   rosparam->getComponentPrivate("angular_p_gain");
+  rosparam->getComponentPrivate("tf_period");
 
   rosparam->getComponentPrivate("robot_description_param");
   rosparam->getParam(robot_description_param_, "robot_description");
@@ -152,17 +157,15 @@ bool CartesianLogisticServo::configureHook()
 
 bool CartesianLogisticServo::startHook()
 {
-  try{
-    tip_frame_msg_ = tf_lookup_transform_(root_link_,target_frame_);
-  } catch (std::exception &ex) {
-    RTT::log(RTT::Warning)<<"Could not look up transform from \""<<root_link_<<"\" to \""<<target_frame_<<"\": "<<ex.what()<<RTT::endlog();
+  // Start looking up the target frame (failures are logged by the cache)
+  tf_cache_.clear();
+  target_frame_handle_ = tf_cache_.addFramePair("/"+root_link_, target_frame_);
+  if(!tf_cache_.start(tf_lookup_transform_, tf_period_)) {
+    return false;
   }
 
   // Zero velocity estimate
   positions_.qdot.data.setZero();
-  // Zero last twist
-  t_cur_cmd_last_.rot = KDL::Vector::Zero();
-  t_cmd_unbounded_ = KDL::Twist::Zero();
   // Initialize TF message
   target_frame_limited_msg_.header.frame_id = root_link_;
   target_frame_limited_msg_.child_frame_id = target_frame_+"_limited";
@@ -176,72 +179,19 @@ bool CartesianLogisticServo::startHook()
   // Read in the current joint positions
   RTT::FlowStatus positions_data = positions_in_port_.readNewest( positions_.q.data );
   if(positions_data != RTT::NewData) {
+    tf_cache_.stop();
     return false;
   }
 
   // Compute the current tip frame
   fk_solver_vel_->JntToCart(positions_, tip_framevel_cur_);
 
-
-  tip_frame_cmd_ = tip_framevel_cur_.GetFrame();
-  tip_frame_cmd_unbounded_ = tip_framevel_cur_.GetFrame();
+  // Start commanding the current tip frame
+  saturation_.reset(tip_framevel_cur_.GetFrame());
 
   return true;
 }
 
-static inline double sigm(const double x, const double s)
-{
-  const double &v = s*(2.0/(1.0 + exp(-2.0*x/s)) - 1.0);
-  return v;
-}
-
-static inline void sigm_scale(KDL::Vector &vec, const double s)
-{
-  const double n = sigm(vec.Norm(), s);
-  vec.Normalize();
-  vec = vec * n;
-}
-
-static inline double sign(double &v) {
-  return v > 0.0 ? 1.0 : -1.0;
-}
-
-static inline bool isnan(KDL::Twist &t) {
-  for(unsigned i=0; i<6; i++) {
-    if(isnan(t[i])) {
-      return true;
-    }
-  }
-  return false;
-}
-
-static inline bool isnan(KDL::Frame &F) {
-  for(unsigned i=0; i<3; i++) {
-    if(isnan(F.p[i])) {
-      return true;
-    }
-  }
-  for(unsigned i=0; i<3; i++) {
-    if(isnan(F.M.GetRot()[i])) {
-      return true;
-    }
-  }
-  return false;
-}
-
-static inline bool isnan(geometry_msgs::TransformStamped &T) {
-  const geometry_msgs::Vector3 &t = T.transform.translation;
-  const geometry_msgs::Quaternion &q = T.transform.rotation;
-  return 
-    isnan(t.x) ||
-    isnan(t.y) ||
-    isnan(t.z) ||
-    isnan(q.x) ||
-    isnan(q.y) ||
-    isnan(q.z) ||
-    isnan(q.w);
-}
-
 void CartesianLogisticServo::updateHook()
 {
   // Compute the inverse kinematics solution
@@ -259,80 +209,32 @@ void CartesianLogisticServo::updateHook()
   fk_solver_vel_->JntToCart(positions_, tip_framevel_cur_);
 
   // Get thep current desired pose in the base frame
-  try{
-    tip_frame_msg_ = tf_lookup_transform_("/"+root_link_,target_frame_);
-    if(isnan(tip_frame_msg_)) {
-      RTT::log(RTT::Fatal) << "Transform contained NaNs! Fleeing." <<RTT::endlog();
-      return;
-    }
-    tf::transformMsgToKDL(tip_frame_msg_.transform, tip_frame_des_);
-    warn_flag_ = false;
-  } catch (std::exception &ex) {
-    if(!warn_flag_) {
-      RTT::log(RTT::Warning) << "Could not look up transform from \""<<root_link_<<
-        "\" to \""<<target_frame_<<"\": "<<ex.what() << RTT::endlog();
-      warn_flag_ = true;
-    }
+  if(tf_cache_.getTransform(target_frame_handle_, tip_frame_des_) != TransformCache::OK) {
+    return;
+  }
+  if(!SE3LogisticSaturation::IsFinite(tip_frame_des_)) {
+    RTT::log(RTT::Fatal) << "Transform contained NaNs! Fleeing." <<RTT::endlog();
     return;
   }
 
-  // Get the twist from the unthrottled pose to the desired pose
-  t_cmd_des_ = KDL::diff(tip_frame_cmd_unbounded_, tip_frame_des_);
-
-  // Scale the twist by a proportional velocity law
-  t_cmd_diff_.vel = linear_p_gain_ * t_cmd_des_.vel;
-  t_cmd_diff_.rot = angular_p_gain_ * t_cmd_des_.rot;
-
-  // Throttle the twist according to maximum linear and angular rates
-  sigm_scale(t_cmd_diff_.vel, max_linear_rate_);
-  sigm_scale(t_cmd_diff_.rot, max_angular_rate_);
-
-  // Reintegrate the twist
+  // Move the command frame towards the desired frame, subject to the rate
+  // and error limits (which may have been changed since the last update)
+  saturation_.setGains(linear_p_gain_, angular_p_gain_);
+  saturation_.setRateLimits(max_linear_rate_, max_angular_rate_);
+  saturation_.setErrorLimits(max_linear_error_, max_angular_error_);
   if(period.toSec() > 1E-8) {
-    // Integrate the additional twist in the unbounded command frame
-    tip_frame_cmd_unbounded_.Integrate(tip_frame_cmd_unbounded_.M.Inverse()*t_cmd_diff_, 1.0/period.toSec());
-
-    // Get the twist from the current frame to the unbounded command frame
-    KDL::Twist t_cur_cmd = KDL::diff(tip_framevel_cur_.GetFrame(), tip_frame_cmd_unbounded_);
-
-    double cur_cmd_angle = t_cur_cmd.rot.Norm();
-    double reflected_cur_cmd_angle = std::min(std::abs(cur_cmd_angle), M_PI-std::abs(cur_cmd_angle));
-    t_cur_cmd.rot.Normalize();
-    t_cur_cmd.rot = t_cur_cmd.rot * reflected_cur_cmd_angle;
-
-    // Check if the twist from the current frame to the unbounded integrated frame has flipped direction
-    if(false && KDL::dot(t_cur_cmd_last_.rot, t_cur_cmd.rot) < 0) {
-      //t_cur_cmd.rot = -1.0 * t_cur_cmd.rot;
-      RTT::log(RTT::Debug) << "Twist flipped direction" <<RTT::endlog();
+    // Don't integrate nans. They're rude and unpleasant.
+    if(!saturation_.update(tip_framevel_cur_.GetFrame(), tip_frame_des_, period.toSec())) {
+      RTT::log(RTT::Fatal) << "CartesianLogisticServo: NaNs detected. Run for the hills." << RTT::endlog();
+      this->error();
+      return;
     }
-    t_cur_cmd_last_ = t_cur_cmd;
-    
-    // Bound the command twist by the maximum error
-    sigm_scale(t_cur_cmd.vel, max_linear_error_);
-    sigm_scale(t_cur_cmd.rot, max_angular_error_);
-
-    tip_frame_cmd_last_ = tip_frame_cmd_;
-    tip_frame_cmd_ = tip_framevel_cur_.GetFrame();
-    tip_frame_cmd_.Integrate(tip_frame_cmd_.M.Inverse()*t_cur_cmd, 1.0);
-
-    t_cmd_ = diff(tip_frame_cmd_last_, tip_frame_cmd_);
   } else {
     RTT::log(RTT::Warning) << "CartesianLogisticServo: Period went backwards or is exceptionally small. Not changing output pose." << RTT::endlog();
   }
 
-  // Check for nans. Don't integrate nans. They're rude and unpleasant.
-  if(isnan(tip_frame_cmd_) || isnan(tip_frame_cmd_unbounded_)) {
-    // Re-set the frame
-    tip_frame_cmd_unbounded_ = tip_framevel_cur_.GetFrame();
-    RTT::log(RTT::Fatal) << "CartesianLogisticServo: NaNs detected. Run for the hills." << RTT::endlog();
-    this->error();
-    return;
-  }
-
   // Set command framevel
-  tip_framevel_cmd_ = tip_frame_cmd_;
-  tip_framevel_cmd_.M.w = t_cmd_.rot;
-  tip_framevel_cmd_.p.v = t_cmd_.vel;
+  saturation_.getCommand(tip_framevel_cmd_);
 
   // Send position target
   framevel_out_port_.write( tip_framevel_cmd_ );
@@ -340,11 +242,11 @@ void CartesianLogisticServo::updateHook()
   // Publish debug traj to ros
   if(ros_publish_throttle_.ready(0.02)) 
   {
-    tf::transformKDLToMsg(tip_frame_cmd_, target_frame_limited_msg_.transform);
+    tf::transformKDLToMsg(saturation_.getCommandFrame(), target_frame_limited_msg_.transform);
     target_frame_limited_msg_.header.stamp = rtt_rosclock::host_now();
     tf_broadcast_transform_(target_frame_limited_msg_);
 
-    tf::transformKDLToMsg(tip_frame_cmd_unbounded_, target_frame_unbounded_msg_.transform);
+    tf::transformKDLToMsg(saturation_.getUnboundedFrame(), target_frame_unbounded_msg_.transform);
     target_frame_unbounded_msg_.header.stamp = rtt_rosclock::host_now();
     tf_broadcast_transform_(target_frame_unbounded_msg_);
   }
@@ -353,6 +255,7 @@ void CartesianLogisticServo::updateHook()
 void CartesianLogisticServo::stopHook()
 {
   positions_in_port_.clear();
+  tf_cache_.stop();
 }
 
 void CartesianLogisticServo::cleanupHook()
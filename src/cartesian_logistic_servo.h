@@ -31,6 +31,9 @@
 
 #include <visualization_msgs/Marker.h>
 
+#include "transform_cache/transform_cache.h"
+#include "saturation/se3_logistic_saturation.h"
+
 namespace lcsr_controllers {
   class CartesianLogisticServo : public RTT::TaskContext
   {
@@ -40,6 +43,7 @@ namespace lcsr_controllers {
     std::string root_link_;
     std::string tip_link_;
     std::string target_frame_;
+    double tf_period_;
     double max_linear_rate_;
     double max_angular_rate_;
 
@@ -83,20 +87,15 @@ namespace lcsr_controllers {
 
     geometry_msgs::TransformStamped target_frame_limited_msg_;
     geometry_msgs::TransformStamped target_frame_unbounded_msg_;
-    geometry_msgs::TransformStamped tip_frame_msg_;
-    KDL::Twist tip_frame_error_;
-    KDL::Twist tip_frame_twist_;
-    KDL::Twist t_cmd_;
-    KDL::Twist t_cmd_des_;
-    KDL::Twist t_cmd_diff_;
-    KDL::Twist t_cur_cmd_last_;
-    KDL::Twist t_cmd_unbounded_;
+    // Target frame, looked up outside of the realtime thread
+    TransformCache tf_cache_;
+    TransformCache::Handle target_frame_handle_;
+
+    // Rate- and error-limited command frame
+    SE3LogisticSaturation saturation_;
+
     KDL::Frame tip_frame_des_;
-    KDL::Frame tip_frame_cmd_;
-    KDL::Frame tip_frame_cmd_last_;
-    KDL::Frame tip_frame_cmd_unbounded_;
     KDL::FrameVel tip_framevel_cur_;
-    KDL::FrameVel tip_framevel_des_;
     KDL::FrameVel tip_framevel_cmd_;
 
     double max_linear_error_;
@@ -109,8 +108,6 @@ namespace lcsr_controllers {
     ros::Time update_time_;
     ros::Time last_update_time_;
 
-    bool warn_flag_;
-
   };
 }
 
@@ -0,0 +1,202 @@
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "batch_id_solver.h"
+
+using namespace lcsr_controllers;
+
+BatchIdSolver::Worker::Worker(
+    const KDL::Chain &chain,
+    const KDL::Vector &gravity) :
+  solver(chain, gravity),
+  positions(chain.getNrOfJoints()),
+  velocities(chain.getNrOfJoints()),
+  accelerations(chain.getNrOfJoints()),
+  torques(chain.getNrOfJoints()),
+  ext_wrenches(chain.getNrOfSegments(), KDL::Wrench::Zero()),
+  result(0)
+{
+}
+
+BatchIdSolver::BatchIdSolver(
+    const KDL::Chain &chain,
+    const KDL::Vector &gravity,
+    unsigned int n_threads) :
+  n_joints_(chain.getNrOfJoints()),
+  gravity_(gravity),
+  tip_inertia_(KDL::RigidBodyInertia::Zero()),
+  shutdown_(false),
+  generation_(0),
+  n_active_(0),
+  n_finished_(0),
+  n_samples_(0),
+  block_size_(0),
+  positions_(NULL),
+  velocities_(NULL),
+  accelerations_(NULL),
+  torques_(NULL)
+{
+  if(n_threads == 0) {
+    n_threads = std::max(1U, boost::thread::hardware_concurrency());
+  }
+
+  workers_.assign(n_threads, Worker(chain, gravity));
+
+  // The first worker runs in the caller's thread
+  for(unsigned int w=1; w<n_threads; w++) {
+    threads_.create_thread(boost::bind(&BatchIdSolver::work, this, w));
+  }
+}
+
+BatchIdSolver::~BatchIdSolver()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_ready_.notify_all();
+  threads_.join_all();
+}
+
+void BatchIdSolver::setTipInertia(const KDL::RigidBodyInertia &inertia)
+{
+  tip_inertia_ = inertia;
+}
+
+int BatchIdSolver::CartToJnt(
+    const Eigen::MatrixXd &positions,
+    const Eigen::MatrixXd &velocities,
+    const Eigen::MatrixXd &accelerations,
+    Eigen::MatrixXd &torques)
+{
+  const unsigned int n_samples = positions.cols();
+
+  if(positions.rows() != n_joints_
+     || velocities.rows() != n_joints_ || velocities.cols() != n_samples
+     || accelerations.rows() != n_joints_ || accelerations.cols() != n_samples)
+  {
+    return -1;
+  }
+
+  torques.resize(n_joints_, n_samples);
+
+  // Split the samples into contiguous blocks, one per worker
+  const unsigned int
+    n_workers = std::max(1U, std::min<unsigned int>(workers_.size(), n_samples)),
+    block_size = (n_samples + n_workers - 1) / n_workers;
+
+  // Hand the other blocks to the threads
+  if(n_workers > 1) {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      positions_ = &positions;
+      velocities_ = &velocities;
+      accelerations_ = &accelerations;
+      torques_ = &torques;
+      n_samples_ = n_samples;
+      block_size_ = block_size;
+      n_active_ = n_workers;
+      n_finished_ = 0;
+      generation_++;
+    }
+    work_ready_.notify_all();
+  }
+
+  // Evaluate the first block in this thread
+  this->solve(workers_[0], positions, velocities, accelerations, torques, 0, std::min(block_size, n_samples));
+
+  // Wait for the threads to finish their blocks
+  if(n_workers > 1) {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(n_finished_ < n_workers - 1) {
+      work_done_.wait(lock);
+    }
+  }
+
+  for(unsigned int w=0; w<n_workers; w++) {
+    if(workers_[w].result != 0) {
+      return workers_[w].result;
+    }
+  }
+
+  return 0;
+}
+
+void BatchIdSolver::work(const unsigned int worker)
+{
+  unsigned int generation = 0;
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+
+  while(true) {
+    // Wait for a new call
+    while(!shutdown_ && generation == generation_) {
+      work_ready_.wait(lock);
+    }
+
+    if(shutdown_) {
+      return;
+    }
+
+    generation = generation_;
+
+    // Calls with few samples don't use every worker
+    if(worker >= n_active_) {
+      continue;
+    }
+
+    const unsigned int
+      begin = std::min(worker * block_size_, n_samples_),
+      end = std::min((worker+1) * block_size_, n_samples_);
+
+    // Solve without holding the lock, the caller waits for this block
+    lock.unlock();
+    this->solve(workers_[worker], *positions_, *velocities_, *accelerations_, *torques_, begin, end);
+    lock.lock();
+
+    n_finished_++;
+    work_done_.notify_one();
+  }
+}
+
+void BatchIdSolver::solve(
+    Worker &worker,
+    const Eigen::MatrixXd &positions,
+    const Eigen::MatrixXd &velocities,
+    const Eigen::MatrixXd &accelerations,
+    Eigen::MatrixXd &torques,
+    const unsigned int begin,
+    const unsigned int end)
+{
+  worker.result = 0;
+
+  for(unsigned int k=begin; k<end; k++) {
+    worker.positions.data = positions.col(k);
+    worker.velocities.data = velocities.col(k);
+    worker.accelerations.data = accelerations.col(k);
+
+    worker.result = worker.solver.JntToCart(worker.positions);
+
+    if(worker.result != 0) {
+      return;
+    }
+
+    // Apply the weight of the tip inertia (in the tip frame)
+    const KDL::Vector tip_gravity = worker.solver.getTipFrame().M.Inverse() * gravity_;
+    worker.ext_wrenches.back() = tip_inertia_ * KDL::Twist(tip_gravity, KDL::Vector::Zero());
+
+    worker.result = worker.solver.CartToJnt(
+        worker.velocities,
+        worker.accelerations,
+        worker.ext_wrenches,
+        worker.torques);
+
+    if(worker.result != 0) {
+      return;
+    }
+
+    torques.col(k) = worker.torques.data;
+  }
+}
@@ -0,0 +1,116 @@
+#ifndef __LCSR_CONTROLLERS_BATCH_ID_SOLVER_H
+#define __LCSR_CONTROLLERS_BATCH_ID_SOLVER_H
+
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <Eigen/Dense>
+
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/rigidbodyinertia.hpp>
+
+#include "chain_id_solver_rne.h"
+
+namespace lcsr_controllers {
+
+  /** \brief Inverse dynamics for every sample of a trajectory
+   *
+   * This evaluates the recursive Newton-Euler inverse dynamics for a batch of
+   * joint-space states, split across several threads. Each thread has its own
+   * solver and working variables, so samples are evaluated independently and
+   * written to their own columns of the output. The threads are created with
+   * the solver and wait for work between calls, so a call doesn't pay for
+   * creating them.
+   *
+   * This is meant to be used outside of the realtime loop, for example to
+   * compute the feed-forward torques for a whole planned trajectory at once.
+   */
+  class BatchIdSolver {
+  public:
+    /** \brief Create a batch solver
+     *
+     * If n_threads is zero, one thread is used per hardware thread.
+     */
+    BatchIdSolver(
+        const KDL::Chain &chain,
+        const KDL::Vector &gravity,
+        unsigned int n_threads = 0);
+    ~BatchIdSolver();
+
+    /** \brief Set the inertia attached to the tip (in the tip frame)
+     *
+     * Its weight is applied to the tip as an external wrench at each sample,
+     * like the end-effector compensation in IDControllerKDL.
+     */
+    void setTipInertia(const KDL::RigidBodyInertia &inertia);
+
+    /** \brief Compute the joint torques for each sample (column)
+     *
+     * The positions, velocities and accelerations are n_joints x n_samples,
+     * and the torques are resized to match. The only external wrench is the
+     * weight of the tip inertia. This can't be called from several threads
+     * at once.
+     *
+     * Returns: 0 on success, -1 if the sizes don't match the chain
+     */
+    int CartToJnt(
+        const Eigen::MatrixXd &positions,
+        const Eigen::MatrixXd &velocities,
+        const Eigen::MatrixXd &accelerations,
+        Eigen::MatrixXd &torques);
+
+    unsigned int getNrOfThreads() const { return workers_.size(); }
+
+  private:
+    struct Worker {
+      Worker(const KDL::Chain &chain, const KDL::Vector &gravity);
+
+      ChainIdSolverRNE solver;
+      KDL::JntArray positions, velocities, accelerations, torques;
+      KDL::Wrenches ext_wrenches;
+      int result;
+    };
+
+    //! Evaluate the samples in [begin, end) with a given worker
+    void solve(
+        Worker &worker,
+        const Eigen::MatrixXd &positions,
+        const Eigen::MatrixXd &velocities,
+        const Eigen::MatrixXd &accelerations,
+        Eigen::MatrixXd &torques,
+        const unsigned int begin,
+        const unsigned int end);
+
+    //! Solve the blocks of a worker thread until shutdown
+    void work(const unsigned int worker);
+
+    unsigned int n_joints_;
+    KDL::Vector gravity_;
+    KDL::RigidBodyInertia tip_inertia_;
+    std::vector<Worker> workers_;
+
+    // Work shared between the caller and the threads (guarded by mutex_)
+    boost::mutex mutex_;
+    boost::condition_variable work_ready_;
+    boost::condition_variable work_done_;
+    bool shutdown_;
+    unsigned int generation_;
+    unsigned int n_active_;
+    unsigned int n_finished_;
+    unsigned int n_samples_;
+    unsigned int block_size_;
+    const Eigen::MatrixXd *positions_;
+    const Eigen::MatrixXd *velocities_;
+    const Eigen::MatrixXd *accelerations_;
+    Eigen::MatrixXd *torques_;
+
+    //! Threads for every worker but the first, which runs in the caller
+    boost::thread_group threads_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_BATCH_ID_SOLVER_H
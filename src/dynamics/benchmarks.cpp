@@ -0,0 +1,186 @@
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include <kdl/chain.hpp>
+#include <kdl/chainidsolver_recursive_newton_euler.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include "../test_fixtures.h"
+#include "chain_gravity_solver.h"
+#include "chain_id_solver_rne.h"
+#include "batch_id_solver.h"
+using namespace lcsr_controllers;
+
+//! Build a serial chain with alternating joint axes and random inertias
+static KDL::Chain SyntheticChain(const unsigned int n_dof)
+{
+  std::srand(0);
+
+  KDL::Chain chain;
+  for(unsigned int i=0; i<n_dof; i++) {
+    KDL::Joint joint((i % 2) ? KDL::Joint::RotY : KDL::Joint::RotZ);
+    KDL::Frame tip(
+        KDL::Rotation::RPY(Random(-M_PI, M_PI), Random(-M_PI, M_PI), Random(-M_PI, M_PI)),
+        KDL::Vector(Random(-0.1, 0.1), Random(-0.1, 0.1), Random(0.1, 0.4)));
+    KDL::RigidBodyInertia inertia(
+        Random(0.5, 5.0),
+        KDL::Vector(Random(-0.05, 0.05), Random(-0.05, 0.05), Random(-0.2, 0.0)),
+        KDL::RotationalInertia(0.01, 0.01, 0.01, 0.0, 0.0, 0.0));
+    chain.addSegment(KDL::Segment(joint, tip, inertia));
+  }
+
+  return chain;
+}
+
+static const KDL::Vector GRAVITY(0.0, 0.0, -9.81);
+static const KDL::RigidBodyInertia PAYLOAD(1.5, KDL::Vector(0.02, 0.0, 0.1));
+
+static KDL::JntArray RandomPositions(const unsigned int n_dof)
+{
+  KDL::JntArray positions(n_dof);
+  for(unsigned int i=0; i<n_dof; i++) {
+    positions(i) = Random(-M_PI, M_PI);
+  }
+  return positions;
+}
+
+/******************************************************************************
+ * Benchmarks
+ ******************************************************************************/
+
+//! What IDControllerKDL does every cycle without gravity_only
+static void BM_RNE_Gravity(benchmark::State& state)
+{
+  const unsigned int n_dof = state.range(0);
+  KDL::Chain chain = SyntheticChain(n_dof);
+
+  KDL::ChainIdSolver_RNE id_solver(chain, GRAVITY);
+  KDL::ChainFkSolverPos_recursive fk_solver(chain);
+
+  KDL::JntArray positions = RandomPositions(n_dof), zeros(n_dof), torques(n_dof);
+  KDL::Wrenches wrenches(chain.getNrOfSegments(), KDL::Wrench::Zero());
+  KDL::Frame tip_frame;
+
+  for(auto _ : state) {
+    fk_solver.JntToCart(positions, tip_frame);
+    wrenches.back() = PAYLOAD * KDL::Twist(tip_frame.M.Inverse() * GRAVITY, KDL::Vector::Zero());
+    id_solver.CartToJnt(positions, zeros, zeros, wrenches, torques);
+    benchmark::DoNotOptimize(torques.data.data());
+  }
+}
+BENCHMARK(BM_RNE_Gravity)->Arg(7)->Arg(32);
+
+//! The gravity_only mode, with its error against the exact RNE torques
+static void BM_ChainGravitySolver(benchmark::State& state)
+{
+  const unsigned int n_dof = state.range(0);
+  KDL::Chain chain = SyntheticChain(n_dof);
+
+  KDL::ChainIdSolver_RNE id_solver(chain, GRAVITY);
+  ChainGravitySolver gravity_solver(chain, GRAVITY);
+  gravity_solver.setTipInertia(PAYLOAD);
+
+  KDL::JntArray zeros(n_dof), torques(n_dof), rne_torques(n_dof);
+  KDL::Wrenches wrenches(chain.getNrOfSegments(), KDL::Wrench::Zero());
+
+  // Compare against RNE over random configurations
+  double max_error = 0.0;
+  for(unsigned int k=0; k<1000; k++) {
+    KDL::JntArray positions = RandomPositions(n_dof);
+    gravity_solver.JntToGravity(positions, torques);
+    wrenches.back() = PAYLOAD * KDL::Twist(gravity_solver.getTipFrame().M.Inverse() * GRAVITY, KDL::Vector::Zero());
+    id_solver.CartToJnt(positions, zeros, zeros, wrenches, rne_torques);
+    max_error = std::max(max_error, (torques.data - rne_torques.data).cwiseAbs().maxCoeff());
+  }
+
+  KDL::JntArray positions = RandomPositions(n_dof);
+
+  for(auto _ : state) {
+    gravity_solver.JntToGravity(positions, torques);
+    benchmark::DoNotOptimize(torques.data.data());
+  }
+
+  state.counters["max_abs_error_Nm"] = max_error;
+}
+BENCHMARK(BM_ChainGravitySolver)->Arg(7)->Arg(32);
+
+//! RNE with the tip frame taken from its own forward sweep
+static void BM_ChainIdSolverRNE_SharedFrames(benchmark::State& state)
+{
+  const unsigned int n_dof = state.range(0);
+  KDL::Chain chain = SyntheticChain(n_dof);
+
+  KDL::ChainIdSolver_RNE kdl_id_solver(chain, GRAVITY);
+  KDL::ChainFkSolverPos_recursive fk_solver(chain);
+  ChainIdSolverRNE id_solver(chain, GRAVITY);
+
+  KDL::JntArray zeros(n_dof), torques(n_dof), kdl_torques(n_dof);
+  KDL::Wrenches wrenches(chain.getNrOfSegments(), KDL::Wrench::Zero());
+  KDL::Frame tip_frame;
+
+  // Compare against KDL over random states
+  double max_error = 0.0;
+  for(unsigned int k=0; k<1000; k++) {
+    KDL::JntArray positions = RandomPositions(n_dof);
+    KDL::JntArray velocities = RandomPositions(n_dof);
+    KDL::JntArray accelerations = RandomPositions(n_dof);
+
+    fk_solver.JntToCart(positions, tip_frame);
+    wrenches.back() = PAYLOAD * KDL::Twist(tip_frame.M.Inverse() * GRAVITY, KDL::Vector::Zero());
+    kdl_id_solver.CartToJnt(positions, velocities, accelerations, wrenches, kdl_torques);
+
+    id_solver.JntToCart(positions);
+    wrenches.back() = PAYLOAD * KDL::Twist(id_solver.getTipFrame().M.Inverse() * GRAVITY, KDL::Vector::Zero());
+    id_solver.CartToJnt(velocities, accelerations, wrenches, torques);
+
+    max_error = std::max(max_error, (torques.data - kdl_torques.data).cwiseAbs().maxCoeff());
+  }
+
+  KDL::JntArray positions = RandomPositions(n_dof);
+
+  for(auto _ : state) {
+    id_solver.JntToCart(positions);
+    wrenches.back() = PAYLOAD * KDL::Twist(id_solver.getTipFrame().M.Inverse() * GRAVITY, KDL::Vector::Zero());
+    id_solver.CartToJnt(zeros, zeros, wrenches, torques);
+    benchmark::DoNotOptimize(torques.data.data());
+  }
+
+  state.counters["max_abs_error_Nm"] = max_error;
+}
+BENCHMARK(BM_ChainIdSolverRNE_SharedFrames)->Arg(7)->Arg(32);
+
+//! Feed-forward torques for a whole trajectory (7 joints) with a given number of threads
+static void BM_BatchIdSolver(benchmark::State& state)
+{
+  const unsigned int
+    n_dof = 7,
+    n_samples = state.range(0),
+    n_threads = state.range(1);
+  KDL::Chain chain = SyntheticChain(n_dof);
+
+  BatchIdSolver batch_solver(chain, GRAVITY, n_threads);
+
+  Eigen::MatrixXd
+    positions = Eigen::MatrixXd::Random(n_dof, n_samples),
+    velocities = Eigen::MatrixXd::Random(n_dof, n_samples),
+    accelerations = Eigen::MatrixXd::Random(n_dof, n_samples),
+    torques(n_dof, n_samples);
+
+  for(auto _ : state) {
+    batch_solver.CartToJnt(positions, velocities, accelerations, torques);
+    benchmark::DoNotOptimize(torques.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_samples);
+}
+BENCHMARK(BM_BatchIdSolver)
+  ->Args({1000,1})->Args({1000,4})
+  ->Args({10000,1})->Args({10000,4})
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,94 @@
+
+#include "chain_gravity_solver.h"
+
+using namespace lcsr_controllers;
+
+ChainGravitySolver::ChainGravitySolver(
+    const KDL::Chain &chain,
+    const KDL::Vector &gravity) :
+  chain_(chain),
+  gravity_(gravity),
+  masses_(chain.getNrOfSegments()),
+  moments_(chain.getNrOfSegments()),
+  tip_mass_(0.0),
+  tip_moment_(KDL::Vector::Zero()),
+  frames_(chain.getNrOfSegments()),
+  joint_axes_(chain.getNrOfSegments()),
+  joint_origins_(chain.getNrOfSegments())
+{
+  for(unsigned int s=0; s<chain_.getNrOfSegments(); s++) {
+    const KDL::RigidBodyInertia &inertia = chain_.getSegment(s).getInertia();
+    masses_[s] = inertia.getMass();
+    moments_[s] = inertia.getMass() * inertia.getCOG();
+  }
+}
+
+void ChainGravitySolver::setTipInertia(const KDL::RigidBodyInertia &inertia)
+{
+  tip_mass_ = inertia.getMass();
+  tip_moment_ = inertia.getMass() * inertia.getCOG();
+}
+
+int ChainGravitySolver::JntToGravity(
+    const KDL::JntArray &positions,
+    KDL::JntArray &torques)
+{
+  const unsigned int n_segments = chain_.getNrOfSegments();
+
+  if(positions.rows() != chain_.getNrOfJoints() || torques.rows() != chain_.getNrOfJoints()) {
+    return -1;
+  }
+
+  // Forward pass: segment frames, and joint axes and origins in the root frame
+  KDL::Frame parent_frame = KDL::Frame::Identity();
+  for(unsigned int s=0, j=0; s<n_segments; s++) {
+    const KDL::Segment &segment = chain_.getSegment(s);
+    const KDL::Joint &joint = segment.getJoint();
+
+    joint_axes_[s] = parent_frame.M * joint.JointAxis();
+    joint_origins_[s] = parent_frame * joint.JointOrigin();
+
+    if(joint.getType() != KDL::Joint::None) {
+      frames_[s] = parent_frame * segment.pose(positions(j));
+      j++;
+    } else {
+      frames_[s] = parent_frame * segment.pose(0.0);
+    }
+
+    parent_frame = frames_[s];
+  }
+
+  // Backward pass: accumulate the mass and first moment of mass (in the root
+  // frame) of everything distal to each joint
+  double mass = tip_mass_;
+  KDL::Vector moment = (n_segments > 0) ?
+    (frames_.back().M * tip_moment_ + tip_mass_ * frames_.back().p) :
+    KDL::Vector::Zero();
+
+  for(int s=n_segments-1, j=chain_.getNrOfJoints()-1; s>=0; s--) {
+    mass += masses_[s];
+    moment += frames_[s].M * moments_[s] + masses_[s] * frames_[s].p;
+
+    const KDL::Joint &joint = chain_.getSegment(s).getJoint();
+
+    switch(joint.getType()) {
+      case KDL::Joint::None:
+        continue;
+      case KDL::Joint::TransAxis:
+      case KDL::Joint::TransX:
+      case KDL::Joint::TransY:
+      case KDL::Joint::TransZ:
+        // Force needed to support the distal mass along the joint axis
+        torques(j) = -KDL::dot(joint_axes_[s], mass * gravity_);
+        break;
+      default:
+        // Torque needed to support the distal mass about the joint axis
+        torques(j) = -KDL::dot(joint_axes_[s], (moment - mass * joint_origins_[s]) * gravity_);
+        break;
+    }
+
+    j--;
+  }
+
+  return 0;
+}
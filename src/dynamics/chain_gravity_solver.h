@@ -0,0 +1,67 @@
+#ifndef __LCSR_CONTROLLERS_CHAIN_GRAVITY_SOLVER_H
+#define __LCSR_CONTROLLERS_CHAIN_GRAVITY_SOLVER_H
+
+#include <vector>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/rigidbodyinertia.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Gravity torques for a KDL chain
+   *
+   * This computes the same torques as KDL::ChainIdSolver_RNE with zero joint
+   * velocities and accelerations, but without the velocity and acceleration
+   * terms of the recursion. Only the mass and the first moment of mass of
+   * each segment affect the gravity torques, so those are extracted once on
+   * construction. Each solve is then a forward pass to compute the segment
+   * frames and a backward pass which accumulates the mass and first moment of
+   * mass of everything distal to each joint.
+   *
+   * An inertia rigidly attached to the tip (like a tool) can be set without
+   * re-extracting the chain's parameters.
+   */
+  class ChainGravitySolver {
+  public:
+    ChainGravitySolver(
+        const KDL::Chain &chain,
+        const KDL::Vector &gravity);
+
+    //! Set an inertia attached to the tip, expressed in the tip frame
+    void setTipInertia(const KDL::RigidBodyInertia &inertia);
+
+    /** \brief Compute the joint torques needed to hold the chain against gravity
+     *
+     * Returns: 0 on success, -1 if the array sizes don't match the chain
+     */
+    int JntToGravity(
+        const KDL::JntArray &positions,
+        KDL::JntArray &torques);
+
+    //! A segment frame computed by the last call to JntToGravity
+    const KDL::Frame& getSegmentFrame(const unsigned int segment) const { return frames_[segment]; }
+    //! The tip frame computed by the last call to JntToGravity
+    const KDL::Frame& getTipFrame() const { return frames_.back(); }
+
+  private:
+    KDL::Chain chain_;
+    KDL::Vector gravity_;
+
+    // Mass and first moment of mass of each segment (in the segment frame)
+    std::vector<double> masses_;
+    std::vector<KDL::Vector> moments_;
+
+    // Mass and first moment of mass of the tip inertia (in the tip frame)
+    double tip_mass_;
+    KDL::Vector tip_moment_;
+
+    // Working variables
+    std::vector<KDL::Frame> frames_;
+    std::vector<KDL::Vector> joint_axes_;
+    std::vector<KDL::Vector> joint_origins_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_CHAIN_GRAVITY_SOLVER_H
@@ -0,0 +1,115 @@
+
+#include "chain_id_solver_rne.h"
+
+using namespace lcsr_controllers;
+
+ChainIdSolverRNE::ChainIdSolverRNE(
+    const KDL::Chain &chain,
+    const KDL::Vector &gravity) :
+  chain_(chain),
+  ag_(-KDL::Twist(gravity, KDL::Vector::Zero())),
+  X_(chain.getNrOfSegments()),
+  S_(chain.getNrOfSegments()),
+  frames_(chain.getNrOfSegments()),
+  v_(chain.getNrOfSegments()),
+  a_(chain.getNrOfSegments()),
+  f_(chain.getNrOfSegments())
+{
+}
+
+int ChainIdSolverRNE::CartToJnt(
+    const KDL::JntArray &positions,
+    const KDL::JntArray &velocities,
+    const KDL::JntArray &accelerations,
+    const KDL::Wrenches &ext_wrenches,
+    KDL::JntArray &torques)
+{
+  if(this->JntToCart(positions) != 0) {
+    return -1;
+  }
+
+  return this->CartToJnt(velocities, accelerations, ext_wrenches, torques);
+}
+
+int ChainIdSolverRNE::JntToCart(const KDL::JntArray &positions)
+{
+  if(positions.rows() != chain_.getNrOfJoints()) {
+    return -1;
+  }
+
+  for(unsigned int i=0, j=0; i<chain_.getNrOfSegments(); i++) {
+    const KDL::Segment &segment = chain_.getSegment(i);
+
+    double q = 0.0;
+    if(segment.getJoint().getType() != KDL::Joint::None) {
+      q = positions(j);
+      j++;
+    }
+
+    // Pose of the segment in its parent, and the joint's unit twist in the segment frame
+    X_[i] = segment.pose(q);
+    S_[i] = X_[i].M.Inverse(segment.twist(q, 1.0));
+
+    // Pose of the segment in the root frame
+    frames_[i] = (i == 0) ? X_[i] : frames_[i-1] * X_[i];
+  }
+
+  return 0;
+}
+
+int ChainIdSolverRNE::CartToJnt(
+    const KDL::JntArray &velocities,
+    const KDL::JntArray &accelerations,
+    const KDL::Wrenches &ext_wrenches,
+    KDL::JntArray &torques)
+{
+  const unsigned int
+    n_segments = chain_.getNrOfSegments(),
+    n_joints = chain_.getNrOfJoints();
+
+  if(velocities.rows() != n_joints
+     || accelerations.rows() != n_joints
+     || torques.rows() != n_joints
+     || ext_wrenches.size() != n_segments)
+  {
+    return -1;
+  }
+
+  // Sweep from root to leaf: segment velocities, accelerations, and the net
+  // forces on each segment (in segment coordinates)
+  for(unsigned int i=0, j=0; i<n_segments; i++) {
+    double qdot = 0.0, qdotdot = 0.0;
+    if(chain_.getSegment(i).getJoint().getType() != KDL::Joint::None) {
+      qdot = velocities(j);
+      qdotdot = accelerations(j);
+      j++;
+    }
+
+    const KDL::Twist vj = S_[i] * qdot;
+
+    if(i == 0) {
+      v_[i] = vj;
+      a_[i] = X_[i].Inverse(ag_) + S_[i] * qdotdot + v_[i] * vj;
+    } else {
+      v_[i] = X_[i].Inverse(v_[i-1]) + vj;
+      a_[i] = X_[i].Inverse(a_[i-1]) + S_[i] * qdotdot + v_[i] * vj;
+    }
+
+    const KDL::RigidBodyInertia &inertia = chain_.getSegment(i).getInertia();
+    f_[i] = inertia * a_[i] + v_[i] * (inertia * v_[i]) - ext_wrenches[i];
+  }
+
+  // Sweep from leaf to root: project the forces onto the joint axes and
+  // propagate them to the parent segments
+  for(int i=n_segments-1, j=n_joints-1; i>=0; i--) {
+    if(chain_.getSegment(i).getJoint().getType() != KDL::Joint::None) {
+      torques(j) = KDL::dot(S_[i], f_[i]);
+      j--;
+    }
+    if(i != 0) {
+      f_[i-1] = f_[i-1] + X_[i] * f_[i];
+    }
+  }
+
+  return 0;
+}
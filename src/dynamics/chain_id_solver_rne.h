@@ -0,0 +1,78 @@
+#ifndef __LCSR_CONTROLLERS_CHAIN_ID_SOLVER_RNE_H
+#define __LCSR_CONTROLLERS_CHAIN_ID_SOLVER_RNE_H
+
+#include <vector>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Recursive Newton-Euler inverse dynamics which shares its frames
+   *
+   * This computes the same torques as KDL::ChainIdSolver_RNE, but splits the
+   * solve into the position-dependent part of the forward sweep (segment
+   * frames and joint unit twists) and the rest. The frames from the first part
+   * are exposed, so a caller who needs the tip frame to compute the external
+   * wrenches (like end-effector gravity compensation) doesn't need a separate
+   * forward-kinematics solve:
+   *
+   * \code
+   * id_solver.JntToCart(positions);
+   * ext_wrenches.back() = payload * KDL::Twist(id_solver.getTipFrame().M.Inverse() * gravity, KDL::Vector::Zero());
+   * id_solver.CartToJnt(velocities, accelerations, ext_wrenches, torques);
+   * \endcode
+   */
+  class ChainIdSolverRNE {
+  public:
+    ChainIdSolverRNE(
+        const KDL::Chain &chain,
+        const KDL::Vector &gravity);
+
+    //! Compute the inverse dynamics in one call (like KDL::ChainIdSolver_RNE)
+    int CartToJnt(
+        const KDL::JntArray &positions,
+        const KDL::JntArray &velocities,
+        const KDL::JntArray &accelerations,
+        const KDL::Wrenches &ext_wrenches,
+        KDL::JntArray &torques);
+
+    /** \brief Compute the segment frames for a set of joint positions
+     *
+     * Returns: 0 on success, -1 if the array size doesn't match the chain
+     */
+    int JntToCart(const KDL::JntArray &positions);
+
+    /** \brief Compute the inverse dynamics at the positions given to the last JntToCart
+     *
+     * Returns: 0 on success, -1 if the array sizes don't match the chain
+     */
+    int CartToJnt(
+        const KDL::JntArray &velocities,
+        const KDL::JntArray &accelerations,
+        const KDL::Wrenches &ext_wrenches,
+        KDL::JntArray &torques);
+
+    //! Get the frame of a segment in the root frame
+    const KDL::Frame& getSegmentFrame(const unsigned int segment) const { return frames_[segment]; }
+    //! Get the frame of the tip in the root frame
+    const KDL::Frame& getTipFrame() const { return frames_.back(); }
+
+  private:
+    KDL::Chain chain_;
+    KDL::Twist ag_;
+
+    // Position-dependent part of the forward sweep
+    std::vector<KDL::Frame> X_;
+    std::vector<KDL::Twist> S_;
+    std::vector<KDL::Frame> frames_;
+
+    // Velocity-dependent part of the forward sweep
+    std::vector<KDL::Twist> v_;
+    std::vector<KDL::Twist> a_;
+    std::vector<KDL::Wrench> f_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_CHAIN_ID_SOLVER_RNE_H
@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <map>
+#include <algorithm>
 
 #include <Eigen/Dense>
 
@@ -26,18 +27,31 @@ IDControllerKDL::IDControllerKDL(std::string const& name) :
   ,root_link_("")
   ,tip_link_("")
   ,gravity_(3)
+  ,feed_forward_threads_(0)
   // Working variables
   ,n_dof_(0)
   ,kdl_tree_()
   ,kdl_chain_()
   ,id_solver_(NULL)
+  ,ee_inertia_buffer_(KDL::RigidBodyInertia::Zero())
   ,ext_wrenches_()
   ,positions_()
   ,accelerations_()
   ,torques_()
+  // Debug relay
+  ,debug_buffer_(DebugSample())
+  ,debug_relay_(*this)
+  ,debug_relay_activity_(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.0, &debug_relay_, name+"_debug"))
+  // Inertia relay
+  ,attached_inertia_buffer_(KDL::RigidBodyInertia::Zero())
+  ,inertia_relay_(*this)
+  ,inertia_relay_activity_(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.01, &inertia_relay_, name+"_inertia"))
   // Throttles
   ,debug_throttle_(0.05)
   ,compensate_end_effector_(true)
+  ,gravity_only_(false)
 {
   // Zero gravity
   gravity_.setZero();
@@ -56,6 +70,14 @@ IDControllerKDL::IDControllerKDL(std::string const& name) :
     .doc("The tip link for the controller.");
   this->addProperty("compensate_end_effector",compensate_end_effector_)
     .doc("Will compute a wrench on the tip link if true.");
+  this->addProperty("feed_forward_threads",feed_forward_threads_)
+    .doc("The number of threads used by computeFeedForward. (default: 0, one per hardware thread)");
+  this->addProperty("gravity_only",gravity_only_)
+    .doc("Will only compensate for gravity (ignoring joint velocities) if true. This is much cheaper than the full inverse dynamics.");
+
+  // Configure operations
+  this->addOperation("computeFeedForward", &IDControllerKDL::computeFeedForward, this, RTT::ClientThread)
+    .doc("Compute the inverse-dynamics torques for each point of a joint trajectory, and return it with the efforts filled in.");
 
   // Configure data ports
   this->ports()->addPort("joint_position_in", joint_position_in_);
@@ -70,9 +92,10 @@ IDControllerKDL::IDControllerKDL(std::string const& name) :
   ext_wrenches_debug_out_.createStream(rtt_roscomm::topic("~/"+this->getName()+"/wrenches"));
 
   this->ports()->addPort("cogs_debug_out", cogs_debug_out_);
-  cogs_debug_out_.createStream(rtt_roscomm::topicBuffer("~/"+this->getName()+"/cogs",32));
+  cogs_debug_out_.createStream(rtt_roscomm::topic("~/"+this->getName()+"/cogs"));
 
-  this->ports()->addPort("end_effector_inertias_in", end_effector_inertias_in_);
+  this->ports()->addPort("end_effector_inertias_in", end_effector_inertias_in_)
+    .doc("Inertias attached to the end-effector, keyed by id. Each is expressed in the frame given by its header, which must be rigidly attached to the tip_link. An inertia with zero mass removes the inertia with the same id. These are read and attached outside of the realtime loop, every 10 ms.");
   end_effector_inertias_in_.createStream(rtt_roscomm::topic("~/"+this->getName()+"/end_effector_inertias"));
 }
 
@@ -92,6 +115,9 @@ bool IDControllerKDL::configureHook()
   param_ok &= rosparam->getComponentPrivate("root_link");
   param_ok &= rosparam->getComponentPrivate("tip_link");
   param_ok &= rosparam->getComponentPrivate("gravity");
+  // Get optional parameters
+  rosparam->getComponentPrivate("gravity_only");
+  rosparam->getComponentPrivate("feed_forward_threads");
 
   if (!param_ok) {
     RTT::log(RTT::Error) << "Can not load all params" << RTT::endlog();
@@ -115,16 +141,19 @@ bool IDControllerKDL::configureHook()
     return false;
   }
 
-  // Create a PoseStamped message for each center of gravity
+  // Create a marker for each center of gravity, which is moved with the
+  // segment frames computed by the solvers
+  cogs_msg_.markers.clear();
+  cogs_.clear();
   for(std::vector<KDL::Segment>::const_iterator it=kdl_chain_.segments.begin();
       it != kdl_chain_.segments.end();
       ++it)
   {
     visualization_msgs::Marker cog_pose;
-    cog_pose.header.frame_id = it->getName();
+    cog_pose.header.frame_id = root_link_;
     cog_pose.ns = it->getName();
     cog_pose.type = visualization_msgs::Marker::SPHERE;
-    cog_pose.frame_locked = true;
+    cog_pose.frame_locked = false;
     cog_pose.scale.x = 0.02;
     cog_pose.scale.y = 0.02;
     cog_pose.scale.z = 0.02;
@@ -132,21 +161,50 @@ bool IDControllerKDL::configureHook()
     cog_pose.color.g = 217.0/255.0;
     cog_pose.color.b = 214.0/255.0;
     cog_pose.color.a = 128.0;
-    cog_pose.pose.position.x = it->getInertia().getCOG().x();
-    cog_pose.pose.position.y = it->getInertia().getCOG().y();
-    cog_pose.pose.position.z = it->getInertia().getCOG().z();
+    cog_pose.pose.orientation.w = 1.0;
 
-    cogs_msgs_.push_back(cog_pose);
+    cogs_msg_.markers.push_back(cog_pose);
+    cogs_.push_back(it->getInertia().getCOG());
   }
 
+  wrench_msg_.header.frame_id = tip_link_;
+
+  // Preallocate the debug data
+  debug_sample_.segment_frames.assign(kdl_chain_.getNrOfSegments(), KDL::Frame::Identity());
+  debug_buffer_.data_sample(debug_sample_);
+
   // Create inverse dynamics chainsolver
   id_solver_.reset(
-      new KDL::ChainIdSolver_RNE(
+      new ChainIdSolverRNE(
         kdl_chain_,
         KDL::Vector(gravity_[0],gravity_[1],gravity_[2])));
 
-  // Create the forward kinematics solver
-  fk_solver_.reset( new KDL::ChainFkSolverPos_recursive( kdl_chain_ ) );
+  // Create the gravity-only solver
+  gravity_solver_.reset(
+      new ChainGravitySolver(
+        kdl_chain_,
+        KDL::Vector(gravity_[0],gravity_[1],gravity_[2])));
+
+  // Create the batch solver for feed-forward trajectories
+  {
+    RTT::os::MutexLock lock(feed_forward_mutex_);
+    batch_id_solver_.reset(
+        new BatchIdSolver(
+          kdl_chain_,
+          KDL::Vector(gravity_[0],gravity_[1],gravity_[2]),
+          std::max(0, feed_forward_threads_)));
+
+    // Get the names of the joints in the chain
+    joint_names_.clear();
+    for(std::vector<KDL::Segment>::const_iterator it=kdl_chain_.segments.begin();
+        it != kdl_chain_.segments.end();
+        ++it)
+    {
+      if(it->getJoint().getType() != KDL::Joint::None) {
+        joint_names_.push_back(it->getJoint().getName());
+      }
+    }
+  }
 
   // Resize IO vectors
   joint_position_.resize(n_dof_);
@@ -178,6 +236,13 @@ bool IDControllerKDL::startHook()
   joint_acceleration_.setZero();
   // Zero out torque data
   torques_.data.setZero();
+
+  // Start publishing debug visualization
+  debug_relay_activity_->start();
+
+  // Start attaching inertias
+  inertia_relay_activity_->start();
+
   return true;
 }
 
@@ -188,83 +253,82 @@ void IDControllerKDL::updateHook()
   bool new_vel_data = joint_velocity_in_.readNewest( joint_velocity_ ) == RTT::NewData;
 
   // Read all the EE masses
-  bool new_ee_data = false;
-
-  double ee_mass = 0;
-  KDL::Vector ee_cog(0,0,0);
-
   if(end_effector_masses_in_.readNewest( end_effector_mass_ ) == RTT::NewData) 
   {
     // Make sure the new mass is well-posed
     if(end_effector_mass_.size() == 4 && end_effector_mass_[3] > 1E-4) 
     {
-      // Update EE cog
-      KDL::Vector new_cog(end_effector_mass_[0], end_effector_mass_[1], end_effector_mass_[2]);
-      double new_mass = end_effector_mass_[3];
-      ee_cog = (ee_cog*ee_mass + new_cog*new_mass) / (ee_mass + new_mass);
-      // Update EE mass
-      ee_mass += new_mass;
-      new_ee_data = true;
+      // Update EE mass and cog
+      ee_mass_inertia_ = KDL::RigidBodyInertia(
+          end_effector_mass_[3],
+          KDL::Vector(end_effector_mass_[0], end_effector_mass_[1], end_effector_mass_[2]));
     }
   }
 
-  while(end_effector_inertias_in_.read( end_effector_inertia_ ) == RTT::NewData) 
-  {
-#if 0 // TODO
-    // Make sure the new mass is well-posed
-    if(end_effector_mass_.size() == 4 && end_effector_mass_[3] > 1E-4) 
-    {
-      // Update EE cog
-      KDL::Vector new_cog(end_effector_mass_[0], end_effector_mass_[1], end_effector_mass_[2]);
-      double new_mass = end_effector_mass_[3];
-      ee_cog = (ee_cog*ee_mass + new_cog*new_mass) / (ee_mass + new_mass);
-      // Update EE mass
-      ee_mass += new_mass;
-      new_ee_data = true;
-    }
-#endif 
-  }
+  // Add the attached inertias, which are read and expressed in the tip frame
+  // by the inertia relay
+  attached_inertia_buffer_.Get(attached_inertia_);
+  ee_inertia = ee_mass_inertia_ + attached_inertia_;
 
-  // Update the ee inertia
-  if(new_ee_data) {
-    ee_inertia = KDL::RigidBodyInertia( ee_mass, ee_cog );  
-  }
+  // Hand the end-effector inertia off to computeFeedForward
+  ee_inertia_buffer_.Set(compensate_end_effector_ ? ee_inertia : KDL::RigidBodyInertia::Zero());
 
-  if(new_pos_data && new_vel_data) {
+  if(new_pos_data && (new_vel_data || gravity_only_)) {
     // Get JntArray structures from pos/vel
     positions_.data = joint_position_;
     velocities_.data = joint_velocity_;
 
-    // Compute wwrenches on the end-effector
-    if(compensate_end_effector_) {
-      // Compute the tip frame from the current joint position
-      KDL::Frame tip_frame;
-      int ret = fk_solver_->JntToCart(positions_, tip_frame);
-      // Compute gravity vector in the tip frame
-      KDL::Vector tip_gravity = tip_frame.M.Inverse() * KDL::Vector(gravity_[0], gravity_[1], gravity_[2]);
-      KDL::Twist tip_gravity_twist(tip_gravity, KDL::Vector::Zero()); //TODO: Add centripetal acceleration (v*r^2)
-      ee_wrench = ee_inertia * tip_gravity_twist;
-      // Compute the external wrench on the tip link
-      // Set the wrench (in root_link_ coordinates)
-      ext_wrenches_.back() = ee_wrench;
-    } else { 
-      // Zero the last wrench
-      ext_wrenches_.back() = KDL::Wrench::Zero();
-    }
+    if(gravity_only_) {
+      // Compute only the gravity torques, including the end-effector inertia
+      gravity_solver_->setTipInertia(compensate_end_effector_ ? ee_inertia : KDL::RigidBodyInertia::Zero());
+      if(gravity_solver_->JntToGravity(positions_, torques_) != 0) {
+        RTT::log(RTT::Error) << "Could not compute joint torques!" << RTT::endlog();
+        this->error();
+      }
 
-    // Compute inverse dynamics
-    // This computes the torques on each joint of the arm as a function of
-    // the arm's joint-space position, velocities, accelerations, external
-    // forces/torques and gravity.
-    if(id_solver_->CartToJnt(
-          positions_,
-          velocities_,
-          accelerations_,
-          ext_wrenches_,
-          torques_) != 0)
-    {
-      RTT::log(RTT::Error) << "Could not compute joint torques!" << RTT::endlog();
-      this->error();
+      // Store the equivalent wrench on the tip link for debugging
+      if(compensate_end_effector_) {
+        KDL::Vector tip_gravity = gravity_solver_->getTipFrame().M.Inverse() * KDL::Vector(gravity_[0], gravity_[1], gravity_[2]);
+        ee_wrench = ee_inertia * KDL::Twist(tip_gravity, KDL::Vector::Zero());
+        ext_wrenches_.back() = ee_wrench;
+      } else {
+        ext_wrenches_.back() = KDL::Wrench::Zero();
+      }
+    } else {
+      // Compute the segment frames from the current joint position
+      if(id_solver_->JntToCart(positions_) != 0) {
+        RTT::log(RTT::Error) << "Could not compute segment frames!" << RTT::endlog();
+        this->error();
+      }
+
+      // Compute wwrenches on the end-effector
+      if(compensate_end_effector_) {
+        // Compute gravity vector in the tip frame
+        KDL::Vector tip_gravity = id_solver_->getTipFrame().M.Inverse() * KDL::Vector(gravity_[0], gravity_[1], gravity_[2]);
+        KDL::Twist tip_gravity_twist(tip_gravity, KDL::Vector::Zero()); //TODO: Add centripetal acceleration (v*r^2)
+        ee_wrench = ee_inertia * tip_gravity_twist;
+        // Compute the external wrench on the tip link
+        // Set the wrench (in root_link_ coordinates)
+        ext_wrenches_.back() = ee_wrench;
+      } else { 
+        // Zero the last wrench
+        ext_wrenches_.back() = KDL::Wrench::Zero();
+      }
+
+      // Compute inverse dynamics
+      // This computes the torques on each joint of the arm as a function of
+      // the arm's joint-space position, velocities, accelerations, external
+      // forces/torques and gravity. The segment frames computed above are
+      // reused so the chain is only traversed once.
+      if(id_solver_->CartToJnt(
+            velocities_,
+            accelerations_,
+            ext_wrenches_,
+            torques_) != 0)
+      {
+        RTT::log(RTT::Error) << "Could not compute joint torques!" << RTT::endlog();
+        this->error();
+      }
     }
 
     // Store the effort command
@@ -275,29 +339,227 @@ void IDControllerKDL::updateHook()
 
     // Debug visualization
     if(this->debug_throttle_.ready(0.05)) {
-      wrench_msg_.header.frame_id = tip_link_;
-      wrench_msg_.header.stamp = rtt_rosclock::host_now();
-      wrench_msg_.wrench.force.x = ext_wrenches_.back().force.x();
-      wrench_msg_.wrench.force.y = ext_wrenches_.back().force.y();
-      wrench_msg_.wrench.force.z = ext_wrenches_.back().force.z();
-      wrench_msg_.wrench.torque.x = ext_wrenches_.back().torque.x();
-      wrench_msg_.wrench.torque.y = ext_wrenches_.back().torque.y();
-      wrench_msg_.wrench.torque.z = ext_wrenches_.back().torque.z();
-      ext_wrenches_debug_out_.write(wrench_msg_);
-
-      for(std::vector<visualization_msgs::Marker>::iterator it = cogs_msgs_.begin();
-          it != cogs_msgs_.end();
-          ++it)
-      {
-        it->header.stamp = wrench_msg_.header.stamp;
-        cogs_debug_out_.write(*it);
+      // Hand off the wrench and segment frames to the relay, so that building
+      // and serializing the messages doesn't happen in this thread
+      debug_sample_.stamp = rtt_rosclock::host_now();
+      debug_sample_.ee_wrench = ext_wrenches_.back();
+      for(unsigned int s=0; s<kdl_chain_.getNrOfSegments(); s++) {
+        debug_sample_.segment_frames[s] = gravity_only_ ?
+          gravity_solver_->getSegmentFrame(s) :
+          id_solver_->getSegmentFrame(s);
+      }
+      debug_buffer_.Set(debug_sample_);
+      debug_relay_activity_->trigger();
+    }
+  }
+}
+
+bool IDControllerKDL::attachInertia(const telemanip_msgs::AttachedInertia &msg)
+{
+  // Remove massless inertias
+  if(msg.inertia.m <= 0.0) {
+    return attached_inertias_.erase(msg.id) > 0;
+  }
+
+  // Find the pose of the inertia's frame in the tip frame. The frame needs to
+  // be rigidly attached to the tip, so every joint between them has to be fixed.
+  KDL::Frame tip_to_frame = KDL::Frame::Identity();
+  const std::string &frame_id = msg.header.frame_id;
+
+  if(frame_id.length() > 0 && frame_id != tip_link_) {
+    KDL::Chain chain;
+    if(!kdl_tree_.getChain(tip_link_, frame_id, chain)) {
+      RTT::log(RTT::Warning) << "Ignoring attached inertia \"" << msg.id << "\": frame \"" << frame_id << "\" is not in the robot model." << RTT::endlog();
+      return false;
+    }
+
+    for(unsigned int s=0; s<chain.getNrOfSegments(); s++) {
+      if(chain.getSegment(s).getJoint().getType() != KDL::Joint::None) {
+        RTT::log(RTT::Warning) << "Ignoring attached inertia \"" << msg.id << "\": frame \"" << frame_id << "\" is not rigidly attached to \"" << tip_link_ << "\"." << RTT::endlog();
+        return false;
+      }
+      tip_to_frame = tip_to_frame * chain.getSegment(s).pose(0.0);
+    }
+  }
+
+  // Express the inertia in the tip frame (the rotational inertia is about the COG)
+  const KDL::RigidBodyInertia inertia(
+      msg.inertia.m,
+      KDL::Vector(msg.inertia.com.x, msg.inertia.com.y, msg.inertia.com.z),
+      KDL::RotationalInertia(
+        msg.inertia.ixx, msg.inertia.iyy, msg.inertia.izz,
+        msg.inertia.ixy, msg.inertia.ixz, msg.inertia.iyz));
+
+  attached_inertias_[msg.id] = tip_to_frame * inertia;
+
+  return true;
+}
+
+void IDControllerKDL::aggregateInertias()
+{
+  // Combine all of the inertias, which are already expressed in the tip frame
+  KDL::RigidBodyInertia attached_inertia = KDL::RigidBodyInertia::Zero();
+  for(AttachedInertias::const_iterator it = attached_inertias_.begin();
+      it != attached_inertias_.end();
+      ++it)
+  {
+    attached_inertia = attached_inertia + it->second;
+  }
+
+  attached_inertia_buffer_.Set(attached_inertia);
+}
+
+trajectory_msgs::JointTrajectory IDControllerKDL::computeFeedForward(
+    const trajectory_msgs::JointTrajectory &trajectory)
+{
+  RTT::os::MutexLock lock(feed_forward_mutex_);
+
+  trajectory_msgs::JointTrajectory result = trajectory;
+
+  if(!batch_id_solver_) {
+    RTT::log(RTT::Error) << "Cannot compute feed-forward torques before the component is configured." << RTT::endlog();
+    return result;
+  }
+
+  const size_t n_dof = joint_names_.size();
+
+  // Map the trajectory's joints onto the chain's joints
+  std::vector<size_t> index_permutation(n_dof);
+  if(trajectory.joint_names.size() == 0) {
+    for(size_t i=0; i<n_dof; i++) {
+      index_permutation[i] = i;
+    }
+  } else if(trajectory.joint_names.size() == n_dof) {
+    for(size_t i=0; i<n_dof; i++) {
+      std::vector<std::string>::const_iterator it =
+        std::find(joint_names_.begin(), joint_names_.end(), trajectory.joint_names[i]);
+      if(it == joint_names_.end()) {
+        RTT::log(RTT::Error) << "Cannot compute feed-forward torques: joint \"" << trajectory.joint_names[i] << "\" is not in the chain." << RTT::endlog();
+        return result;
+      }
+      index_permutation[i] = it - joint_names_.begin();
+    }
+  } else {
+    RTT::log(RTT::Error) << "Cannot compute feed-forward torques: the trajectory has " << trajectory.joint_names.size() << " joints but the chain has " << n_dof << "." << RTT::endlog();
+    return result;
+  }
+
+  // Pack the trajectory points into dense buffers (one column per point)
+  const size_t n_points = trajectory.points.size();
+  feed_forward_positions_.setZero(n_dof, n_points);
+  feed_forward_velocities_.setZero(n_dof, n_points);
+  feed_forward_accelerations_.setZero(n_dof, n_points);
+
+  for(size_t p=0; p<n_points; p++) {
+    const trajectory_msgs::JointTrajectoryPoint &point = trajectory.points[p];
+
+    if(point.positions.size() != n_dof
+       || (point.velocities.size() != 0 && point.velocities.size() != n_dof)
+       || (point.accelerations.size() != 0 && point.accelerations.size() != n_dof))
+    {
+      RTT::log(RTT::Error) << "Cannot compute feed-forward torques: trajectory point " << p << " has the wrong number of joints." << RTT::endlog();
+      return result;
+    }
+
+    for(size_t i=0; i<n_dof; i++) {
+      const size_t j = index_permutation[i];
+      feed_forward_positions_(j,p) = point.positions[i];
+      if(point.velocities.size() > 0) {
+        feed_forward_velocities_(j,p) = point.velocities[i];
+      }
+      if(point.accelerations.size() > 0) {
+        feed_forward_accelerations_(j,p) = point.accelerations[i];
       }
     }
   }
+
+  // Include the end-effector inertia, as the control loop does
+  KDL::RigidBodyInertia ee_inertia = KDL::RigidBodyInertia::Zero();
+  ee_inertia_buffer_.Get(ee_inertia);
+  batch_id_solver_->setTipInertia(ee_inertia);
+
+  // Evaluate the inverse dynamics for all points
+  if(batch_id_solver_->CartToJnt(
+        feed_forward_positions_,
+        feed_forward_velocities_,
+        feed_forward_accelerations_,
+        feed_forward_torques_) != 0)
+  {
+    RTT::log(RTT::Error) << "Could not compute feed-forward torques!" << RTT::endlog();
+    return result;
+  }
+
+  // Unpack the torques in the trajectory's joint order
+  for(size_t p=0; p<n_points; p++) {
+    result.points[p].effort.resize(n_dof);
+    for(size_t i=0; i<n_dof; i++) {
+      result.points[p].effort[i] = feed_forward_torques_(index_permutation[i],p);
+    }
+  }
+
+  return result;
+}
+
+void IDControllerKDL::DebugRelay::step()
+{
+  owner_.debug_buffer_.Get(sample_);
+
+  if(sample_.segment_frames.size() != owner_.cogs_msg_.markers.size()) {
+    return;
+  }
+
+  // End-effector wrench
+  geometry_msgs::WrenchStamped &wrench_msg = owner_.wrench_msg_;
+  wrench_msg.header.stamp = sample_.stamp;
+  wrench_msg.wrench.force.x = sample_.ee_wrench.force.x();
+  wrench_msg.wrench.force.y = sample_.ee_wrench.force.y();
+  wrench_msg.wrench.force.z = sample_.ee_wrench.force.z();
+  wrench_msg.wrench.torque.x = sample_.ee_wrench.torque.x();
+  wrench_msg.wrench.torque.y = sample_.ee_wrench.torque.y();
+  wrench_msg.wrench.torque.z = sample_.ee_wrench.torque.z();
+  owner_.ext_wrenches_debug_out_.write(wrench_msg);
+
+  // Centers of gravity in the root frame
+  for(size_t s=0; s<sample_.segment_frames.size(); s++) {
+    const KDL::Frame &frame = sample_.segment_frames[s];
+    const KDL::Vector cog = frame * owner_.cogs_[s];
+    visualization_msgs::Marker &marker = owner_.cogs_msg_.markers[s];
+
+    marker.header.stamp = sample_.stamp;
+    marker.pose.position.x = cog.x();
+    marker.pose.position.y = cog.y();
+    marker.pose.position.z = cog.z();
+    frame.M.GetQuaternion(
+        marker.pose.orientation.x,
+        marker.pose.orientation.y,
+        marker.pose.orientation.z,
+        marker.pose.orientation.w);
+  }
+  owner_.cogs_debug_out_.write(owner_.cogs_msg_);
+}
+
+void IDControllerKDL::InertiaRelay::step()
+{
+  // Read all the attached inertias
+  bool new_inertia = false;
+  while(owner_.end_effector_inertias_in_.read( msg_ ) == RTT::NewData) 
+  {
+    new_inertia |= owner_.attachInertia(msg_);
+  }
+
+  // Update the sum only when the attached bodies change
+  if(new_inertia) {
+    owner_.aggregateInertias();
+  }
 }
 
 void IDControllerKDL::stopHook()
 {
+  // Stop publishing debug visualization
+  debug_relay_activity_->stop();
+
+  // Stop attaching inertias
+  inertia_relay_activity_->stop();
 }
 
 void IDControllerKDL::cleanupHook()
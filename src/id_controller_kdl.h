@@ -2,24 +2,32 @@
 #define __LCSR_CONTROLLERS_ID_CONTROLLER_KDL_H
 
 #include <iostream>
+#include <map>
 
 #include <boost/scoped_ptr.hpp>
 
 #include <rtt/RTT.hpp>
 #include <rtt/Port.hpp>
+#include <rtt/os/Mutex.hpp>
+#include <rtt/Activity.hpp>
+#include <rtt/base/RunnableInterface.hpp>
+#include <rtt/base/DataObjectLockFree.hpp>
 
 #include <kdl/jntarrayvel.hpp>
 #include <kdl/tree.hpp>
 #include <kdl/chain.hpp>
-#include <kdl/chainidsolver_recursive_newton_euler.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
 
 #include <rtt_ros_tools/throttles.h>
 
 #include <geometry_msgs/WrenchStamped.h>
-#include <visualization_msgs/Marker.h>
+#include <trajectory_msgs/JointTrajectory.h>
+#include <visualization_msgs/MarkerArray.h>
 #include <telemanip_msgs/AttachedInertia.h>
 
+#include "dynamics/chain_gravity_solver.h"
+#include "dynamics/chain_id_solver_rne.h"
+#include "dynamics/batch_id_solver.h"
+
 namespace lcsr_controllers {
   class IDControllerKDL : public RTT::TaskContext
   {
@@ -30,6 +38,7 @@ namespace lcsr_controllers {
     std::string tip_link_;
     std::string wrench_link_;
     Eigen::VectorXd gravity_;
+    int feed_forward_threads_;
 
     // RTT Ports
     RTT::InputPort<Eigen::VectorXd> joint_position_in_;
@@ -40,7 +49,7 @@ namespace lcsr_controllers {
     RTT::OutputPort<Eigen::VectorXd> joint_effort_out_;
 
     RTT::OutputPort<geometry_msgs::WrenchStamped> ext_wrenches_debug_out_;
-    RTT::OutputPort<visualization_msgs::Marker> cogs_debug_out_;
+    RTT::OutputPort<visualization_msgs::MarkerArray> cogs_debug_out_;
 
   public:
     IDControllerKDL(std::string const& name);
@@ -50,16 +59,44 @@ namespace lcsr_controllers {
     virtual void stopHook();
     virtual void cleanupHook();
 
+    /** \brief Compute the inverse-dynamics torques for each point of a trajectory
+     *
+     * This evaluates every point's positions, velocities and accelerations
+     * (missing velocities or accelerations are taken as zero) in parallel,
+     * and returns the trajectory with the efforts filled in. Like the control
+     * loop, it includes the weight of the end-effector inertias at the tip.
+     * It runs in the caller's thread, so it doesn't block the control loop.
+     */
+    trajectory_msgs::JointTrajectory computeFeedForward(
+        const trajectory_msgs::JointTrajectory &trajectory);
+
   private:
 
+    //! Add, replace, or remove (if it has no mass) an attached inertia
+    bool attachInertia(const telemanip_msgs::AttachedInertia &msg);
+    //! Hand the sum of the attached inertias off to the realtime loop
+    void aggregateInertias();
+
     // Kinematic properties
     unsigned int n_dof_;
     KDL::Tree kdl_tree_;
     KDL::Chain kdl_chain_;
 
     // Solvers
-    boost::scoped_ptr<KDL::ChainIdSolver_RNE> id_solver_;
-    boost::scoped_ptr<KDL::ChainFkSolverPos_recursive> fk_solver_;
+    boost::scoped_ptr<ChainIdSolverRNE> id_solver_;
+    boost::scoped_ptr<ChainGravitySolver> gravity_solver_;
+    boost::scoped_ptr<BatchIdSolver> batch_id_solver_;
+
+    // Feed-forward working variables
+    RTT::os::Mutex feed_forward_mutex_;
+    std::vector<std::string> joint_names_;
+    Eigen::MatrixXd
+      feed_forward_positions_,
+      feed_forward_velocities_,
+      feed_forward_accelerations_,
+      feed_forward_torques_;
+    //! End-effector inertia handed off from the realtime loop (zero if it isn't compensated)
+    RTT::base::DataObjectLockFree<KDL::RigidBodyInertia> ee_inertia_buffer_;
 
     // Working variables
     KDL::JntArray positions_;
@@ -76,14 +113,75 @@ namespace lcsr_controllers {
       joint_effort_;
 
     KDL::RigidBodyInertia ee_inertia;
+    //! Inertia from the legacy (x,y,z,m) end-effector mass port
+    KDL::RigidBodyInertia ee_mass_inertia_;
+    //! Sum of the attached inertias, from the inertia relay
+    KDL::RigidBodyInertia attached_inertia_;
     KDL::Wrench ee_wrench;
 
+    /** \brief Attaches inertias outside of the realtime loop
+     *
+     * This reads the attached inertias, looks up the pose of each one's frame
+     * in the robot model, and hands the sum of the inertias (in the tip frame)
+     * off to the realtime loop.
+     */
+    class InertiaRelay : public RTT::base::RunnableInterface {
+    public:
+      InertiaRelay(IDControllerKDL &owner) : owner_(owner) { }
+      virtual bool initialize() { return true; }
+      virtual void step();
+      virtual void finalize() { }
+    private:
+      IDControllerKDL &owner_;
+      telemanip_msgs::AttachedInertia msg_;
+    };
+
+    //! Attached inertias by id, expressed in the tip frame, only used by the inertia relay
+    typedef std::map<std::string, KDL::RigidBodyInertia> AttachedInertias;
+    AttachedInertias attached_inertias_;
+    //! Latest sum of the attached inertias handed off by the relay
+    RTT::base::DataObjectLockFree<KDL::RigidBodyInertia> attached_inertia_buffer_;
+    InertiaRelay inertia_relay_;
+    boost::scoped_ptr<RTT::Activity> inertia_relay_activity_;
+
+    //! Debug data handed off from the realtime loop to the debug relay
+    struct DebugSample {
+      ros::Time stamp;
+      KDL::Wrench ee_wrench;
+      std::vector<KDL::Frame> segment_frames;
+    };
+
+    /** \brief Publishes debug visualization outside of the realtime loop
+     *
+     * This fills in the end-effector wrench and the center-of-gravity markers
+     * from the latest debug sample, and writes them to their ports.
+     */
+    class DebugRelay : public RTT::base::RunnableInterface {
+    public:
+      DebugRelay(IDControllerKDL &owner) : owner_(owner) { }
+      virtual bool initialize() { return true; }
+      virtual void step();
+      virtual void finalize() { }
+    private:
+      IDControllerKDL &owner_;
+      DebugSample sample_;
+    };
+
+    //! Debug data, preallocated in configureHook
+    DebugSample debug_sample_;
+    //! Latest debug data handed off to the relay
+    RTT::base::DataObjectLockFree<DebugSample> debug_buffer_;
+    DebugRelay debug_relay_;
+    boost::scoped_ptr<RTT::Activity> debug_relay_activity_;
+
+    // Debug messages, only used by the debug relay
     geometry_msgs::WrenchStamped wrench_msg_;
-    std::vector<visualization_msgs::Marker> cogs_msgs_;
+    visualization_msgs::MarkerArray cogs_msg_;
+    std::vector<KDL::Vector> cogs_;
 
     rtt_ros_tools::PeriodicThrottle debug_throttle_;
     bool compensate_end_effector_;
-    telemanip_msgs::AttachedInertia end_effector_inertia_;
+    bool gravity_only_;
   };
 }
 
@@ -0,0 +1,152 @@
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include <kdl/chain.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolvervel_wdls.hpp>
+#include <kdl/chainiksolverpos_nr_jl.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include "../test_fixtures.h"
+#include "chain_ik_solver_pos_analytic.h"
+#include "wam_chain.h"
+using namespace lcsr_controllers;
+
+//! Targets along a random walk in joint space on a 7-DOF WAM, each solved
+//! from the previous target's joint positions
+struct Problem
+{
+  Problem(const unsigned int n_targets) :
+    chain(WAMChain()),
+    positions(n_targets, KDL::JntArray(7)),
+    targets(n_targets)
+  {
+    WAMJointLimits(joint_limits_min, joint_limits_max);
+
+    std::srand(0);
+    for(unsigned int i=0; i<7; i++) {
+      positions[0](i) = 0.5 * (joint_limits_min(i) + joint_limits_max(i));
+    }
+
+    // Step by up to 0.01 rad per joint between targets
+    KDL::ChainFkSolverPos_recursive fk_solver(chain);
+    for(unsigned int t=0; t<n_targets; t++) {
+      if(t > 0) {
+        for(unsigned int i=0; i<7; i++) {
+          positions[t](i) = std::max(
+              joint_limits_min(i),
+              std::min(positions[t-1](i) + Random(-0.01, 0.01), joint_limits_max(i)));
+        }
+      }
+      fk_solver.JntToCart(positions[t], targets[t]);
+    }
+  }
+
+  KDL::Chain chain;
+  KDL::JntArray joint_limits_min, joint_limits_max;
+  std::vector<KDL::JntArray> positions;
+  std::vector<KDL::Frame> targets;
+};
+
+static const unsigned int N_TARGETS = 1000;
+
+//! Largest tip position error over the targets
+template <class Solver>
+static double MaxError(Solver &solver, const Problem &problem)
+{
+  KDL::ChainFkSolverPos_recursive fk_solver(problem.chain);
+  KDL::JntArray solution(7);
+  KDL::Frame frame;
+  double max_error = 0.0;
+
+  for(unsigned int t=1; t<N_TARGETS; t++) {
+    if(solver.CartToJnt(problem.positions[t-1], problem.targets[t], solution) < 0) {
+      continue;
+    }
+    fk_solver.JntToCart(solution, frame);
+    max_error = std::max(max_error, (frame.p - problem.targets[t].p).Norm());
+  }
+
+  return max_error;
+}
+
+/******************************************************************************
+ * Solvers
+ ******************************************************************************/
+
+static void BM_NR_JL(benchmark::State& state)
+{
+  Problem problem(N_TARGETS);
+
+  KDL::ChainFkSolverPos_recursive fk_solver(problem.chain);
+  KDL::ChainIkSolverVel_wdls ik_solver_vel(problem.chain, 1.0E-6, 150);
+  ik_solver_vel.setLambda(0.1);
+  KDL::ChainIkSolverPos_NR_JL solver(
+      problem.chain,
+      problem.joint_limits_min,
+      problem.joint_limits_max,
+      fk_solver,
+      ik_solver_vel,
+      10,
+      1.0E-6);
+
+  KDL::JntArray solution(7);
+  unsigned int t = 1, n_failed = 0;
+
+  for(auto _ : state) {
+    n_failed += (solver.CartToJnt(problem.positions[t-1], problem.targets[t], solution) < 0);
+    benchmark::DoNotOptimize(solution.data.data());
+    t = (t + 1 < N_TARGETS) ? t + 1 : 1;
+  }
+
+  state.counters["failed"] = benchmark::Counter(n_failed, benchmark::Counter::kAvgIterations);
+  state.counters["max_error_m"] = MaxError(solver, problem);
+}
+BENCHMARK(BM_NR_JL);
+
+static void BM_Analytic(benchmark::State& state)
+{
+  Problem problem(N_TARGETS);
+
+  ChainIkSolverPosAnalytic solver(
+      problem.chain,
+      problem.joint_limits_min,
+      problem.joint_limits_max);
+
+  KDL::JntArray solution(7);
+  unsigned int t = 1, n_failed = 0;
+
+  for(auto _ : state) {
+    n_failed += (solver.CartToJnt(problem.positions[t-1], problem.targets[t], solution) < 0);
+    benchmark::DoNotOptimize(solution.data.data());
+    t = (t + 1 < N_TARGETS) ? t + 1 : 1;
+  }
+
+  state.counters["failed"] = benchmark::Counter(n_failed, benchmark::Counter::kAvgIterations);
+  state.counters["max_error_m"] = MaxError(solver, problem);
+}
+BENCHMARK(BM_Analytic);
+
+static void BM_Analytic_Branches(benchmark::State& state)
+{
+  Problem problem(N_TARGETS);
+
+  ChainIkSolverPosAnalytic solver(
+      problem.chain,
+      problem.joint_limits_min,
+      problem.joint_limits_max);
+
+  unsigned int t = 1;
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(solver.solveBranches(problem.targets[t], solver.getElbowAngle(problem.positions[t-1])));
+    t = (t + 1 < N_TARGETS) ? t + 1 : 1;
+  }
+}
+BENCHMARK(BM_Analytic_Branches);
+
+BENCHMARK_MAIN();
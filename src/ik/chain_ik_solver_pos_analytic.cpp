@@ -0,0 +1,436 @@
+
+#include <cmath>
+#include <limits>
+
+#include "chain_ik_solver_pos_analytic.h"
+
+using namespace lcsr_controllers;
+
+static const double GEOMETRY_TOLERANCE = 1E-6;
+
+/******************************************************************************
+ * Paden-Kahan subproblems
+ *
+ * Each one solves for the rotations about axes through a point r with unit
+ * directions w.
+ ******************************************************************************/
+
+//! Rotation about (r,w) which takes p to q
+static double Subproblem1(
+    const KDL::Vector &r,
+    const KDL::Vector &w,
+    const KDL::Vector &p,
+    const KDL::Vector &q)
+{
+  KDL::Vector u = p - r, v = q - r;
+  u = u - w * KDL::dot(w, u);
+  v = v - w * KDL::dot(w, v);
+  return std::atan2(KDL::dot(w, u * v), KDL::dot(u, v));
+}
+
+//! Rotations about (r,w1) and then (r,w2) which take p to q
+static unsigned int Subproblem2(
+    const KDL::Vector &r,
+    const KDL::Vector &w1,
+    const KDL::Vector &w2,
+    const KDL::Vector &p,
+    const KDL::Vector &q,
+    double theta1[2],
+    double theta2[2])
+{
+  const KDL::Vector u = p - r, v = q - r, w1xw2 = w1 * w2;
+  const double
+    w12 = KDL::dot(w1, w2),
+    alpha = (w12 * KDL::dot(w2, u) - KDL::dot(w1, v)) / (w12 * w12 - 1.0),
+    beta = (w12 * KDL::dot(w1, v) - KDL::dot(w2, u)) / (w12 * w12 - 1.0),
+    gamma_sq = (KDL::dot(u, u) - alpha * alpha - beta * beta - 2.0 * alpha * beta * w12) / KDL::dot(w1xw2, w1xw2);
+
+  // The intersection of the two circles is only missed through round-off,
+  // since the targets passed in here are always reachable
+  const double gamma = std::sqrt(std::max(0.0, gamma_sq));
+
+  for(unsigned int k=0; k<2; k++) {
+    const KDL::Vector c = r + alpha * w1 + beta * w2 + ((k == 0) ? gamma : -gamma) * w1xw2;
+    theta2[k] = Subproblem1(r, w2, p, c);
+    theta1[k] = Subproblem1(r, w1, c, q);
+  }
+
+  return 2;
+}
+
+//! Rotations about (r,w) which take p to a distance delta from q
+static unsigned int Subproblem3(
+    const KDL::Vector &r,
+    const KDL::Vector &w,
+    const KDL::Vector &p,
+    const KDL::Vector &q,
+    const double delta,
+    double theta[2])
+{
+  KDL::Vector u = p - r, v = q - r;
+  u = u - w * KDL::dot(w, u);
+  v = v - w * KDL::dot(w, v);
+
+  const double
+    u_norm = u.Norm(),
+    v_norm = v.Norm(),
+    axial = KDL::dot(w, p - q),
+    delta_sq = delta * delta - axial * axial;
+
+  if(u_norm < GEOMETRY_TOLERANCE || v_norm < GEOMETRY_TOLERANCE) {
+    return 0;
+  }
+
+  const double cos_offset = (u_norm * u_norm + v_norm * v_norm - delta_sq) / (2.0 * u_norm * v_norm);
+  if(std::abs(cos_offset) > 1.0 + GEOMETRY_TOLERANCE) {
+    return 0;
+  }
+
+  const double
+    theta0 = std::atan2(KDL::dot(w, u * v), KDL::dot(u, v)),
+    offset = std::acos(std::max(-1.0, std::min(cos_offset, 1.0)));
+
+  theta[0] = theta0 + offset;
+  theta[1] = theta0 - offset;
+
+  return 2;
+}
+
+/******************************************************************************
+ * Geometry
+ ******************************************************************************/
+
+//! Intersection of two lines, returns false if they don't intersect
+static bool Intersect(
+    const KDL::Vector &p1,
+    const KDL::Vector &d1,
+    const KDL::Vector &p2,
+    const KDL::Vector &d2,
+    KDL::Vector &intersection)
+{
+  const KDL::Vector w0 = p1 - p2;
+  const double
+    b = KDL::dot(d1, d2),
+    d = KDL::dot(d1, w0),
+    e = KDL::dot(d2, w0),
+    denominator = 1.0 - b * b;
+
+  if(denominator < GEOMETRY_TOLERANCE) {
+    return false;
+  }
+
+  const KDL::Vector
+    c1 = p1 + d1 * ((b * e - d) / denominator),
+    c2 = p2 + d2 * ((e - b * d) / denominator);
+
+  intersection = 0.5 * (c1 + c2);
+  return (c1 - c2).Norm() < GEOMETRY_TOLERANCE;
+}
+
+//! Distance from a point to a line
+static double Distance(
+    const KDL::Vector &point,
+    const KDL::Vector &p,
+    const KDL::Vector &d)
+{
+  return ((point - p) * d).Norm();
+}
+
+//! Wrap an angle into [-pi, pi)
+static double Wrap(const double angle)
+{
+  return angle - 2.0 * M_PI * std::floor((angle + M_PI) / (2.0 * M_PI));
+}
+
+//! Wrap an angle into [-pi, pi), then shift it by a full turn if that brings
+//! it within joint limits which extend past [-pi, pi)
+static double WrapIntoLimits(
+    const double angle,
+    const double min,
+    const double max)
+{
+  const double wrapped = Wrap(angle);
+  if(wrapped > max && wrapped - 2.0 * M_PI >= min) {
+    return wrapped - 2.0 * M_PI;
+  } else if(wrapped < min && wrapped + 2.0 * M_PI <= max) {
+    return wrapped + 2.0 * M_PI;
+  }
+  return wrapped;
+}
+
+ChainIkSolverPosAnalytic::ChainIkSolverPosAnalytic(
+    const KDL::Chain &chain,
+    const KDL::JntArray &joint_limits_min,
+    const KDL::JntArray &joint_limits_max,
+    const double elbow_angle_step,
+    const double eps) :
+  chain_(chain),
+  joint_limits_min_(joint_limits_min),
+  joint_limits_max_(joint_limits_max),
+  elbow_angle_step_(elbow_angle_step),
+  eps_(eps),
+  valid_(false),
+  fk_solver_(chain_),
+  n_branches_(0),
+  branches_(MAX_BRANCHES, KDL::JntArray(chain.getNrOfJoints()))
+{
+  // Get the joint axes at zero joint positions
+  KDL::Frame parent_frame = KDL::Frame::Identity();
+  for(unsigned int s=0; s<chain_.getNrOfSegments(); s++) {
+    const KDL::Segment &segment = chain_.getSegment(s);
+    const KDL::Joint &joint = segment.getJoint();
+
+    switch(joint.getType()) {
+      case KDL::Joint::None:
+        break;
+      case KDL::Joint::RotAxis:
+      case KDL::Joint::RotX:
+      case KDL::Joint::RotY:
+      case KDL::Joint::RotZ:
+        {
+          KDL::Vector axis = parent_frame.M * joint.JointAxis();
+          axis.Normalize();
+          KDL::Vector normal = axis * KDL::Vector(1.0, 0.0, 0.0);
+          if(normal.Norm() < 0.5) {
+            normal = axis * KDL::Vector(0.0, 1.0, 0.0);
+          }
+          normal.Normalize();
+
+          axes_.push_back(axis);
+          points_.push_back(parent_frame * joint.JointOrigin());
+          normals_.push_back(normal);
+        }
+        break;
+      default:
+        // Prismatic joints aren't supported
+        return;
+    };
+
+    parent_frame = parent_frame * segment.pose(0.0);
+  }
+  tip_frame_ = parent_frame;
+
+  if(axes_.size() != 7
+     || joint_limits_min_.rows() != 7
+     || joint_limits_max_.rows() != 7)
+  {
+    return;
+  }
+
+  // The shoulder and wrist axes have to intersect, and the first two axes
+  // of each have to be independent
+  if(!Intersect(points_[0], axes_[0], points_[1], axes_[1], shoulder_)
+     || Distance(shoulder_, points_[2], axes_[2]) > GEOMETRY_TOLERANCE
+     || !Intersect(points_[4], axes_[4], points_[5], axes_[5], wrist_)
+     || Distance(wrist_, points_[6], axes_[6]) > GEOMETRY_TOLERANCE)
+  {
+    return;
+  }
+
+  // The elbow is the point on its axis closest to the shoulder
+  elbow_ = points_[3] + axes_[3] * KDL::dot(axes_[3], shoulder_ - points_[3]);
+
+  valid_ = true;
+}
+
+KDL::Frame ChainIkSolverPosAnalytic::jointMotion(const unsigned int i, const double q) const
+{
+  const KDL::Rotation rotation = KDL::Rotation::Rot2(axes_[i], q);
+  return KDL::Frame(rotation, points_[i] - rotation * points_[i]);
+}
+
+KDL::Vector ChainIkSolverPosAnalytic::elbowReference(const KDL::Vector &axis) const
+{
+  // Use the first joint axis, unless the shoulder-wrist axis is aligned with it
+  KDL::Vector reference = axes_[0] - axis * KDL::dot(axis, axes_[0]);
+  if(reference.Norm() < GEOMETRY_TOLERANCE) {
+    reference = axes_[1] - axis * KDL::dot(axis, axes_[1]);
+  }
+  reference.Normalize();
+  return reference;
+}
+
+double ChainIkSolverPosAnalytic::getElbowAngle(const KDL::JntArray &q) const
+{
+  if(!valid_) {
+    return 0.0;
+  }
+
+  const KDL::Frame shoulder_motion = this->jointMotion(0, q(0)) * this->jointMotion(1, q(1)) * this->jointMotion(2, q(2));
+
+  KDL::Vector axis = shoulder_motion * (this->jointMotion(3, q(3)) * wrist_) - shoulder_;
+  axis.Normalize();
+
+  KDL::Vector elbow = shoulder_motion * elbow_ - shoulder_;
+  elbow = elbow - axis * KDL::dot(axis, elbow);
+
+  const KDL::Vector reference = this->elbowReference(axis);
+  return std::atan2(KDL::dot(axis, reference * elbow), KDL::dot(reference, elbow));
+}
+
+bool ChainIkSolverPosAnalytic::withinLimits(const KDL::JntArray &q) const
+{
+  for(unsigned int i=0; i<q.rows(); i++) {
+    if(q(i) < joint_limits_min_(i) || q(i) > joint_limits_max_(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+unsigned int ChainIkSolverPosAnalytic::solveBranches(
+    const KDL::Frame &p_in,
+    const double elbow_angle)
+{
+  n_branches_ = 0;
+
+  if(!valid_) {
+    return 0;
+  }
+
+  // Motion of the chain from its zero position, and the wrist at the target
+  const KDL::Frame motion = p_in * tip_frame_.Inverse();
+  const KDL::Vector wrist = motion * wrist_ - shoulder_;
+  const double reach = wrist.Norm();
+
+  if(reach < GEOMETRY_TOLERANCE) {
+    return 0;
+  }
+
+  KDL::Vector axis = wrist / reach;
+  const KDL::Vector reference = this->elbowReference(axis);
+
+  // Elbow: the shoulder-wrist distance only depends on joint 4
+  double q4[2];
+  const unsigned int n_elbow = Subproblem3(points_[3], axes_[3], wrist_, shoulder_, reach, q4);
+
+  for(unsigned int e=0; e<n_elbow; e++) {
+    const KDL::Frame elbow_motion = this->jointMotion(3, q4[e]);
+
+    // The shoulder rotates the wrist onto the target wrist: start from the
+    // smallest such rotation, and then swing the elbow to its angle
+    const KDL::Vector wrist_zero = elbow_motion * wrist_ - shoulder_;
+    KDL::Vector swing_axis = wrist_zero * wrist;
+    const double swing_angle = std::atan2(swing_axis.Norm(), KDL::dot(wrist_zero, wrist));
+    if(swing_axis.Norm() < GEOMETRY_TOLERANCE) {
+      swing_axis = (std::abs(KDL::dot(axis, axes_[0])) < 0.5) ? axis * axes_[0] : axis * axes_[1];
+    }
+    swing_axis.Normalize();
+    const KDL::Rotation swing = KDL::Rotation::Rot2(swing_axis, swing_angle);
+
+    KDL::Vector elbow = swing * (elbow_ - shoulder_);
+    elbow = elbow - axis * KDL::dot(axis, elbow);
+    const double swing_elbow_angle = std::atan2(KDL::dot(axis, reference * elbow), KDL::dot(reference, elbow));
+
+    const KDL::Rotation shoulder_rotation = KDL::Rotation::Rot2(axis, elbow_angle - swing_elbow_angle) * swing;
+    const KDL::Frame shoulder_motion(shoulder_rotation, shoulder_ - shoulder_rotation * shoulder_);
+
+    // Shoulder: joints 1 and 2 align joint 3's axis, then joint 3 turns about it
+    double q1[2], q2[2];
+    const unsigned int n_shoulder = Subproblem2(
+        shoulder_, axes_[0], axes_[1],
+        shoulder_ + axes_[2],
+        shoulder_motion * (shoulder_ + axes_[2]),
+        q1, q2);
+
+    for(unsigned int s=0; s<n_shoulder; s++) {
+      const KDL::Frame upper_motion = this->jointMotion(0, q1[s]) * this->jointMotion(1, q2[s]);
+      const double q3 = Subproblem1(
+          shoulder_, axes_[2],
+          shoulder_ + normals_[2],
+          upper_motion.Inverse() * (shoulder_motion * (shoulder_ + normals_[2])));
+
+      // Wrist: the rest of the motion is a rotation about the wrist center
+      const KDL::Frame wrist_motion = (upper_motion * this->jointMotion(2, q3) * elbow_motion).Inverse() * motion;
+
+      double q5[2], q6[2];
+      const unsigned int n_wrist = Subproblem2(
+          wrist_, axes_[4], axes_[5],
+          wrist_ + axes_[6],
+          wrist_motion * (wrist_ + axes_[6]),
+          q5, q6);
+
+      for(unsigned int w=0; w<n_wrist; w++) {
+        const KDL::Frame lower_motion = this->jointMotion(4, q5[w]) * this->jointMotion(5, q6[w]);
+        const double q7 = Subproblem1(
+            wrist_, axes_[6],
+            wrist_ + normals_[6],
+            lower_motion.Inverse() * (wrist_motion * (wrist_ + normals_[6])));
+
+        KDL::JntArray &branch = branches_[n_branches_];
+        branch(0) = q1[s];
+        branch(1) = q2[s];
+        branch(2) = q3;
+        branch(3) = q4[e];
+        branch(4) = q5[w];
+        branch(5) = q6[w];
+        branch(6) = q7;
+        for(unsigned int i=0; i<7; i++) {
+          branch(i) = WrapIntoLimits(branch(i), joint_limits_min_(i), joint_limits_max_(i));
+        }
+
+        // Drop solutions which were lost to round-off near singularities
+        if(fk_solver_.JntToCart(branch, frame_) >= 0 && KDL::Equal(frame_, p_in, eps_)) {
+          n_branches_++;
+        }
+      }
+    }
+  }
+
+  return n_branches_;
+}
+
+int ChainIkSolverPosAnalytic::CartToJnt(
+    const KDL::JntArray &q_init,
+    const KDL::Frame &p_in,
+    KDL::JntArray &q_out)
+{
+  if(!valid_) {
+    return -3;
+  }
+
+  const double elbow_angle = this->getElbowAngle(q_init);
+  const int n_steps = (elbow_angle_step_ > 0.0) ? static_cast<int>(std::ceil(M_PI / elbow_angle_step_)) : 0;
+
+  // Search outwards from the initial elbow angle
+  bool reachable = false;
+  for(int step=0; step<=n_steps; step++) {
+    for(int sign=1; sign>=-1; sign-=2) {
+      if(step == 0 && sign < 0) {
+        continue;
+      }
+
+      // Branches can be lost to round-off at some elbow angles (for example
+      // where the shoulder or wrist is singular), so keep searching
+      if(this->solveBranches(p_in, elbow_angle + sign * step * elbow_angle_step_) == 0) {
+        continue;
+      }
+      reachable = true;
+
+      // Keep the branch closest to the initial positions
+      int best = -1;
+      double best_distance = std::numeric_limits<double>::max();
+      for(unsigned int b=0; b<n_branches_; b++) {
+        if(!this->withinLimits(branches_[b])) {
+          continue;
+        }
+        double distance = 0.0;
+        for(unsigned int i=0; i<q_init.rows(); i++) {
+          const double difference = Wrap(branches_[b](i) - q_init(i));
+          distance += difference * difference;
+        }
+        if(distance < best_distance) {
+          best = b;
+          best_distance = distance;
+        }
+      }
+
+      if(best >= 0) {
+        q_out = branches_[best];
+        return 0;
+      }
+    }
+  }
+
+  return reachable ? -2 : -1;
+}
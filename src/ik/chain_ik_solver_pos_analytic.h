@@ -0,0 +1,116 @@
+#ifndef __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANALYTIC_H
+#define __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANALYTIC_H
+
+#include <vector>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/chainiksolver.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Closed-form position IK for 7-DOF WAM-class arms
+   *
+   * This solves arms with a spherical shoulder (joints 1-3 intersect), an
+   * elbow (joint 4, which may be offset from the shoulder and the wrist), and
+   * a spherical wrist (joints 5-7 intersect), like the Barrett WAM. The
+   * geometry is extracted from the chain on construction, so it doesn't
+   * depend on a particular DH convention.
+   *
+   * The redundancy is parameterized by the elbow angle: the angle of the
+   * elbow around the line from the shoulder to the wrist, measured from the
+   * plane which contains that line and the first joint axis. For a given
+   * target and elbow angle there are up to eight solutions, from the two
+   * elbow, shoulder and wrist branches. Each one is computed with
+   * Paden-Kahan subproblems on the chain's product-of-exponentials form, so a
+   * solve takes the same (small) number of operations every time.
+   *
+   * As a KDL::ChainIkSolverPos, it solves at the elbow angle of the initial
+   * joint positions, and returns the solution within the joint limits which
+   * is closest to them. If no solution is within the limits, it searches for
+   * the closest elbow angle which has one.
+   */
+  class ChainIkSolverPosAnalytic : public KDL::ChainIkSolverPos {
+  public:
+    static const unsigned int MAX_BRANCHES = 8;
+
+    ChainIkSolverPosAnalytic(
+        const KDL::Chain &chain,
+        const KDL::JntArray &joint_limits_min,
+        const KDL::JntArray &joint_limits_max,
+        const double elbow_angle_step = 0.05,
+        const double eps = 1E-6);
+
+    //! True if the chain has the structure this solver needs
+    bool isValid() const { return valid_; }
+
+    /** \brief Solve for the branch closest to q_init, at its elbow angle
+     *
+     * Returns: 0 on success, -1 if there are no solutions at any elbow
+     * angle (the target is out of reach), -2 if no solution is within the
+     * joint limits, -3 if the chain isn't supported
+     */
+    virtual int CartToJnt(
+        const KDL::JntArray &q_init,
+        const KDL::Frame &p_in,
+        KDL::JntArray &q_out);
+
+    //! Nothing to update, the chain is copied on construction
+    virtual void updateInternalDataStructures() { }
+
+    /** \brief Compute every solution branch for a target at an elbow angle
+     *
+     * The solutions aren't checked against the joint limits, but each joint
+     * position is wrapped into [-pi, pi), or shifted by a full turn from there
+     * if that brings it within the limits. They're available from getBranch()
+     * until the next solve.
+     *
+     * Returns: the number of solutions
+     */
+    unsigned int solveBranches(
+        const KDL::Frame &p_in,
+        const double elbow_angle);
+
+    //! Get a solution computed by the last solve
+    const KDL::JntArray& getBranch(const unsigned int i) const { return branches_[i]; }
+
+    //! Compute the elbow angle of a set of joint positions
+    double getElbowAngle(const KDL::JntArray &q) const;
+
+    //! True if joint positions are within the joint limits
+    bool withinLimits(const KDL::JntArray &q) const;
+
+  private:
+    //! Rotation about joint i's axis (in the root frame, at zero position)
+    KDL::Frame jointMotion(const unsigned int i, const double q) const;
+    //! Direction from which elbow angles are measured, around a shoulder-wrist axis
+    KDL::Vector elbowReference(const KDL::Vector &axis) const;
+
+    KDL::Chain chain_;
+    KDL::JntArray joint_limits_min_;
+    KDL::JntArray joint_limits_max_;
+    double elbow_angle_step_;
+    double eps_;
+    bool valid_;
+
+    // Geometry at zero joint positions, in the root frame
+    std::vector<KDL::Vector> axes_;
+    std::vector<KDL::Vector> points_;
+    //! A unit vector perpendicular to each axis
+    std::vector<KDL::Vector> normals_;
+    KDL::Frame tip_frame_;
+    KDL::Vector shoulder_;
+    KDL::Vector elbow_;
+    KDL::Vector wrist_;
+
+    // Working variables
+    KDL::ChainFkSolverPos_recursive fk_solver_;
+    KDL::Frame frame_;
+    unsigned int n_branches_;
+    std::vector<KDL::JntArray> branches_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANALYTIC_H
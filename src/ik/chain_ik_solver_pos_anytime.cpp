@@ -0,0 +1,98 @@
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include <rtt/os/TimeService.hpp>
+
+#include "chain_ik_solver_pos_anytime.h"
+
+using namespace lcsr_controllers;
+
+ChainIkSolverPosAnytime::ChainIkSolverPosAnytime(
+    const KDL::Chain &chain,
+    const KDL::JntArray &joint_limits_min,
+    const KDL::JntArray &joint_limits_max,
+    const double budget,
+    const double damping,
+    const double eps) :
+  chain_(chain),
+  joint_limits_min_(joint_limits_min),
+  joint_limits_max_(joint_limits_max),
+  budget_(budget),
+  eps_(eps),
+  fk_solver_(chain_),
+  ik_solver_vel_(chain_, 1.0E-6, 150),
+  resume_(false),
+  residual_(0.0),
+  iterations_(0),
+  best_positions_(chain.getNrOfJoints()),
+  positions_(chain.getNrOfJoints()),
+  delta_positions_(chain.getNrOfJoints())
+{
+  ik_solver_vel_.setLambda(damping);
+}
+
+double ChainIkSolverPosAnytime::computeResidual(
+    const KDL::JntArray &q,
+    const KDL::Frame &p_in)
+{
+  fk_solver_.JntToCart(q, frame_);
+  delta_twist_ = KDL::diff(frame_, p_in);
+  return std::sqrt(KDL::dot(delta_twist_.vel, delta_twist_.vel) + KDL::dot(delta_twist_.rot, delta_twist_.rot));
+}
+
+int ChainIkSolverPosAnytime::CartToJnt(
+    const KDL::JntArray &q_init,
+    const KDL::Frame &p_in,
+    KDL::JntArray &q_out)
+{
+  RTT::os::TimeService *ts = RTT::os::TimeService::Instance();
+  RTT::os::TimeService::ticks tic = ts->getTicks();
+
+  const unsigned int n_dof = chain_.getNrOfJoints();
+  if(q_init.rows() != n_dof || q_out.rows() != n_dof) {
+    return -1;
+  }
+
+  // Resume from the last best iterate if it's closer to the target
+  positions_ = q_init;
+  if(resume_ && this->computeResidual(best_positions_, p_in) < this->computeResidual(q_init, p_in)) {
+    positions_ = best_positions_;
+  }
+
+  residual_ = std::numeric_limits<double>::max();
+  iterations_ = 0;
+
+  for(;;) {
+    // Keep the best iterate
+    const double residual = this->computeResidual(positions_, p_in);
+    if(residual < residual_) {
+      residual_ = residual;
+      best_positions_ = positions_;
+    }
+
+    if(residual < eps_) {
+      resume_ = false;
+      q_out = best_positions_;
+      return 0;
+    }
+
+    if(iterations_ > 0 && ts->secondsSince(tic) >= budget_) {
+      break;
+    }
+
+    // Step towards the target, and clamp to the joint limits
+    ik_solver_vel_.CartToJnt(positions_, delta_twist_, delta_positions_);
+    KDL::Add(positions_, delta_positions_, positions_);
+
+    for(unsigned int i=0; i<n_dof; i++) {
+      positions_(i) = std::max(joint_limits_min_(i), std::min(positions_(i), joint_limits_max_(i)));
+    }
+
+    iterations_++;
+  }
+
+  resume_ = true;
+  q_out = best_positions_;
+  return 1;
+}
@@ -0,0 +1,87 @@
+#ifndef __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANYTIME_H
+#define __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANYTIME_H
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/chainiksolver.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolvervel_wdls.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Newton-Raphson position IK bounded by a time budget
+   *
+   * This iterates like KDL::ChainIkSolverPos_NR_JL (a damped least-squares
+   * step, clamped to the joint limits), but instead of a fixed number of
+   * iterations it runs until the target is reached or the time budget
+   * (measured with RTT::os::TimeService) runs out. Either way it returns the
+   * iterate with the smallest residual so far.
+   *
+   * If a solve runs out of time, the next one resumes from its best iterate
+   * (unless the initial positions are closer to the new target), so a hard
+   * target is reached over several cycles while each cycle still has an
+   * output.
+   */
+  class ChainIkSolverPosAnytime : public KDL::ChainIkSolverPos {
+  public:
+    ChainIkSolverPosAnytime(
+        const KDL::Chain &chain,
+        const KDL::JntArray &joint_limits_min,
+        const KDL::JntArray &joint_limits_max,
+        const double budget,
+        const double damping,
+        const double eps = 1E-6);
+
+    //! Set the time budget for each solve, in seconds
+    void setBudget(const double budget) { budget_ = budget; }
+
+    /** \brief Iterate towards a target until it's reached or the budget runs out
+     *
+     * Returns: 0 if the target was reached, 1 if the budget ran out (q_out is
+     * then the best iterate), -1 if the array sizes don't match the chain
+     */
+    virtual int CartToJnt(
+        const KDL::JntArray &q_init,
+        const KDL::Frame &p_in,
+        KDL::JntArray &q_out);
+
+    //! Nothing to update, the chain is copied on construction
+    virtual void updateInternalDataStructures() { }
+
+    //! Start the next solve from its initial positions, even if the last one ran out of time
+    void reset() { resume_ = false; }
+
+    //! The residual of the last solution (the norm of the twist to the target)
+    double getResidual() const { return residual_; }
+    //! The number of iterations of the last solve
+    unsigned int getIterations() const { return iterations_; }
+
+  private:
+    //! Compute the twist from the forward kinematics of q to the target, and its norm
+    double computeResidual(const KDL::JntArray &q, const KDL::Frame &p_in);
+
+    KDL::Chain chain_;
+    KDL::JntArray joint_limits_min_;
+    KDL::JntArray joint_limits_max_;
+    double budget_;
+    double eps_;
+
+    KDL::ChainFkSolverPos_recursive fk_solver_;
+    KDL::ChainIkSolverVel_wdls ik_solver_vel_;
+
+    // Solver state
+    bool resume_;
+    double residual_;
+    unsigned int iterations_;
+    KDL::JntArray best_positions_;
+
+    // Working variables
+    KDL::JntArray positions_;
+    KDL::JntArray delta_positions_;
+    KDL::Frame frame_;
+    KDL::Twist delta_twist_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_CHAIN_IK_SOLVER_POS_ANYTIME_H
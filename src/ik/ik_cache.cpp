@@ -0,0 +1,137 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include <boost/functional/hash.hpp>
+
+#include "ik_cache.h"
+
+using namespace lcsr_controllers;
+
+bool IKCache::Key::operator==(const Key &other) const
+{
+  return
+    position[0] == other.position[0] &&
+    position[1] == other.position[1] &&
+    position[2] == other.position[2] &&
+    rotation[0] == other.rotation[0] &&
+    rotation[1] == other.rotation[1] &&
+    rotation[2] == other.rotation[2] &&
+    hint == other.hint;
+}
+
+IKCache::IKCache(
+    const KDL::Chain &chain,
+    const unsigned int capacity,
+    const double position_resolution,
+    const double rotation_resolution,
+    const double hint_resolution,
+    const double tolerance) :
+  position_resolution_(position_resolution),
+  rotation_resolution_(rotation_resolution),
+  hint_resolution_(hint_resolution),
+  tolerance_(tolerance),
+  entries_(capacity),
+  clock_(0),
+  fk_solver_(chain)
+{
+  for(std::vector<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    it->solution.resize(chain.getNrOfJoints());
+  }
+}
+
+void IKCache::computeKey(
+    const KDL::Frame &target,
+    const KDL::JntArray &hint,
+    Key &key) const
+{
+  // Quantize the position and the rotation vector
+  const KDL::Vector rotation = target.M.GetRot();
+  for(unsigned int i=0; i<3; i++) {
+    key.position[i] = std::floor(target.p(i) / position_resolution_ + 0.5);
+    key.rotation[i] = std::floor(rotation(i) / rotation_resolution_ + 0.5);
+  }
+
+  // Within a cell of a half turn, negating the rotation vector gives a
+  // rotation less than two cells away, and round-off can make GetRot() return
+  // either sign for the same rotation, so use whichever quantizes to the
+  // lesser key
+  if(rotation.Norm() > M_PI - rotation_resolution_) {
+    long flipped[3];
+    for(unsigned int i=0; i<3; i++) {
+      flipped[i] = std::floor(-rotation(i) / rotation_resolution_ + 0.5);
+    }
+    if(std::lexicographical_compare(flipped, flipped + 3, key.rotation, key.rotation + 3)) {
+      std::copy(flipped, flipped + 3, key.rotation);
+    }
+  }
+
+  // Quantize and hash the hint
+  key.hint = 0;
+  for(unsigned int i=0; i<hint.rows(); i++) {
+    boost::hash_combine(key.hint, static_cast<long>(std::floor(hint(i) / hint_resolution_ + 0.5)));
+  }
+}
+
+IKCache::LookupResult IKCache::lookup(
+    const KDL::Frame &target,
+    const KDL::JntArray &hint,
+    KDL::JntArray &solution)
+{
+  this->computeKey(target, hint, key_);
+
+  for(std::vector<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    if(it->valid && it->key == key_) {
+      it->last_used = ++clock_;
+      solution = it->solution;
+
+      // Check that the solution actually reaches this target
+      if(fk_solver_.JntToCart(solution, frame_) >= 0 && KDL::Equal(frame_, target, tolerance_)) {
+        return HIT;
+      }
+
+      return NEAR_HIT;
+    }
+  }
+
+  return MISS;
+}
+
+void IKCache::insert(
+    const KDL::Frame &target,
+    const KDL::JntArray &hint,
+    const KDL::JntArray &solution)
+{
+  if(entries_.empty()) {
+    return;
+  }
+
+  this->computeKey(target, hint, key_);
+
+  // Replace the entry with the same key, or an empty entry, or the least-recently-used entry
+  std::vector<Entry>::iterator replace = entries_.begin();
+  for(std::vector<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    if(it->valid && it->key == key_) {
+      replace = it;
+      break;
+    } else if(!it->valid) {
+      if(replace->valid) {
+        replace = it;
+      }
+    } else if(replace->valid && it->last_used < replace->last_used) {
+      replace = it;
+    }
+  }
+
+  replace->valid = true;
+  replace->last_used = ++clock_;
+  replace->key = key_;
+  replace->solution = solution;
+}
+
+void IKCache::clear()
+{
+  for(std::vector<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    it->valid = false;
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef __LCSR_CONTROLLERS_IK_CACHE_H
+#define __LCSR_CONTROLLERS_IK_CACHE_H
+
+#include <vector>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief A least-recently-used cache of IK solutions
+   *
+   * Solutions are keyed by the target frame and the IK hint, each quantized
+   * to a given resolution, so a target which hasn't moved (or has only moved
+   * within a quantization cell) finds the solution from a previous cycle.
+   * Near a half turn, where the rotation vector's sign is ambiguous, the
+   * rotation vector and its negation share a key. The hint is hashed, so
+   * different hints can collide.
+   * Before a cached solution is returned, its forward kinematics are checked
+   * against the target:
+   *
+   *  - HIT: the solution reaches the target within the tolerance, and can be
+   *    used without solving
+   *  - NEAR_HIT: the solution is for a nearby target, and is a good starting
+   *    point for the solver
+   *  - MISS: there's no solution for this target
+   *
+   * The cache has a fixed capacity and is searched linearly, so it never
+   * allocates after construction.
+   */
+  class IKCache {
+  public:
+    enum LookupResult {
+      MISS = 0,
+      NEAR_HIT = 1,
+      HIT = 2
+    };
+
+    IKCache(
+        const KDL::Chain &chain,
+        const unsigned int capacity,
+        const double position_resolution,
+        const double rotation_resolution,
+        const double hint_resolution,
+        const double tolerance);
+
+    //! Look up a solution for a target and hint
+    LookupResult lookup(
+        const KDL::Frame &target,
+        const KDL::JntArray &hint,
+        KDL::JntArray &solution);
+
+    //! Store a solution, evicting the least-recently-used one if the cache is full
+    void insert(
+        const KDL::Frame &target,
+        const KDL::JntArray &hint,
+        const KDL::JntArray &solution);
+
+    //! Remove all solutions
+    void clear();
+
+  private:
+    struct Key {
+      long position[3];
+      long rotation[3];
+      size_t hint;
+      bool operator==(const Key &other) const;
+    };
+
+    struct Entry {
+      Entry() : valid(false), last_used(0) { }
+      bool valid;
+      unsigned long last_used;
+      Key key;
+      KDL::JntArray solution;
+    };
+
+    void computeKey(
+        const KDL::Frame &target,
+        const KDL::JntArray &hint,
+        Key &key) const;
+
+    double position_resolution_;
+    double rotation_resolution_;
+    double hint_resolution_;
+    double tolerance_;
+
+    std::vector<Entry> entries_;
+    unsigned long clock_;
+
+    // Working variables
+    KDL::ChainFkSolverPos_recursive fk_solver_;
+    KDL::Frame frame_;
+    Key key_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_IK_CACHE_H
@@ -0,0 +1,214 @@
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include "multi_start_ik.h"
+
+using namespace lcsr_controllers;
+
+MultiStartIK::Solvers::Solvers(
+    const KDL::Chain &chain,
+    const KDL::JntArray &joint_limits_min,
+    const KDL::JntArray &joint_limits_max,
+    const double damping) :
+  fk_solver(chain),
+  ik_solver_vel(chain, 1.0E-6, 150),
+  ik_solver_pos(chain, joint_limits_min, joint_limits_max, fk_solver, ik_solver_vel, 10, 1.0E-6),
+  positions(chain.getNrOfJoints())
+{
+  ik_solver_vel.setLambda(damping);
+}
+
+MultiStartIK::MultiStartIK(
+    const KDL::Chain &chain,
+    const KDL::JntArray &joint_limits_min,
+    const KDL::JntArray &joint_limits_max,
+    const unsigned int n_starts,
+    const unsigned int n_threads,
+    const double timeout,
+    const double damping) :
+  n_dof_(chain.getNrOfJoints()),
+  n_starts_(std::max(1U, n_starts)),
+  timeout_(timeout),
+  joint_limits_min_(joint_limits_min),
+  joint_limits_max_(joint_limits_max),
+  request_buffer_(Request()),
+  result_buffer_(Result()),
+  coordinator_(*this),
+  solved_sequence_(0),
+  shutdown_(false),
+  generation_(0),
+  next_start_(n_starts_),
+  n_finished_(0),
+  starts_(n_starts_, KDL::JntArray(n_dof_)),
+  solutions_(n_starts_, KDL::JntArray(n_dof_)),
+  solved_(n_starts_, false)
+{
+  // Preallocate the requests and results
+  pending_request_.current.resize(n_dof_);
+  pending_request_.previous.resize(n_dof_);
+  pending_request_.hint.resize(n_dof_);
+  request_buffer_.data_sample(pending_request_);
+  request_ = pending_request_;
+
+  result_.positions.resize(n_dof_);
+  result_buffer_.data_sample(result_);
+
+  // Create the workers, each with its own solvers
+  for(unsigned int w=0; w<std::max(1U, n_threads); w++) {
+    solvers_.push_back(boost::shared_ptr<Solvers>(
+          new Solvers(chain, joint_limits_min, joint_limits_max, damping)));
+    workers_.create_thread(boost::bind(&MultiStartIK::work, this, w));
+  }
+
+  coordinator_activity_.reset(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.0, &coordinator_, "multi_start_ik"));
+  coordinator_activity_->start();
+}
+
+MultiStartIK::~MultiStartIK()
+{
+  coordinator_activity_->stop();
+
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_ready_.notify_all();
+  workers_.join_all();
+}
+
+void MultiStartIK::request(const Request &request)
+{
+  pending_request_.target = request.target;
+  pending_request_.current = request.current;
+  pending_request_.previous = request.previous;
+  pending_request_.hint = request.hint;
+  pending_request_.sequence++;
+
+  request_buffer_.Set(pending_request_);
+  coordinator_activity_->trigger();
+}
+
+bool MultiStartIK::getResult(Result &result, const unsigned int last_sequence) const
+{
+  result_buffer_.Get(result);
+  return result.sequence != last_sequence;
+}
+
+void MultiStartIK::solve()
+{
+  request_buffer_.Get(request_);
+
+  // Only solve each request once
+  if(request_.sequence == solved_sequence_) {
+    return;
+  }
+  solved_sequence_ = request_.sequence;
+
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    // Seed the solves from the current position, the previous solution, the
+    // hint, the center of the joint range, and random positions
+    for(unsigned int k=0; k<n_starts_; k++) {
+      switch(k) {
+        case 0:
+          starts_[k] = request_.current; break;
+        case 1:
+          starts_[k] = request_.previous; break;
+        case 2:
+          starts_[k] = request_.hint; break;
+        case 3:
+          starts_[k].data = (joint_limits_min_.data + joint_limits_max_.data)/2.0; break;
+        default:
+          for(unsigned int i=0; i<n_dof_; i++) {
+            boost::random::uniform_real_distribution<double> range(
+                std::min(joint_limits_min_(i), joint_limits_max_(i)),
+                std::max(joint_limits_min_(i), joint_limits_max_(i)));
+            starts_[k](i) = range(random_);
+          }
+          break;
+      };
+    }
+
+    // Start a new generation of work
+    generation_++;
+    target_ = request_.target;
+    std::fill(solved_.begin(), solved_.end(), false);
+    next_start_ = 0;
+    n_finished_ = 0;
+    work_ready_.notify_all();
+
+    // Wait until all the solves finish or the deadline passes
+    const boost::system_time deadline =
+      boost::get_system_time() + boost::posix_time::microseconds(static_cast<long>(timeout_ * 1E6));
+    while(n_finished_ < n_starts_) {
+      if(!work_done_.timed_wait(lock, deadline)) {
+        break;
+      }
+    }
+
+    // Drop any solves which haven't started yet
+    next_start_ = n_starts_;
+
+    // Keep the solution closest to the current position
+    result_.valid = false;
+    for(unsigned int k=0; k<n_starts_; k++) {
+      if(solved_[k]) {
+        const double cost = (solutions_[k].data - request_.current.data).squaredNorm();
+        if(!result_.valid || cost < result_.cost) {
+          result_.positions = solutions_[k];
+          result_.cost = cost;
+          result_.valid = true;
+        }
+      }
+    }
+  }
+
+  result_.sequence = request_.sequence;
+  result_buffer_.Set(result_);
+}
+
+void MultiStartIK::work(const unsigned int worker)
+{
+  Solvers &solvers = *solvers_[worker];
+  KDL::JntArray start(n_dof_);
+  KDL::Frame target;
+
+  boost::unique_lock<boost::mutex> lock(mutex_);
+
+  while(true) {
+    // Wait for a start to solve from
+    while(!shutdown_ && next_start_ >= n_starts_) {
+      work_ready_.wait(lock);
+    }
+
+    if(shutdown_) {
+      return;
+    }
+
+    // Claim the next start
+    const unsigned int
+      generation = generation_,
+      k = next_start_++;
+    start = starts_[k];
+    target = target_;
+
+    // Solve without holding the lock
+    lock.unlock();
+    const int ik_ret = solvers.ik_solver_pos.CartToJnt(start, target, solvers.positions);
+    lock.lock();
+
+    // Drop the solution if the coordinator has moved on
+    if(generation == generation_) {
+      solutions_[k] = solvers.positions;
+      solved_[k] = (ik_ret >= 0);
+      n_finished_++;
+      work_done_.notify_one();
+    }
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef __LCSR_CONTROLLERS_MULTI_START_IK_H
+#define __LCSR_CONTROLLERS_MULTI_START_IK_H
+
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+#include <rtt/Activity.hpp>
+#include <rtt/base/RunnableInterface.hpp>
+#include <rtt/base/DataObjectLockFree.hpp>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolvervel_wdls.hpp>
+#include <kdl/chainiksolverpos_nr_jl.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Asynchronous inverse kinematics from several starting points
+   *
+   * A single Newton-Raphson IK solve can fail from a poor starting point. This
+   * seeds several solves for the same target: from the current position, the
+   * previous solution, the hint, the center of the joint range, and uniformly
+   * random positions within the joint limits. The solves are run on a pool
+   * of worker threads, each with its own KDL solvers, until they all finish or
+   * a deadline passes. The solution closest to the current position is kept.
+   *
+   * The realtime thread only posts requests and reads the latest finished
+   * result. Both are lock-free, and neither waits for the solvers.
+   */
+  class MultiStartIK {
+  public:
+    struct Request {
+      Request() : sequence(0) { }
+      KDL::Frame target;
+      KDL::JntArray current;
+      KDL::JntArray previous;
+      KDL::JntArray hint;
+      unsigned int sequence;
+    };
+
+    struct Result {
+      Result() : valid(false), cost(0.0), sequence(0) { }
+      KDL::JntArray positions;
+      bool valid;
+      //! Squared joint-space distance from the current position
+      double cost;
+      //! The sequence number of the request this answers
+      unsigned int sequence;
+    };
+
+    MultiStartIK(
+        const KDL::Chain &chain,
+        const KDL::JntArray &joint_limits_min,
+        const KDL::JntArray &joint_limits_max,
+        const unsigned int n_starts,
+        const unsigned int n_threads,
+        const double timeout,
+        const double damping);
+    ~MultiStartIK();
+
+    //! Post a new request, replacing any request which hasn't been started yet
+    void request(const Request &request);
+
+    //! Get the latest finished result, returns true if it's newer than last_sequence
+    bool getResult(Result &result, const unsigned int last_sequence) const;
+
+  private:
+    //! Runs the solves for the latest request and publishes the result
+    class Coordinator : public RTT::base::RunnableInterface {
+    public:
+      Coordinator(MultiStartIK &owner) : owner_(owner) { }
+      virtual bool initialize() { return true; }
+      virtual void step() { owner_.solve(); }
+      virtual void finalize() { }
+    private:
+      MultiStartIK &owner_;
+    };
+
+    //! KDL solvers owned by a single worker thread
+    struct Solvers {
+      Solvers(
+          const KDL::Chain &chain,
+          const KDL::JntArray &joint_limits_min,
+          const KDL::JntArray &joint_limits_max,
+          const double damping);
+
+      KDL::ChainFkSolverPos_recursive fk_solver;
+      KDL::ChainIkSolverVel_wdls ik_solver_vel;
+      KDL::ChainIkSolverPos_NR_JL ik_solver_pos;
+      KDL::JntArray positions;
+    };
+
+    void solve();
+    void work(const unsigned int worker);
+
+    unsigned int n_dof_;
+    unsigned int n_starts_;
+    double timeout_;
+    KDL::JntArray joint_limits_min_;
+    KDL::JntArray joint_limits_max_;
+
+    // Realtime interface
+    Request pending_request_;
+    RTT::base::DataObjectLockFree<Request> request_buffer_;
+    RTT::base::DataObjectLockFree<Result> result_buffer_;
+    Coordinator coordinator_;
+    boost::scoped_ptr<RTT::Activity> coordinator_activity_;
+
+    // Coordinator state
+    Request request_;
+    unsigned int solved_sequence_;
+    Result result_;
+    boost::random::mt19937 random_;
+
+    // Work shared between the coordinator and the workers (guarded by mutex_)
+    boost::mutex mutex_;
+    boost::condition_variable work_ready_;
+    boost::condition_variable work_done_;
+    bool shutdown_;
+    unsigned int generation_;
+    unsigned int next_start_;
+    unsigned int n_finished_;
+    KDL::Frame target_;
+    std::vector<KDL::JntArray> starts_;
+    std::vector<KDL::JntArray> solutions_;
+    std::vector<bool> solved_;
+
+    std::vector<boost::shared_ptr<Solvers> > solvers_;
+    boost::thread_group workers_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_MULTI_START_IK_H
@@ -0,0 +1,354 @@
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <boost/shared_ptr.hpp>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+
+#include <gtest/gtest.h>
+
+#include "../test_fixtures.h"
+#include "chain_ik_solver_pos_analytic.h"
+#include "ik_cache.h"
+#include "wam_chain.h"
+using namespace lcsr_controllers;
+
+/******************************************************************************
+ * Each test solves for targets computed with forward kinematics on a WAM, and
+ * checks that the solutions reach the targets again, or checks which cached
+ * solutions are found for them.
+ ******************************************************************************/
+
+//! Largest difference between two joint positions, modulo full turns
+static double JointError(const KDL::JntArray &a, const KDL::JntArray &b)
+{
+  double max_error = 0.0;
+  for(unsigned int i=0; i<a.rows(); i++) {
+    const double error = std::abs(std::remainder(a(i) - b(i), 2.0 * M_PI));
+    max_error = std::max(max_error, error);
+  }
+  return max_error;
+}
+
+class AnalyticIKTest : public ::testing::Test {
+public:
+  double tolerance;
+  KDL::Chain chain;
+  KDL::JntArray joint_limits_min, joint_limits_max;
+  boost::shared_ptr<KDL::ChainFkSolverPos_recursive> fk_solver;
+  boost::shared_ptr<ChainIkSolverPosAnalytic> ik_solver;
+
+  virtual void SetUp() {
+    tolerance = 1E-6;
+    chain = WAMChain();
+    WAMJointLimits(joint_limits_min, joint_limits_max);
+    fk_solver.reset(new KDL::ChainFkSolverPos_recursive(chain));
+    ik_solver.reset(new ChainIkSolverPosAnalytic(chain, joint_limits_min, joint_limits_max));
+
+    std::srand(0);
+  }
+
+  //! Joint positions drawn uniformly from within the joint limits
+  KDL::JntArray randomPositions() {
+    KDL::JntArray q(7);
+    for(unsigned int i=0; i<7; i++) {
+      q(i) = Random(joint_limits_min(i), joint_limits_max(i));
+    }
+    return q;
+  }
+
+  KDL::Frame forward(const KDL::JntArray &q) {
+    KDL::Frame frame;
+    EXPECT_GE(fk_solver->JntToCart(q, frame), 0);
+    return frame;
+  }
+
+  //! Check that a target is reached from q_init, within the joint limits
+  void expectSolution(const KDL::JntArray &q_init, const KDL::Frame &target) {
+    KDL::JntArray q_out(7);
+    ASSERT_EQ(ik_solver->CartToJnt(q_init, target, q_out), 0);
+    EXPECT_TRUE(ik_solver->withinLimits(q_out));
+    EXPECT_TRUE(KDL::Equal(this->forward(q_out), target, tolerance));
+  }
+};
+
+TEST_F(AnalyticIKTest, ChainStructure)
+{
+  EXPECT_TRUE(ik_solver->isValid());
+
+  // Without the wrist, the chain isn't supported
+  KDL::Chain arm;
+  for(unsigned int s=0; s<4; s++) {
+    arm.addSegment(chain.getSegment(s));
+  }
+  ChainIkSolverPosAnalytic arm_solver(arm, joint_limits_min, joint_limits_max);
+  EXPECT_FALSE(arm_solver.isValid());
+
+  KDL::JntArray q_out(7);
+  EXPECT_EQ(arm_solver.CartToJnt(KDL::JntArray(7), KDL::Frame::Identity(), q_out), -3);
+}
+
+TEST_F(AnalyticIKTest, RoundTripAllBranches)
+{
+  for(unsigned int k=0; k<500; k++) {
+    const KDL::JntArray q = this->randomPositions();
+    const KDL::Frame target = this->forward(q);
+    const double elbow_angle = ik_solver->getElbowAngle(q);
+
+    // Away from singularities, all eight branches are found
+    const unsigned int n_branches = ik_solver->solveBranches(target, elbow_angle);
+    ASSERT_EQ(n_branches, 8U);
+
+    // Each branch reaches the target at the same elbow angle, and one of them
+    // is the configuration the target came from
+    double min_error = M_PI;
+    for(unsigned int b=0; b<n_branches; b++) {
+      const KDL::JntArray &branch = ik_solver->getBranch(b);
+      EXPECT_TRUE(KDL::Equal(this->forward(branch), target, tolerance));
+      EXPECT_NEAR(std::remainder(ik_solver->getElbowAngle(branch) - elbow_angle, 2.0 * M_PI), 0.0, tolerance);
+      min_error = std::min(min_error, JointError(branch, q));
+    }
+    EXPECT_LT(min_error, tolerance);
+
+    // Solving from the configuration itself returns it
+    KDL::JntArray q_out(7);
+    ASSERT_EQ(ik_solver->CartToJnt(q, target, q_out), 0);
+    EXPECT_LT(JointError(q_out, q), tolerance);
+  }
+}
+
+TEST_F(AnalyticIKTest, TrackFromNearbyPositions)
+{
+  for(unsigned int k=0; k<500; k++) {
+    const KDL::JntArray q = this->randomPositions();
+
+    // Start from a slightly different configuration, as when tracking
+    KDL::JntArray q_init(7);
+    for(unsigned int i=0; i<7; i++) {
+      q_init(i) = std::max(joint_limits_min(i), std::min(q(i) + Random(-0.01, 0.01), joint_limits_max(i)));
+    }
+
+    this->expectSolution(q_init, this->forward(q));
+  }
+}
+
+TEST_F(AnalyticIKTest, SingularConfigurations)
+{
+  std::vector<KDL::JntArray> configurations;
+  KDL::JntArray q(7);
+
+  // Zero positions: the shoulder and the wrist are both singular, and the
+  // shoulder-wrist line lies on the first joint axis
+  configurations.push_back(q);
+
+  // Shoulder singularity: joints 1 and 3 are aligned
+  q(0) = 0.3; q(1) = 0.0; q(2) = -0.4; q(3) = 1.5; q(4) = 0.2; q(5) = 0.7; q(6) = -0.5;
+  configurations.push_back(q);
+
+  // Wrist singularity: joints 5 and 7 are aligned
+  q(0) = 0.3; q(1) = 0.8; q(2) = -0.4; q(3) = 1.5; q(4) = 0.2; q(5) = 0.0; q(6) = -0.5;
+  configurations.push_back(q);
+
+  // The elbow offsets cancel when it's straight, so the shoulder-wrist line
+  // passes through the elbow axis
+  q(0) = 0.3; q(1) = 0.8; q(2) = -0.4; q(3) = 0.0; q(4) = 0.2; q(5) = 0.7; q(6) = -0.5;
+  configurations.push_back(q);
+
+  for(unsigned int c=0; c<configurations.size(); c++) {
+    SCOPED_TRACE(c);
+    const KDL::Frame target = this->forward(configurations[c]);
+
+    // Solve both from the singular configuration and from nearby
+    this->expectSolution(configurations[c], target);
+    KDL::JntArray q_init = configurations[c];
+    for(unsigned int i=0; i<7; i++) {
+      q_init(i) += 0.05;
+    }
+    this->expectSolution(q_init, target);
+  }
+}
+
+TEST_F(AnalyticIKTest, LimitViolatingTargets)
+{
+  const KDL::JntArray q = this->randomPositions();
+  const KDL::Frame target = this->forward(q);
+
+  // With tight limits around q, starting from another elbow angle needs a
+  // search back to an elbow angle which is within the limits
+  KDL::JntArray tight_min(7), tight_max(7);
+  for(unsigned int i=0; i<7; i++) {
+    tight_min(i) = q(i) - 0.2;
+    tight_max(i) = q(i) + 0.2;
+  }
+  ChainIkSolverPosAnalytic tight_solver(chain, tight_min, tight_max);
+
+  ASSERT_GT(tight_solver.solveBranches(target, ik_solver->getElbowAngle(q) + 1.0), 0U);
+  KDL::JntArray q_init = tight_solver.getBranch(0);
+  EXPECT_FALSE(tight_solver.withinLimits(q_init));
+
+  KDL::JntArray q_out(7);
+  ASSERT_EQ(tight_solver.CartToJnt(q_init, target, q_out), 0);
+  EXPECT_TRUE(tight_solver.withinLimits(q_out));
+  EXPECT_TRUE(KDL::Equal(this->forward(q_out), target, tolerance));
+
+  // Turning the base further than its limits allow can't be reached at any
+  // elbow angle
+  KDL::JntArray q_turned = q;
+  q_turned(0) += 1.0;
+  EXPECT_EQ(tight_solver.CartToJnt(q, this->forward(q_turned), q_out), -2);
+
+  // Targets beyond the arm's reach have no solutions at all
+  KDL::Frame far_target = target;
+  far_target.p = KDL::Vector(2.0, 0.0, 0.0);
+  EXPECT_EQ(ik_solver->CartToJnt(q, far_target, q_out), -1);
+}
+
+class IKCacheTest : public AnalyticIKTest {
+public:
+  double position_resolution, rotation_resolution, hint_resolution;
+  KDL::JntArray hint;
+
+  virtual void SetUp() {
+    AnalyticIKTest::SetUp();
+    position_resolution = 0.01;
+    rotation_resolution = 0.01;
+    hint_resolution = 0.1;
+    hint = KDL::JntArray(7);
+  }
+
+  IKCache makeCache(const unsigned int capacity) {
+    return IKCache(chain, capacity, position_resolution, rotation_resolution, hint_resolution, tolerance);
+  }
+
+  //! Check the result of a lookup, and which solution it found
+  void expectLookup(
+      IKCache &cache,
+      const KDL::Frame &target,
+      const IKCache::LookupResult expected_result,
+      const KDL::JntArray &expected_solution)
+  {
+    KDL::JntArray solution(7);
+    ASSERT_EQ(cache.lookup(target, hint, solution), expected_result);
+    if(expected_result != IKCache::MISS) {
+      EXPECT_LT(JointError(solution, expected_solution), tolerance);
+    }
+  }
+};
+
+TEST_F(IKCacheTest, LookupResults)
+{
+  IKCache cache = this->makeCache(4);
+  const KDL::JntArray q = this->randomPositions();
+  const KDL::Frame target = this->forward(q);
+
+  this->expectLookup(cache, target, IKCache::MISS, q);
+  cache.insert(target, hint, q);
+
+  // The same target is solved by the cached solution
+  this->expectLookup(cache, target, IKCache::HIT, q);
+
+  // A target in the same cell finds it, but it isn't a solution
+  KDL::Frame nearby = target;
+  const double cell_center = position_resolution * std::floor(target.p(0) / position_resolution + 0.5);
+  nearby.p = KDL::Vector(cell_center + 0.4 * position_resolution, target.p(1), target.p(2));
+  ASSERT_GT(std::abs(nearby.p(0) - target.p(0)), tolerance);
+  this->expectLookup(cache, nearby, IKCache::NEAR_HIT, q);
+
+  // Targets in other cells, or with a different hint, don't find it
+  KDL::Frame moved = target;
+  moved.p = target.p + KDL::Vector(0.0, 0.0, 5.0 * position_resolution);
+  this->expectLookup(cache, moved, IKCache::MISS, q);
+
+  KDL::Frame turned = target;
+  turned.M = KDL::Rotation::Rot(KDL::Vector(0.0, 0.0, 1.0), 5.0 * rotation_resolution) * target.M;
+  this->expectLookup(cache, turned, IKCache::MISS, q);
+
+  KDL::JntArray solution(7);
+  KDL::JntArray other_hint = hint;
+  other_hint(0) += 5.0 * hint_resolution;
+  EXPECT_EQ(cache.lookup(target, other_hint, solution), IKCache::MISS);
+
+  // Clearing the cache removes the solution
+  cache.clear();
+  this->expectLookup(cache, target, IKCache::MISS, q);
+}
+
+TEST_F(IKCacheTest, LeastRecentlyUsedEviction)
+{
+  IKCache cache = this->makeCache(3);
+
+  std::vector<KDL::JntArray> positions;
+  std::vector<KDL::Frame> targets;
+  for(unsigned int k=0; k<5; k++) {
+    positions.push_back(this->randomPositions());
+    targets.push_back(this->forward(positions.back()));
+  }
+
+  for(unsigned int k=0; k<3; k++) {
+    cache.insert(targets[k], hint, positions[k]);
+  }
+
+  // A lookup refreshes an entry, so the second entry is evicted
+  this->expectLookup(cache, targets[0], IKCache::HIT, positions[0]);
+  cache.insert(targets[3], hint, positions[3]);
+  this->expectLookup(cache, targets[1], IKCache::MISS, positions[1]);
+
+  // Then the third, which hasn't been used since it was inserted
+  cache.insert(targets[4], hint, positions[4]);
+  this->expectLookup(cache, targets[2], IKCache::MISS, positions[2]);
+
+  this->expectLookup(cache, targets[0], IKCache::HIT, positions[0]);
+  this->expectLookup(cache, targets[3], IKCache::HIT, positions[3]);
+  this->expectLookup(cache, targets[4], IKCache::HIT, positions[4]);
+
+  // Inserting a solution for a cached target replaces it without evicting
+  cache.insert(targets[3], hint, positions[0]);
+  this->expectLookup(cache, targets[3], IKCache::NEAR_HIT, positions[0]);
+  this->expectLookup(cache, targets[0], IKCache::HIT, positions[0]);
+  this->expectLookup(cache, targets[4], IKCache::HIT, positions[4]);
+}
+
+TEST_F(IKCacheTest, KeyCollisions)
+{
+  IKCache cache = this->makeCache(2);
+  const KDL::JntArray q = this->randomPositions(), other_q = this->randomPositions();
+  const KDL::Frame target = this->forward(q), other_target = this->forward(other_q);
+
+  // Two targets within a cell share a key, so each replaces the other, and
+  // the forward kinematics check keeps either from being taken as a hit for
+  // the other
+  KDL::Frame nearby = target;
+  const double cell_center = position_resolution * std::floor(target.p(0) / position_resolution + 0.5);
+  nearby.p = KDL::Vector(cell_center + 0.4 * position_resolution, target.p(1), target.p(2));
+
+  cache.insert(other_target, hint, other_q);
+  cache.insert(target, hint, q);
+  cache.insert(nearby, hint, other_q);
+  this->expectLookup(cache, target, IKCache::NEAR_HIT, other_q);
+  this->expectLookup(cache, other_target, IKCache::HIT, other_q);
+
+  // Rotations within a cell of a half turn share a key with their negations,
+  // which GetRot() can return for nearly the same rotation
+  for(unsigned int k=0; k<100; k++) {
+    KDL::Vector axis(Random(-1.0, 1.0), Random(-1.0, 1.0), Random(-1.0, 1.0));
+    axis.Normalize();
+    KDL::Frame half_turn = target, opposite_half_turn = target;
+    half_turn.M = KDL::Rotation::Rot(axis, M_PI - 1E-4);
+    opposite_half_turn.M = KDL::Rotation::Rot(-axis, M_PI - 1E-4);
+    ASSERT_LT(KDL::dot(half_turn.M.GetRot(), opposite_half_turn.M.GetRot()), 0.0);
+
+    cache.clear();
+    cache.insert(half_turn, hint, q);
+    this->expectLookup(cache, opposite_half_turn, IKCache::NEAR_HIT, q);
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,115 @@
+#include <cmath>
+
+#include "trajectory_ik.h"
+
+using namespace lcsr_controllers;
+
+TrajectoryIK::TrajectoryIK(
+    const KDL::Chain &chain,
+    const KDL::JntArray &joint_limits_min,
+    const KDL::JntArray &joint_limits_max,
+    const unsigned int n_points,
+    const double damping) :
+  n_dof_(chain.getNrOfJoints()),
+  n_points_(n_points),
+  request_buffer_(Request()),
+  result_buffer_(Result()),
+  solver_(*this),
+  solved_sequence_(0),
+  fk_solver_(chain),
+  ik_solver_vel_(chain, 1.0E-6, 150),
+  ik_solver_pos_(chain, joint_limits_min, joint_limits_max, fk_solver_, ik_solver_vel_, 10, 1.0E-6),
+  warm_start_(n_dof_)
+{
+  ik_solver_vel_.setLambda(damping);
+
+  // Preallocate the requests and results
+  pending_request_.start.resize(n_dof_);
+  request_buffer_.data_sample(pending_request_);
+  request_ = pending_request_;
+
+  result_.points.resize(n_points_, KDL::JntArrayVel(n_dof_));
+  result_.times.resize(n_points_, 0.0);
+  result_buffer_.data_sample(result_);
+
+  solver_activity_.reset(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.0, &solver_, "trajectory_ik"));
+  solver_activity_->start();
+}
+
+TrajectoryIK::~TrajectoryIK()
+{
+  solver_activity_->stop();
+}
+
+void TrajectoryIK::request(const Request &request)
+{
+  pending_request_.from = request.from;
+  pending_request_.to = request.to;
+  pending_request_.duration = request.duration;
+  pending_request_.start = request.start;
+  pending_request_.sequence++;
+
+  request_buffer_.Set(pending_request_);
+  solver_activity_->trigger();
+}
+
+bool TrajectoryIK::getResult(Result &result, const unsigned int last_sequence) const
+{
+  result_buffer_.Get(result);
+  return result.sequence != last_sequence;
+}
+
+void TrajectoryIK::solve()
+{
+  request_buffer_.Get(request_);
+
+  // Only solve each request once
+  if(request_.sequence == solved_sequence_) {
+    return;
+  }
+  solved_sequence_ = request_.sequence;
+
+  result_.valid = (request_.duration >= 1E-6);
+
+  if(result_.valid) {
+    // Interpolate the position linearly and the orientation along the
+    // geodesic, at a constant twist
+    const KDL::Twist delta = KDL::diff(request_.from, request_.to);
+    const KDL::Twist twist = delta / request_.duration;
+    warm_start_ = request_.start;
+
+    for(unsigned int p=0; p<n_points_; p++) {
+      const double s = double(p + 1) / double(n_points_);
+      const KDL::Frame frame = KDL::addDelta(request_.from, delta, s);
+      KDL::JntArrayVel &point = result_.points[p];
+
+      // Start each solve from the solution for the previous point
+      if(ik_solver_pos_.CartToJnt(warm_start_, frame, point.q) < 0) {
+        result_.valid = false;
+        break;
+      }
+      warm_start_ = point.q;
+
+      unwrap_angles(point.q);
+      if(ik_solver_vel_.CartToJnt(point.q, twist, point.qdot) < 0) {
+        point.qdot.data.setZero();
+      }
+      result_.times[p] = s * request_.duration;
+    }
+  }
+
+  result_.sequence = request_.sequence;
+  result_buffer_.Set(result_);
+}
+
+void TrajectoryIK::unwrap_angles(KDL::JntArray &positions)
+{
+  for(unsigned int i=0; i<positions.rows(); i++) {
+    if(positions(i) > 0) {
+      positions(i) = fmod(positions(i)+M_PI,2.0*M_PI)-M_PI;
+    } else {
+      positions(i) = fmod(positions(i)-M_PI,2.0*M_PI)+M_PI;
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef __LCSR_CONTROLLERS_TRAJECTORY_IK_H
+#define __LCSR_CONTROLLERS_TRAJECTORY_IK_H
+
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <rtt/Activity.hpp>
+#include <rtt/base/RunnableInterface.hpp>
+#include <rtt/base/DataObjectLockFree.hpp>
+
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/jntarrayvel.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainiksolvervel_wdls.hpp>
+#include <kdl/chainiksolverpos_nr_jl.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Asynchronous inverse kinematics along an interpolated tip motion
+   *
+   * This interpolates a fixed number of points from one tip frame to another,
+   * at a constant twist, and solves IK for each point starting from the
+   * previous point's solution. Each point's velocities are computed from the
+   * twist with a damped least-squares solve.
+   *
+   * The solves are run by a low-priority activity with its own KDL solvers,
+   * so a batch of them never runs on, or changes the state of, the realtime
+   * thread's solvers. The realtime thread only posts requests and reads the
+   * latest finished result. Both are lock-free, and neither waits for the
+   * solvers.
+   */
+  class TrajectoryIK {
+  public:
+    struct Request {
+      Request() : duration(0.0), sequence(0) { }
+      KDL::Frame from;
+      KDL::Frame to;
+      //! The time to move from one frame to the other, in seconds
+      double duration;
+      //! The solution for the from frame, where the first solve starts
+      KDL::JntArray start;
+      unsigned int sequence;
+    };
+
+    struct Result {
+      Result() : valid(false), sequence(0) { }
+      //! Positions and velocities of each point, evenly spaced after the from frame
+      std::vector<KDL::JntArrayVel> points;
+      //! The time of each point after the from frame, in seconds
+      std::vector<double> times;
+      //! False if any point couldn't be solved
+      bool valid;
+      //! The sequence number of the request this answers
+      unsigned int sequence;
+    };
+
+    TrajectoryIK(
+        const KDL::Chain &chain,
+        const KDL::JntArray &joint_limits_min,
+        const KDL::JntArray &joint_limits_max,
+        const unsigned int n_points,
+        const double damping);
+    ~TrajectoryIK();
+
+    //! The number of points in each result
+    unsigned int getNrOfPoints() const { return n_points_; }
+
+    //! Post a new request, replacing any request which hasn't been started yet
+    void request(const Request &request);
+
+    //! Get the latest finished result, returns true if it's newer than last_sequence
+    bool getResult(Result &result, const unsigned int last_sequence) const;
+
+  private:
+    //! Solves the latest request and publishes the result
+    class Solver : public RTT::base::RunnableInterface {
+    public:
+      Solver(TrajectoryIK &owner) : owner_(owner) { }
+      virtual bool initialize() { return true; }
+      virtual void step() { owner_.solve(); }
+      virtual void finalize() { }
+    private:
+      TrajectoryIK &owner_;
+    };
+
+    void solve();
+    //! Wrap joint angles into [-pi, pi), as IKController does
+    static void unwrap_angles(KDL::JntArray &positions);
+
+    unsigned int n_dof_;
+    unsigned int n_points_;
+
+    // Realtime interface
+    Request pending_request_;
+    RTT::base::DataObjectLockFree<Request> request_buffer_;
+    RTT::base::DataObjectLockFree<Result> result_buffer_;
+    Solver solver_;
+    boost::scoped_ptr<RTT::Activity> solver_activity_;
+
+    // Solver state
+    Request request_;
+    unsigned int solved_sequence_;
+    Result result_;
+    KDL::ChainFkSolverPos_recursive fk_solver_;
+    KDL::ChainIkSolverVel_wdls ik_solver_vel_;
+    KDL::ChainIkSolverPos_NR_JL ik_solver_pos_;
+    KDL::JntArray warm_start_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_TRAJECTORY_IK_H
@@ -0,0 +1,53 @@
+#ifndef __LCSR_CONTROLLERS_WAM_CHAIN_H
+#define __LCSR_CONTROLLERS_WAM_CHAIN_H
+
+#include <cmath>
+
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+
+/******************************************************************************
+ * A 7-DOF Barrett WAM, shared by the IK tests and benchmarks
+ ******************************************************************************/
+
+namespace lcsr_controllers {
+
+  //! Build a 7-DOF WAM from its DH parameters
+  inline KDL::Chain WAMChain()
+  {
+    static const double DH[7][3] = {
+      // a, alpha, d
+      { 0.0,   -M_PI/2.0, 0.0  },
+      { 0.0,    M_PI/2.0, 0.0  },
+      { 0.045, -M_PI/2.0, 0.55 },
+      {-0.045,  M_PI/2.0, 0.0  },
+      { 0.0,   -M_PI/2.0, 0.3  },
+      { 0.0,    M_PI/2.0, 0.0  },
+      { 0.0,    0.0,      0.06 }};
+
+    KDL::Chain chain;
+    for(unsigned int i=0; i<7; i++) {
+      chain.addSegment(KDL::Segment(KDL::Joint(KDL::Joint::RotZ), KDL::Frame::DH(DH[i][0], DH[i][1], DH[i][2], 0.0)));
+    }
+
+    return chain;
+  }
+
+  //! Get the WAM's joint limits
+  inline void WAMJointLimits(
+      KDL::JntArray &joint_limits_min,
+      KDL::JntArray &joint_limits_max)
+  {
+    static const double LIMITS[7][2] = {
+      {-2.6, 2.6}, {-2.0, 2.0}, {-2.8, 2.8}, {-0.9, 3.1}, {-4.76, 1.24}, {-1.6, 1.6}, {-3.0, 3.0}};
+
+    joint_limits_min.resize(7);
+    joint_limits_max.resize(7);
+    for(unsigned int i=0; i<7; i++) {
+      joint_limits_min(i) = LIMITS[i][0];
+      joint_limits_max(i) = LIMITS[i][1];
+    }
+  }
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_WAM_CHAIN_H
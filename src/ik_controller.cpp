@@ -14,6 +14,8 @@
 
 #include <tf_conversions/tf_kdl.h>
 
+#include <rtt/os/TimeService.hpp>
+
 #include <rtt_ros_tools/tools.h>
 #include <rtt_roscomm/rtt_rostopic.h>
 #include <rtt_rosclock/rtt_rosclock.h>
@@ -30,13 +32,36 @@ IKController::IKController(std::string const& name) :
   ,root_link_("")
   ,tip_link_("")
   ,target_frame_("")
+  ,tf_period_(0.005)
+  ,trajectory_points_(0)
+  ,ik_solver_("nr_jl")
+  ,analytic_elbow_angle_step_(0.05)
+  ,anytime_budget_(5E-4)
+  ,multi_start_seeds_(0)
+  ,multi_start_threads_(2)
+  ,multi_start_timeout_(0.01)
+  ,ik_cache_size_(0)
+  ,ik_cache_position_resolution_(1E-3)
+  ,ik_cache_rotation_resolution_(1E-3)
+  ,ik_cache_hint_resolution_(1E-2)
+  ,ik_cache_tolerance_(1E-5)
+  ,ik_cache_hits_(0)
+  ,ik_cache_near_hits_(0)
+  ,ik_cache_misses_(0)
+  ,ik_cache_hit_rate_(0.0)
+  ,ik_cache_time_saved_(0.0)
+  ,ik_residual_(0.0)
+  ,ik_iterations_(0)
   // Working variables
   ,n_dof_(0)
-  ,kdl_tree_()
   ,kdl_chain_()
+  ,kdl_tree_()
   ,positions_()
+  ,tf_cache_(name)
+  ,target_frame_handle_(0)
+  ,has_tip_frame_des_last_(false)
+  ,has_trajectory_(false)
   ,ros_publish_throttle_(0.02)
-  ,warn_flag_(false)
 {
   // Declare properties
   this->addProperty("robot_description",robot_description_)
@@ -50,11 +75,47 @@ IKController::IKController(std::string const& name) :
     .doc("The tip link for the controller.");
   this->addProperty("target_frame",target_frame_)
     .doc("The target frame to track with tip_link.");
+  this->addProperty("tf_period",tf_period_)
+    .doc("The period, in seconds, at which the target frame is looked up outside of the realtime thread.");
+  this->addProperty("trajectory_points",trajectory_points_)
+    .doc("The number of points in the trajectories_out trajectory, interpolated between the last published target frame and the current one, and solved outside of the realtime thread. This is read when the controller is configured. (0: a single point with the current solution)");
   this->addProperty("hint_modes",hint_modes_)
     .doc("IK hint mode for joints. (0: use current joint value, 1: use middle of joint range, 2: use value specified in hint_positions vector)");
   this->addProperty("hint_positions",hint_positions_)
     .doc("IK hint position.");
-  this->addProperty("damping",damping_);
+  this->addProperty("damping",damping_)
+    .doc("The damping of the least-squares velocity IK, used by the numeric IK solvers and to compute the joint velocity output.");
+  this->addProperty("ik_solver",ik_solver_)
+    .doc("The position IK solver. (nr_jl: KDL Newton-Raphson with joint limits, lma: KDL Levenberg-Marquardt, anytime: Newton-Raphson until anytime_budget runs out, analytic: closed-form solver for 7-DOF arms with a spherical shoulder and wrist, like the WAM)");
+  this->addProperty("analytic_elbow_angle_step",analytic_elbow_angle_step_)
+    .doc("The step, in radians, of the analytic solver's search for an elbow angle with a solution within the joint limits.");
+  this->addProperty("anytime_budget",anytime_budget_)
+    .doc("The time budget, in seconds, for each solve of the anytime IK solver. If it runs out, the best iterate so far is used, and the next solve resumes from it.");
+  this->addProperty("multi_start_seeds",multi_start_seeds_)
+    .doc("The number of starting points for multi-start IK, which is solved outside of the realtime thread. (0: disabled, solve once from the hint every update)");
+  this->addProperty("multi_start_threads",multi_start_threads_)
+    .doc("The number of worker threads used for multi-start IK.");
+  this->addProperty("multi_start_timeout",multi_start_timeout_)
+    .doc("The deadline for all of the multi-start IK solves for a target, in seconds.");
+  this->addProperty("ik_cache_size",ik_cache_size_)
+    .doc("The number of IK solutions to cache for recent targets. (0: disabled)");
+  this->addProperty("ik_cache_position_resolution",ik_cache_position_resolution_)
+    .doc("The resolution to which target positions are quantized for the IK cache, in meters.");
+  this->addProperty("ik_cache_rotation_resolution",ik_cache_rotation_resolution_)
+    .doc("The resolution to which target rotation vectors are quantized for the IK cache, in radians.");
+  this->addProperty("ik_cache_hint_resolution",ik_cache_hint_resolution_)
+    .doc("The resolution to which IK hints are quantized for the IK cache, in radians.");
+  this->addProperty("ik_cache_tolerance",ik_cache_tolerance_)
+    .doc("The maximum difference between the target and the forward kinematics of a cached solution for it to be used without solving.");
+
+  // Declare attributes
+  this->addAttribute("ik_cache_hits",ik_cache_hits_);
+  this->addAttribute("ik_cache_near_hits",ik_cache_near_hits_);
+  this->addAttribute("ik_cache_misses",ik_cache_misses_);
+  this->addAttribute("ik_cache_hit_rate",ik_cache_hit_rate_);
+  this->addAttribute("ik_cache_time_saved",ik_cache_time_saved_);
+  this->addAttribute("ik_residual",ik_residual_);
+  this->addAttribute("ik_iterations",ik_iterations_);
 
   // Configure data ports
   this->ports()->addPort("positions_in", positions_in_port_)
@@ -87,6 +148,20 @@ bool IKController::configureHook()
   param_ok &= rosparam->getComponentPrivate("hint_modes");
   param_ok &= rosparam->getComponentPrivate("hint_positions");
   param_ok &= rosparam->getComponentPrivate("damping");
+  // Get optional parameters
+  rosparam->getComponentPrivate("tf_period");
+  rosparam->getComponentPrivate("trajectory_points");
+  rosparam->getComponentPrivate("ik_solver");
+  rosparam->getComponentPrivate("analytic_elbow_angle_step");
+  rosparam->getComponentPrivate("anytime_budget");
+  rosparam->getComponentPrivate("multi_start_seeds");
+  rosparam->getComponentPrivate("multi_start_threads");
+  rosparam->getComponentPrivate("multi_start_timeout");
+  rosparam->getComponentPrivate("ik_cache_size");
+  rosparam->getComponentPrivate("ik_cache_position_resolution");
+  rosparam->getComponentPrivate("ik_cache_rotation_resolution");
+  rosparam->getComponentPrivate("ik_cache_hint_resolution");
+  rosparam->getComponentPrivate("ik_cache_tolerance");
 
   // sanity check
   if (!param_ok) {
@@ -188,8 +263,9 @@ bool IKController::configureHook()
   single_point.velocities.resize(n_dof_);
   std::fill(single_point.positions.begin(),single_point.positions.end(),0.0);
   std::fill(single_point.velocities.begin(),single_point.velocities.end(),0.0);
-  trajectory_.points.push_back(single_point);
-
+  single_point_trajectory_ = trajectory_;
+  single_point_trajectory_.points.push_back(single_point);
+  trajectory_.points.resize(std::max(1, trajectory_points_), single_point);
 
   // Initialize FK solver
   kdl_fk_solver_pos_.reset(
@@ -204,27 +280,115 @@ bool IKController::configureHook()
   boost::dynamic_pointer_cast<KDL::ChainIkSolverVel_wdls>(kdl_ik_solver_vel_)->setLambda(damping_);
 
   // Initialize position IK solver
-#if 1
-  kdl_ik_solver_pos_.reset(
-      new KDL::ChainIkSolverPos_NR_JL(
-        kdl_chain_,
-        joint_limits_min_,
-        joint_limits_max_,
-        *kdl_fk_solver_pos_,
-        *kdl_ik_solver_vel_,
-        10,
-        1.0E-6));
-#else
-  kdl_ik_solver_pos_.reset(
-      new KDL::ChainIkSolverPos_LMA(
-        kdl_chain_,
-        1E-5,
-        500,
-        1E-15));
-#endif
+  anytime_ik_solver_.reset();
+  if(ik_solver_ == "nr_jl") {
+    kdl_ik_solver_pos_.reset(
+        new KDL::ChainIkSolverPos_NR_JL(
+          kdl_chain_,
+          joint_limits_min_,
+          joint_limits_max_,
+          *kdl_fk_solver_pos_,
+          *kdl_ik_solver_vel_,
+          10,
+          1.0E-6));
+  } else if(ik_solver_ == "lma") {
+    kdl_ik_solver_pos_.reset(
+        new KDL::ChainIkSolverPos_LMA(
+          kdl_chain_,
+          1E-5,
+          500,
+          1E-15));
+  } else if(ik_solver_ == "anytime") {
+    anytime_ik_solver_.reset(
+        new ChainIkSolverPosAnytime(
+          kdl_chain_,
+          joint_limits_min_,
+          joint_limits_max_,
+          anytime_budget_,
+          damping_,
+          1.0E-6));
+    kdl_ik_solver_pos_ = anytime_ik_solver_;
+  } else if(ik_solver_ == "analytic") {
+    boost::shared_ptr<ChainIkSolverPosAnalytic> analytic_solver(
+        new ChainIkSolverPosAnalytic(
+          kdl_chain_,
+          joint_limits_min_,
+          joint_limits_max_,
+          analytic_elbow_angle_step_,
+          1.0E-6));
+    if(!analytic_solver->isValid()) {
+      RTT::log(RTT::Error) << "The analytic IK solver needs 7 revolute joints with a spherical shoulder (joints 1-3) and a spherical wrist (joints 5-7)." << RTT::endlog();
+      return false;
+    }
+    kdl_ik_solver_pos_ = analytic_solver;
+  } else {
+    RTT::log(RTT::Error) << "Unknown IK solver \"" << ik_solver_ << "\"" << RTT::endlog();
+    return false;
+  }
 
   jac_solver_.reset(
       new KDL::ChainJntToJacSolver(kdl_chain_));
+  jacobian_.resize(n_dof_);
+
+  // Initialize multi-start IK solver
+  if(multi_start_seeds_ > 0) {
+    multi_start_ik_.reset(
+        new MultiStartIK(
+          kdl_chain_,
+          joint_limits_min_,
+          joint_limits_max_,
+          multi_start_seeds_,
+          std::max(1, multi_start_threads_),
+          multi_start_timeout_,
+          damping_));
+    multi_start_request_.current.resize(n_dof_);
+    multi_start_request_.previous.resize(n_dof_);
+    multi_start_request_.hint.resize(n_dof_);
+    multi_start_result_ = MultiStartIK::Result();
+    multi_start_result_.positions.resize(n_dof_);
+  } else {
+    multi_start_ik_.reset();
+  }
+
+  // Initialize trajectory IK solver, with the number of points fixed until
+  // the controller is configured again
+  if(trajectory_points_ > 0) {
+    trajectory_ik_.reset(
+        new TrajectoryIK(
+          kdl_chain_,
+          joint_limits_min_,
+          joint_limits_max_,
+          trajectory_points_,
+          damping_));
+    trajectory_request_ = TrajectoryIK::Request();
+    trajectory_request_.start.resize(n_dof_);
+    trajectory_result_ = TrajectoryIK::Result();
+    trajectory_result_.points.resize(trajectory_points_, KDL::JntArrayVel(n_dof_));
+    trajectory_result_.times.resize(trajectory_points_, 0.0);
+  } else {
+    trajectory_ik_.reset();
+  }
+
+  // Initialize IK cache
+  if(ik_cache_size_ > 0) {
+    ik_cache_.reset(
+        new IKCache(
+          kdl_chain_,
+          ik_cache_size_,
+          ik_cache_position_resolution_,
+          ik_cache_rotation_resolution_,
+          ik_cache_hint_resolution_,
+          ik_cache_tolerance_));
+  } else {
+    ik_cache_.reset();
+  }
+  ik_warm_start_.resize(n_dof_);
+  ik_solve_time_ = 0.0;
+  ik_cache_hits_ = 0;
+  ik_cache_near_hits_ = 0;
+  ik_cache_misses_ = 0;
+  ik_cache_hit_rate_ = 0.0;
+  ik_cache_time_saved_ = 0.0;
 
   // Zero out data
   positions_.q.data.setZero();
@@ -253,20 +417,58 @@ bool IKController::compute_ik(
     const ros::Duration dt)
 {
   // Select ik hint by joint
-  for(unsigned int i=0; i<n_dof_; i++) {
-    switch(hint_modes_[i]) {
-      case 0:
-        ik_hint(i) = positions_.q(i); break;
-      case 1:
-        ik_hint(i) = (joint_limits_min_(i) + joint_limits_max_(i))/2.0; break;
-      case 2:
-        ik_hint(i) = hint_positions_(i); break;
+  this->compute_hint(ik_hint);
+
+  // Compute joint coordinates of the target tip frame
+  int ik_ret = 0;
+
+  if(ik_cache_) {
+    RTT::os::TimeService *ts = RTT::os::TimeService::Instance();
+    RTT::os::TimeService::ticks tic = ts->getTicks();
+
+    IKCache::LookupResult lookup = ik_cache_->lookup(tip_frame_des, ik_hint, ik_warm_start_);
+
+    switch(lookup) {
+      case IKCache::HIT:
+        // Use the cached solution without solving
+        positions_des.q = ik_warm_start_;
+        ik_cache_hits_++;
+        break;
+      case IKCache::NEAR_HIT:
+        // Start from the cached solution for a nearby target
+        ik_ret = kdl_ik_solver_pos_->CartToJnt(ik_warm_start_, tip_frame_des, positions_des.q);
+        ik_cache_near_hits_++;
+        break;
+      case IKCache::MISS:
+        ik_ret = kdl_ik_solver_pos_->CartToJnt(ik_hint, tip_frame_des, positions_des.q);
+        ik_cache_misses_++;
+        break;
     };
+
+    // Compare the time taken against the average time to solve from the hint
+    const double elapsed = ts->secondsSince(tic);
+    if(lookup == IKCache::MISS) {
+      ik_solve_time_ += (elapsed - ik_solve_time_) / ik_cache_misses_;
+    } else if(ik_cache_misses_ > 0) {
+      // Nothing is known to be saved until a miss has been timed
+      ik_cache_time_saved_ += ik_solve_time_ - elapsed;
+    }
+    ik_cache_hit_rate_ = double(ik_cache_hits_) / double(ik_cache_hits_ + ik_cache_near_hits_ + ik_cache_misses_);
+
+    // Store new solutions (but not unconverged anytime iterates)
+    if(lookup != IKCache::HIT && ik_ret == 0) {
+      ik_cache_->insert(tip_frame_des, ik_hint, positions_des.q);
+    }
+  } else {
+    ik_ret = kdl_ik_solver_pos_->CartToJnt(ik_hint, tip_frame_des, positions_des.q);
   }
 
-  // Compute joint coordinates of the target tip frame
-  int ik_ret = kdl_ik_solver_pos_->CartToJnt(ik_hint, tip_frame_des, positions_des.q);
+  if(anytime_ik_solver_) {
+    ik_residual_ = anytime_ik_solver_->getResidual();
+    ik_iterations_ = anytime_ik_solver_->getIterations();
+  }
 
+  // The anytime solver returns its best iterate when it runs out of time
   if(ik_ret < 0) {
     return false;
   }
@@ -276,20 +478,10 @@ bool IKController::compute_ik(
   }
 
   // Unwrap angles
-  for(unsigned int i=0; i<n_dof_; i++) {
-    if(positions_des.q(i) > 0) {
-      positions_des.q(i) = fmod(positions_des.q(i)+M_PI,2.0*M_PI)-M_PI;
-    } else {
-      positions_des.q(i) = fmod(positions_des.q(i)-M_PI,2.0*M_PI)+M_PI;
-    }
-  }
+  unwrap_angles(positions_des.q);
 
-  // Compute joint velocities
-  //if(dt.toSec() > 1E-5) {
-    //positions_des_.qdot.data = (positions_des_.q.data - positions_des_last_.q.data)/dt.toSec();
-  //} else {
-    positions_des.qdot.data.setZero();
-  //}
+  // Compute joint velocities from the velocity of the target
+  this->compute_velocities(positions_des.q, tip_frame_twist_, positions_des.qdot);
 
   if(debug) {
     RTT::log(RTT::Debug)<<"Wrapped angles: "<<(positions_des.q.data.transpose())<<RTT::endlog();
@@ -302,15 +494,114 @@ bool IKController::compute_ik(
   return true;
 }
 
+void IKController::compute_hint(KDL::JntArray &ik_hint)
+{
+  for(unsigned int i=0; i<n_dof_; i++) {
+    switch(hint_modes_[i]) {
+      case 0:
+        ik_hint(i) = positions_.q(i); break;
+      case 1:
+        ik_hint(i) = (joint_limits_min_(i) + joint_limits_max_(i))/2.0; break;
+      case 2:
+        ik_hint(i) = hint_positions_(i); break;
+    };
+  }
+}
+
+void IKController::write_trajectory()
+{
+  const unsigned int last_sequence = trajectory_result_.sequence;
+  if(!trajectory_ik_->getResult(trajectory_result_, last_sequence)) {
+    return;
+  }
+
+  if(!trajectory_result_.valid) {
+    this->write_single_point_trajectory();
+    return;
+  }
+
+  // Interpolated trajectory to the target
+  for(unsigned int p=0; p<trajectory_ik_->getNrOfPoints(); p++) {
+    trajectory_msgs::JointTrajectoryPoint &point = trajectory_.points[p];
+    point.time_from_start = ros::Duration(trajectory_result_.times[p]);
+    for(size_t i=0; i<n_dof_; i++) {
+      point.positions[i] = trajectory_result_.points[p].q(i);
+      point.velocities[i] = trajectory_result_.points[p].qdot(i);
+    }
+  }
+
+  trajectory_.header.stamp = ros::Time(0,0);
+  trajectories_out_port_.write( trajectory_ );
+}
+
+void IKController::write_single_point_trajectory()
+{
+  single_point_trajectory_.header.stamp = ros::Time(0,0);
+
+  for(size_t i=0; i<n_dof_; i++) {
+    single_point_trajectory_.points[0].positions[i] = positions_des_.q(i);
+    single_point_trajectory_.points[0].velocities[i] = positions_des_.qdot(i);
+  }
+
+  trajectories_out_port_.write( single_point_trajectory_ );
+}
+
+void IKController::compute_velocities(
+    const KDL::JntArray &positions,
+    const KDL::Twist &twist,
+    KDL::JntArray &velocities)
+{
+  if(jac_solver_->JntToJac(positions, jacobian_) < 0) {
+    velocities.data.setZero();
+    return;
+  }
+
+  for(unsigned int i=0; i<6; i++) {
+    twist_(i) = twist(i);
+  }
+
+  // qdot = J^T (J J^T + damping^2 I)^-1 twist, which only factors a 6x6 matrix
+  jjt_.noalias() = jacobian_.data * jacobian_.data.transpose();
+  jjt_.diagonal().array() += damping_ * damping_;
+  jjt_ldlt_.compute(jjt_);
+  jjt_ldlt_.solveInPlace(twist_);
+  velocities.data.noalias() = jacobian_.data.transpose() * twist_;
+}
+
+void IKController::unwrap_angles(KDL::JntArray &positions)
+{
+  for(unsigned int i=0; i<positions.rows(); i++) {
+    if(positions(i) > 0) {
+      positions(i) = fmod(positions(i)+M_PI,2.0*M_PI)-M_PI;
+    } else {
+      positions(i) = fmod(positions(i)-M_PI,2.0*M_PI)+M_PI;
+    }
+  }
+}
+
 bool IKController::startHook()
 {
-  try{
-    tip_frame_msg_ = tf_lookup_transform_(root_link_,target_frame_);
-  } catch (std::exception &ex) {
-    RTT::log(RTT::Error)<<"Could not look up transform from \""<<root_link_<<"\" to \""<<target_frame_<<"\": "<<ex.what()<<RTT::endlog();
+  // Start looking up the target frame
+  tf_cache_.clear();
+  target_frame_handle_ = tf_cache_.addFramePair("/"+root_link_, target_frame_);
+
+  if(!tf_cache_.start(tf_lookup_transform_, tf_period_)
+     || tf_cache_.getTransform(target_frame_handle_, tip_frame_des_) != TransformCache::OK)
+  {
+    RTT::log(RTT::Error)<<"Could not look up transform from \""<<root_link_<<"\" to \""<<target_frame_<<"\""<<RTT::endlog();
+    tf_cache_.stop();
     return false;
   }
 
+  // Don't differentiate the target across a restart
+  has_tip_frame_des_last_ = false;
+  has_trajectory_ = false;
+
+  // Don't resume from an iterate from before the controller was stopped
+  if(anytime_ik_solver_) {
+    anytime_ik_solver_->reset();
+  }
+
   last_update_time_ = rtt_rosclock::rtt_now();
   return true;
 }
@@ -328,26 +619,51 @@ void IKController::updateHook()
   }
 
   // Get transform from the root link frame to the target frame
-  try{
-    tip_frame_msg_ = tf_lookup_transform_("/"+root_link_,target_frame_);
-    warn_flag_ = false;
-  } catch (std::exception &ex) {
-    if(!warn_flag_) {
-      RTT::log(RTT::Warning) << "Could not look up transform from \""<<root_link_<<
-        "\" to \""<<target_frame_<<"\": "<<ex.what() << RTT::endlog();
-      warn_flag_ = true;
-    }
+  if(tf_cache_.getTransform(target_frame_handle_, tip_frame_des_, tip_frame_des_stamp_) != TransformCache::OK) {
     return;
   }
 
-  tf::transformMsgToTF(tip_frame_msg_.transform, tip_frame_tf_);
-  tf::TransformTFToKDL(tip_frame_tf_,tip_frame_des_);
-
-  // Get cartesian velocity
-  //tip_frame_twist_ = KDL::diff(tip_frame_des_last_, tip_frame_des_, dt.toSec());
-  //tip_frame_des_last_ = tip_frame_des_;
+  // Get cartesian velocity between the target's samples, which are refreshed
+  // more slowly than this runs. It's held until the next sample is due, and
+  // dropped if the target stops being updated.
+  if(!has_tip_frame_des_last_) {
+    tip_frame_twist_ = KDL::Twist::Zero();
+    tip_frame_des_last_ = tip_frame_des_;
+    tip_frame_des_stamp_last_ = tip_frame_des_stamp_;
+    tip_frame_twist_expiry_ = update_time_;
+    has_tip_frame_des_last_ = true;
+  } else if(tip_frame_des_stamp_ != tip_frame_des_stamp_last_) {
+    const double dt = (tip_frame_des_stamp_ - tip_frame_des_stamp_last_).toSec();
+    if(dt > 1E-5) {
+      tip_frame_twist_ = KDL::diff(tip_frame_des_last_, tip_frame_des_, dt);
+      tip_frame_twist_expiry_ = update_time_ + ros::Duration(dt + tf_period_);
+    } else {
+      tip_frame_twist_ = KDL::Twist::Zero();
+    }
+    tip_frame_des_last_ = tip_frame_des_;
+    tip_frame_des_stamp_last_ = tip_frame_des_stamp_;
+  } else if(update_time_ > tip_frame_twist_expiry_) {
+    tip_frame_twist_ = KDL::Twist::Zero();
+  }
 
-  if(this->compute_ik(
+  if(multi_start_ik_) {
+    // Request a solution for the new target, and use the latest finished
+    // solution (which may be for an earlier target)
+    this->compute_hint(ik_hint_);
+    multi_start_request_.target = tip_frame_des_;
+    multi_start_request_.current = positions_.q;
+    multi_start_request_.previous = positions_des_.q;
+    multi_start_request_.hint = ik_hint_;
+    multi_start_ik_->request(multi_start_request_);
+
+    const unsigned int last_sequence = multi_start_result_.sequence;
+    if(multi_start_ik_->getResult(multi_start_result_, last_sequence) && multi_start_result_.valid) {
+      positions_des_raw_.q = multi_start_result_.positions;
+      unwrap_angles(positions_des_raw_.q);
+      positions_des_raw_.qdot.data.setZero();
+      positions_des_ = positions_des_raw_;
+    }
+  } else if(this->compute_ik(
       positions_,
       tip_frame_des_,
       ik_hint_,
@@ -365,20 +681,36 @@ void IKController::updateHook()
   positions_out_port_.write( positions_des_.q.data );
   velocities_out_port_.write( positions_des_.qdot.data );
 
+  // Send the last requested traj target once it has been solved
+  if(trajectory_ik_) {
+    this->write_trajectory();
+  }
+
   // Publish debug traj to ros
   if(ros_publish_throttle_.ready(0.02)) 
   {
     // Send traj target
     if(trajectories_out_port_.connected()) {
-      trajectory_.header.stamp = ros::Time(0,0);
-
-      for(size_t i=0; i<n_dof_; i++) {
-        trajectory_.points[0].positions[i] = positions_des_.q(i);
-        trajectory_.points[0].velocities[i] = positions_des_.qdot(i);
+      if(trajectory_ik_ && has_trajectory_) {
+        // Interpolated trajectory to the current target, solved outside of
+        // the realtime thread
+        trajectory_request_.from = trajectory_frame_last_;
+        trajectory_request_.to = tip_frame_des_;
+        trajectory_request_.duration = (update_time_ - trajectory_time_last_).toSec();
+        trajectory_ik_->request(trajectory_request_);
+      } else {
+        // Single point at the current solution
+        this->write_single_point_trajectory();
       }
+    }
 
-      trajectories_out_port_.write( trajectory_ );
+    // Interpolate the next trajectory from this target
+    trajectory_frame_last_ = tip_frame_des_;
+    trajectory_time_last_ = update_time_;
+    if(trajectory_ik_) {
+      trajectory_request_.start = positions_des_.q;
     }
+    has_trajectory_ = true;
 
     // Publish controller desired state
     joint_state_desired_.header.stamp = rtt_rosclock::host_now();
@@ -393,6 +725,7 @@ void IKController::updateHook()
 void IKController::stopHook()
 {
   positions_in_port_.clear();
+  tf_cache_.stop();
 }
 
 void IKController::cleanupHook()
@@ -4,6 +4,9 @@
 #include <iostream>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <Eigen/Dense>
 
 #include <rtt/RTT.hpp>
 #include <rtt/Port.hpp>
@@ -30,6 +33,13 @@
 
 #include <visualization_msgs/Marker.h>
 
+#include "ik/multi_start_ik.h"
+#include "ik/trajectory_ik.h"
+#include "ik/ik_cache.h"
+#include "ik/chain_ik_solver_pos_analytic.h"
+#include "ik/chain_ik_solver_pos_anytime.h"
+#include "transform_cache/transform_cache.h"
+
 namespace lcsr_controllers {
   class IKController : public RTT::TaskContext
   {
@@ -39,9 +49,31 @@ namespace lcsr_controllers {
     std::string root_link_;
     std::string tip_link_;
     std::string target_frame_;
+    double tf_period_;
+    int trajectory_points_;
     std::vector<int> hint_modes_;
     Eigen::VectorXd hint_positions_;
     double damping_;
+    std::string ik_solver_;
+    double analytic_elbow_angle_step_;
+    double anytime_budget_;
+    int multi_start_seeds_;
+    int multi_start_threads_;
+    double multi_start_timeout_;
+    int ik_cache_size_;
+    double ik_cache_position_resolution_;
+    double ik_cache_rotation_resolution_;
+    double ik_cache_hint_resolution_;
+    double ik_cache_tolerance_;
+
+    // RTT Attributes
+    int ik_cache_hits_;
+    int ik_cache_near_hits_;
+    int ik_cache_misses_;
+    double ik_cache_hit_rate_;
+    double ik_cache_time_saved_;
+    double ik_residual_;
+    int ik_iterations_;
 
     // RTT Ports
     RTT::InputPort<Eigen::VectorXd> positions_in_port_;
@@ -74,6 +106,20 @@ namespace lcsr_controllers {
         const ros::Duration dt);
   private:
 
+    //! Select the IK hint for each joint according to hint_modes
+    void compute_hint(KDL::JntArray &ik_hint);
+    //! Wrap joint angles into [-pi, pi)
+    static void unwrap_angles(KDL::JntArray &positions);
+    //! Publish the latest finished trajectory, or the single point if it couldn't be solved
+    void write_trajectory();
+    //! Publish a single trajectory point at the current solution
+    void write_single_point_trajectory();
+    //! Compute the joint velocities which move the tip with a twist (damped least-squares)
+    void compute_velocities(
+        const KDL::JntArray &positions,
+        const KDL::Twist &twist,
+        KDL::JntArray &velocities);
+
     // Kinematic properties
     unsigned int n_dof_;
     KDL::Chain kdl_chain_;
@@ -92,9 +138,11 @@ namespace lcsr_controllers {
     KDL::JntArray joint_limits_min_;
     KDL::JntArray joint_limits_max_;
 
-    // KDL IK solver which accounts for joint limits
+    // Position IK solver (selected by ik_solver) and velocity IK solver
     boost::shared_ptr<KDL::ChainIkSolverPos> kdl_ik_solver_pos_;
     boost::shared_ptr<KDL::ChainIkSolverVel> kdl_ik_solver_vel_;
+    //! The position IK solver, if it's the anytime solver
+    boost::shared_ptr<ChainIkSolverPosAnytime> anytime_ik_solver_;
 
     // KDL FK solver
     boost::shared_ptr<KDL::ChainFkSolverPos> kdl_fk_solver_pos_;
@@ -102,14 +150,48 @@ namespace lcsr_controllers {
     // KDL Jacobian
     boost::shared_ptr<KDL::ChainJntToJacSolver> jac_solver_;
 
-    geometry_msgs::TransformStamped tip_frame_msg_;
-    tf::Transform tip_frame_tf_;
+    // Damped least-squares velocity IK workspace
+    KDL::Jacobian jacobian_;
+    Eigen::Matrix<double,6,6> jjt_;
+    Eigen::LDLT<Eigen::Matrix<double,6,6> > jjt_ldlt_;
+    Eigen::Matrix<double,6,1> twist_;
+
+    // Multi-start IK solver which runs outside of the realtime thread
+    boost::scoped_ptr<MultiStartIK> multi_start_ik_;
+    MultiStartIK::Request multi_start_request_;
+    MultiStartIK::Result multi_start_result_;
+
+    // Cache of IK solutions for recent targets
+    boost::scoped_ptr<IKCache> ik_cache_;
+    KDL::JntArray ik_warm_start_;
+    //! Average time to solve IK on a cache miss
+    double ik_solve_time_;
+
+    // Target frame, looked up outside of the realtime thread
+    TransformCache tf_cache_;
+    TransformCache::Handle target_frame_handle_;
+
     KDL::Frame tip_frame_;
     KDL::Frame tip_frame_des_;
     KDL::Frame tip_frame_des_last_;
+    ros::Time tip_frame_des_stamp_;
+    ros::Time tip_frame_des_stamp_last_;
+    //! Velocity of the target between its last two samples
     KDL::Twist tip_frame_twist_;
+    //! Time after which tip_frame_twist_ is dropped if no new sample arrives
+    ros::Time tip_frame_twist_expiry_;
+    bool has_tip_frame_des_last_;
 
     trajectory_msgs::JointTrajectory trajectory_;
+    trajectory_msgs::JointTrajectory single_point_trajectory_;
+
+    // IK along the target's motion, solved outside of the realtime thread
+    boost::scoped_ptr<TrajectoryIK> trajectory_ik_;
+    TrajectoryIK::Request trajectory_request_;
+    TrajectoryIK::Result trajectory_result_;
+    KDL::Frame trajectory_frame_last_;
+    ros::Time trajectory_time_last_;
+    bool has_trajectory_;
     sensor_msgs::JointState joint_state_desired_;
 
     rtt_ros_tools::PeriodicThrottle ros_publish_throttle_;
@@ -117,8 +199,6 @@ namespace lcsr_controllers {
     ros::Time update_time_;
     ros::Time last_update_time_;
 
-    bool warn_flag_;
-
   };
 }
 
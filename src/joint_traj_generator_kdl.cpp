@@ -26,6 +26,7 @@ JointTrajGeneratorKDL::JointTrajGeneratorKDL(std::string const& name) :
   ,robot_description_param_("/robot_description")
   ,root_link_("")
   ,tip_link_("")
+  ,synchronize_joints_(false)
   // Working variables
   ,n_dof_(0)
   ,kdl_tree_()
@@ -42,6 +43,7 @@ JointTrajGeneratorKDL::JointTrajGeneratorKDL(std::string const& name) :
   this->addProperty("trap_max_accs",trap_max_accs_).doc("Maximum acceperations for trap generation.");
   this->addProperty("position_tolerance",position_tolerance_).doc("Maximum position error.");
   this->addProperty("velocity_smoothing_factor",velocity_smoothing_factor_).doc("Exponential smoothing factor to use when estimating veolocity from finite differences.");
+  this->addProperty("synchronize_joints",synchronize_joints_).doc("If true, all joints are planned together so that they start and finish at the same time.");
   
   // Configure data ports
   this->ports()->addPort("joint_position_in", joint_position_in_);
@@ -84,6 +86,7 @@ bool JointTrajGeneratorKDL::configureHook()
   rosparam->getComponentPrivate("trap_max_accs");
   rosparam->getComponentPrivate("position_tolerance");
   rosparam->getComponentPrivate("velocity_smoothing_factor");
+  rosparam->getComponentPrivate("synchronize_joints");
 
   rosparam->getComponentPrivate("robot_description_param");
   rosparam->getParam(robot_description_param_, "robot_description");
@@ -111,20 +114,13 @@ bool JointTrajGeneratorKDL::configureHook()
   joint_velocity_raw_.resize(n_dof_);
   joint_velocity_sample_.resize(n_dof_);
 
-  trajectory_start_times_.resize(n_dof_);
-  trajectory_end_times_.resize(n_dof_);
-  
   position_tolerance_.resize(n_dof_);
   trap_max_vels_.resize(n_dof_);
   trap_max_accs_.resize(n_dof_);
 
   // Create trajectory generators
   trajectories_.resize(n_dof_);
-  for(unsigned i=0; i<n_dof_; i++){
-    trajectory_start_times_[i] = 0.0;
-    trajectory_end_times_[i] = 0.0;
-    trajectories_[i] = KDL::VelocityProfile_Trap(trap_max_vels_[i], trap_max_accs_[i]);
-  }
+  trajectories_.setLimits(trap_max_vels_, trap_max_accs_);
 
   return true;
 }
@@ -181,39 +177,55 @@ void JointTrajGeneratorKDL::updateHook()
             joint_position_cmd_ros_.positions.data(),
             joint_position_cmd_ros_.positions.size());
       }
+      // Re-plan from the current reference in joints which are still
+      // moving, so that the new profile continues with the same position and
+      // velocity, and from the measured position in joints which are at rest
+      trajectories_.sample(time, joint_position_sample_, joint_velocity_sample_);
       for(unsigned i=0; i<n_dof_; i++) {
-        // Check to make sure the last trajectory has completed in this degree-of-freedom
-        if(time > trajectory_end_times_[i]) {
-          // Set the 1-dof trajectory profile
-          // This will compute a trajectory subject to the velocity and
-          // acceleration limits, but assume it's starting with zero velocity.
-          trajectories_[i].SetProfile(joint_position_[i], joint_position_cmd_[i]);
-          trajectory_start_times_[i] = time;
-          trajectory_end_times_[i] = trajectory_start_times_[i] + trajectories_[i].Duration();
+        if(time > trajectories_.endTime(i)) {
+          joint_position_sample_[i] = joint_position_[i];
+          joint_velocity_sample_[i] = 0.0;
         }
       }
+
+      // Compute trajectories subject to the velocity and acceleration limits,
+      // optionally stretching every joint's profile to the duration of the
+      // slowest one
+      trajectories_.setProfiles(
+          time,
+          joint_position_sample_,
+          joint_velocity_sample_,
+          joint_position_cmd_,
+          synchronize_joints_);
     }
 
-    // Sample the trajectory
+    // Sample the trajectory for all joints at once
+    trajectories_.sample(time, joint_position_sample_, joint_velocity_sample_);
+
+    bool exceeded_tolerance = false;
     for(unsigned i=0; i<n_dof_; i++) {
       // Set final position commands
-      if(time > trajectory_end_times_[i]) {
+      if(time > trajectories_.endTime(i)) {
         joint_position_sample_[i] = joint_position_cmd_[i];
         joint_velocity_sample_[i] = 0.0;
-      } else {
-        joint_position_sample_[i] = trajectories_[i].Pos(time - trajectory_start_times_[i]);
-        joint_velocity_sample_[i] = trajectories_[i].Vel(time - trajectory_start_times_[i]);
       }
 
       // Check tolerance
       if(fabs(joint_position_sample_[i] - joint_position_[i]) > position_tolerance_[i]) {
         //RTT::log(RTT::Debug) << "Exceeded tolerance in joint: "<<i << RTT::endlog();
-        trajectories_[i].SetProfile(joint_position_[i], joint_position_cmd_[i]);
-        trajectory_start_times_[i] = time;
-        trajectory_end_times_[i] = trajectory_start_times_[i] + trajectories_[i].Duration();
+        if(synchronize_joints_) {
+          exceeded_tolerance = true;
+        } else {
+          trajectories_.setProfile(i, time, joint_position_[i], joint_position_cmd_[i], joint_velocity_[i]);
+        }
       }
     }
 
+    // Re-plan all joints together if any of them exceeded their tolerance
+    if(exceeded_tolerance) {
+      trajectories_.setProfiles(time, joint_position_, joint_velocity_, joint_position_cmd_, true);
+    }
+
     // Send instantaneous joint position and velocity commands
     joint_position_out_.write(joint_position_sample_);
     joint_velocity_out_.write(joint_velocity_sample_);
@@ -11,7 +11,6 @@
 #include <kdl/jntarrayvel.hpp>
 #include <kdl/tree.hpp>
 #include <kdl/chain.hpp>
-#include <kdl/velocityprofile_trap.hpp>
 
 #include <trajectory_msgs/JointTrajectoryPoint.h>
 #include <sensor_msgs/JointState.h>
@@ -20,6 +19,8 @@
 
 #include <conman/hook.h>
 
+#include "trap_profile/trap_profiles.h"
+
 namespace lcsr_controllers {
   class JointTrajGeneratorKDL : public RTT::TaskContext
   {
@@ -29,6 +30,7 @@ namespace lcsr_controllers {
     std::string root_link_;
     std::string tip_link_;
     float velocity_smoothing_factor_;
+    bool synchronize_joints_;
     Eigen::VectorXd 
       trap_max_vels_,
       trap_max_accs_;
@@ -58,9 +60,7 @@ namespace lcsr_controllers {
     KDL::Tree kdl_tree_;
     KDL::Chain kdl_chain_;
 
-    std::vector<KDL::VelocityProfile_Trap> trajectories_;
-    std::vector<RTT::Seconds> trajectory_start_times_;
-    std::vector<RTT::Seconds> trajectory_end_times_;
+    TrapProfiles trajectories_;
 
     // State
     Eigen::VectorXd 
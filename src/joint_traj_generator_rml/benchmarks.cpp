@@ -0,0 +1,492 @@
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#include <rtt/os/startstop.h>
+#include <rtt/Logger.hpp>
+#include <rtt/extras/SlaveActivity.hpp>
+#include <rtt/deployment/ComponentLoader.hpp>
+
+#include <trajectory_msgs/JointTrajectory.h>
+
+#include <rtt_rosclock/rtt_rosclock.h>
+
+#include <benchmark/benchmark.h>
+
+#include "joint_traj_generator_rml.h"
+#include "synthetic_urdf.h"
+using namespace lcsr_controllers;
+
+/******************************************************************************
+ * Allocation counting
+ *
+ * Every allocation made on a given thread is counted so that the number of
+ * allocations per call can be reported alongside the latency.
+ ******************************************************************************/
+
+static thread_local size_t allocation_count = 0;
+
+void* operator new(std::size_t size)
+{
+  allocation_count++;
+  void *ptr = std::malloc(size ? size : 1);
+  if(!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+/******************************************************************************
+ * Simulated clock
+ *
+ * These replace the rtt_rosclock functions used by the generator so that the
+ * benchmarks run without a ROS master and time only advances when a benchmark
+ * says so.
+ ******************************************************************************/
+
+static ros::Time sim_now(1000,0);
+
+namespace rtt_rosclock {
+  const ros::Time host_now() { return sim_now; }
+  const ros::Time rtt_now() { return sim_now; }
+}
+
+/******************************************************************************
+ * Latency and allocation recording
+ ******************************************************************************/
+
+//! Times individual calls and reports their distribution as counters
+class CallRecorder
+{
+public:
+  CallRecorder(benchmark::State &state) :
+    state_(state),
+    allocations_(0),
+    allocations_start_(0)
+  { }
+
+  ~CallRecorder()
+  {
+    if(samples_.empty()) {
+      return;
+    }
+
+    std::sort(samples_.begin(), samples_.end());
+
+    state_.counters["p50_us"] = Percentile(0.50);
+    state_.counters["p90_us"] = Percentile(0.90);
+    state_.counters["p99_us"] = Percentile(0.99);
+    state_.counters["max_us"] = 1E6*samples_.back();
+    state_.counters["allocs_per_call"] = double(allocations_) / double(samples_.size());
+  }
+
+  void start()
+  {
+    allocations_start_ = allocation_count;
+    start_time_ = std::chrono::high_resolution_clock::now();
+  }
+
+  void stop()
+  {
+    const std::chrono::high_resolution_clock::time_point end_time = std::chrono::high_resolution_clock::now();
+    allocations_ += allocation_count - allocations_start_;
+
+    const double elapsed = std::chrono::duration<double>(end_time - start_time_).count();
+    state_.SetIterationTime(elapsed);
+    samples_.push_back(elapsed);
+  }
+
+private:
+  double Percentile(const double p) const
+  {
+    return 1E6*samples_[std::min(samples_.size() - 1, size_t(p*samples_.size()))];
+  }
+
+  benchmark::State &state_;
+  std::vector<double> samples_;
+  size_t allocations_;
+  size_t allocations_start_;
+  std::chrono::high_resolution_clock::time_point start_time_;
+};
+
+/******************************************************************************
+ * Synthetic robots and trajectories
+ ******************************************************************************/
+
+//! Create a sinusoidal trajectory with n_points points spaced by t_step
+static trajectory_msgs::JointTrajectory SyntheticTrajectory(
+    const std::vector<std::string> &joint_names,
+    const size_t n_points,
+    const double t_step)
+{
+  trajectory_msgs::JointTrajectory traj;
+  traj.joint_names = joint_names;
+  traj.points.reserve(n_points);
+
+  for(size_t i=0; i<n_points; i++) {
+    trajectory_msgs::JointTrajectoryPoint point;
+    const double t = (i+1)*t_step;
+
+    point.time_from_start = ros::Duration(t);
+    point.positions.resize(joint_names.size());
+    point.velocities.resize(joint_names.size());
+
+    for(size_t j=0; j<joint_names.size(); j++) {
+      point.positions[j] = 0.5*sin(0.1*(j+1)*t);
+      point.velocities[j] = 0.05*(j+1)*cos(0.1*(j+1)*t);
+    }
+
+    traj.points.push_back(point);
+  }
+
+  return traj;
+}
+
+//! Create a single-point streaming command with a given joint ordering
+static trajectory_msgs::JointTrajectory StreamingPoint(
+    const std::vector<std::string> &joint_names)
+{
+  trajectory_msgs::JointTrajectory traj;
+  traj.joint_names = joint_names;
+  trajectory_msgs::JointTrajectoryPoint point;
+  point.positions.assign(joint_names.size(), 0.1);
+  traj.points.push_back(point);
+  return traj;
+}
+
+//! A generator configured for a synthetic chain, with its internals exposed
+class BenchmarkTrajGenerator : public JointTrajGeneratorRML
+{
+public:
+  BenchmarkTrajGenerator(const size_t n_dof) :
+    JointTrajGeneratorRML("benchmark_traj_rml")
+  {
+    // Don't touch the ROS parameter server or topics
+    use_rosparam_ = false;
+    use_rostopic_ = false;
+    verbose_ = false;
+
+    robot_description_ = SyntheticURDF(n_dof);
+    std::ostringstream tip_link;
+    tip_link << "link_" << n_dof;
+    root_link_ = "link_0";
+    tip_link_ = tip_link.str();
+
+    sampling_resolution_ = 0.001;
+    goal_position_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E-3);
+    goal_velocity_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E-3);
+    position_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E3);
+    velocity_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E3);
+    max_velocities_ = Eigen::VectorXd::Constant(n_dof,2.5);
+    max_accelerations_ = Eigen::VectorXd::Constant(n_dof,5.0);
+    max_jerks_ = Eigen::VectorXd::Constant(n_dof,20.0);
+
+    // Updates are driven explicitly by the benchmarks
+    this->setActivity(new RTT::extras::SlaveActivity());
+
+    if(!this->configure()) {
+      throw std::runtime_error("Could not configure the synthetic trajectory generator.");
+    }
+
+    identity_permutation_.resize(n_dof_);
+    for(size_t j=0; j<n_dof_; j++) {
+      identity_permutation_[j] = j;
+    }
+  }
+
+  using JointTrajGeneratorRML::insertSegments;
+  using JointTrajGeneratorRML::getIndexPermutation;
+  using JointTrajGeneratorRML::joint_names_;
+  using JointTrajGeneratorRML::index_permutation_;
+  using JointTrajGeneratorRML::joint_position_in_;
+  using JointTrajGeneratorRML::joint_velocity_in_;
+  using JointTrajGeneratorRML::joint_position_sample_;
+  using JointTrajGeneratorRML::joint_velocity_sample_;
+
+  std::vector<size_t> identity_permutation_;
+};
+
+/******************************************************************************
+ * Command ingestion
+ ******************************************************************************/
+
+//! Streaming points which always use the same (non-native) joint ordering
+static void BM_StreamingPointIngestion(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(state.range(0));
+
+  std::vector<std::string> reversed(task.joint_names_.rbegin(), task.joint_names_.rend());
+  const trajectory_msgs::JointTrajectory traj = StreamingPoint(reversed);
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  const ros::Time now(1000,0);
+
+  for(auto _ : state) {
+    task.insertSegments(traj, now, segments, task.index_permutation_);
+    benchmark::DoNotOptimize(segments.size());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StreamingPointIngestion)->Arg(7)->Arg(32);
+
+//! Streaming points which alternate between two joint orderings
+static void BM_StreamingPointIngestionReordered(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(state.range(0));
+
+  std::vector<std::string> reversed(task.joint_names_.rbegin(), task.joint_names_.rend());
+  std::vector<std::string> rotated(task.joint_names_);
+  std::rotate(rotated.begin(), rotated.begin() + 1, rotated.end());
+
+  const trajectory_msgs::JointTrajectory trajs[2] = {
+    StreamingPoint(reversed),
+    StreamingPoint(rotated) };
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  const ros::Time now(1000,0);
+
+  size_t i = 0;
+  for(auto _ : state) {
+    task.insertSegments(trajs[i++ % 2], now, segments, task.index_permutation_);
+    benchmark::DoNotOptimize(segments.size());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StreamingPointIngestionReordered)->Arg(7)->Arg(32);
+
+//! Permutation lookup alone, with and without a cache hit
+static void BM_IndexPermutation(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(state.range(0));
+  const bool cache_hit = state.range(1);
+
+  std::vector<std::string> reversed(task.joint_names_.rbegin(), task.joint_names_.rend());
+  std::vector<std::string> rotated(task.joint_names_);
+  std::rotate(rotated.begin(), rotated.begin() + 1, rotated.end());
+
+  std::vector<size_t> index_permutation(task.joint_names_.size());
+
+  size_t i = 0;
+  for(auto _ : state) {
+    const std::vector<std::string> &names = (cache_hit || (i++ % 2)) ? reversed : rotated;
+    benchmark::DoNotOptimize(task.getIndexPermutation(names, index_permutation));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexPermutation)->Args({7,1})->Args({7,0})->Args({32,1})->Args({32,0});
+
+/******************************************************************************
+ * Trajectory processing (arg: number of trajectory points)
+ ******************************************************************************/
+
+//! Convert a trajectory message into segments
+static void BM_TrajectoryMsgToSegments(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(7);
+  const trajectory_msgs::JointTrajectory traj =
+    SyntheticTrajectory(task.joint_names_, state.range(0), 0.01);
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  CallRecorder recorder(state);
+
+  for(auto _ : state) {
+    segments.clear();
+
+    recorder.start();
+    JointTrajGeneratorRML::TrajectoryMsgToSegments(
+        traj, task.identity_permutation_, task.n_dof_, sim_now, segments);
+    recorder.stop();
+
+    benchmark::DoNotOptimize(segments.size());
+  }
+
+  state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_TrajectoryMsgToSegments)->RangeMultiplier(10)->Range(1,100000)->UseManualTime();
+
+//! Replace the second half of a trajectory with a new one
+static void BM_SpliceTrajectory(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(7);
+  const size_t n_points = state.range(0);
+  const double t_step = 0.01;
+
+  JointTrajGeneratorRML::TrajSegments current_segments, new_segments;
+  JointTrajGeneratorRML::TrajectoryMsgToSegments(
+      SyntheticTrajectory(task.joint_names_, n_points, t_step),
+      task.identity_permutation_, task.n_dof_, sim_now, current_segments);
+  JointTrajGeneratorRML::TrajectoryMsgToSegments(
+      SyntheticTrajectory(task.joint_names_, n_points, t_step),
+      task.identity_permutation_, task.n_dof_, sim_now + ros::Duration(0.5*n_points*t_step), new_segments);
+
+  CallRecorder recorder(state);
+
+  // After the first splice, each call replaces the same tail
+  for(auto _ : state) {
+    recorder.start();
+    JointTrajGeneratorRML::SpliceTrajectory(current_segments, new_segments);
+    recorder.stop();
+
+    benchmark::DoNotOptimize(current_segments.size());
+  }
+
+  state.SetItemsProcessed(state.iterations()*n_points);
+}
+BENCHMARK(BM_SpliceTrajectory)->RangeMultiplier(10)->Range(1,100000)->UseManualTime();
+
+//! Per-cycle segment bookkeeping while following a long trajectory
+static void BM_UpdateSegments(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(7);
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  JointTrajGeneratorRML::TrajectoryMsgToSegments(
+      SyntheticTrajectory(task.joint_names_, state.range(0), 0.01),
+      task.identity_permutation_, task.n_dof_, sim_now, segments);
+
+  const Eigen::VectorXd joint_position = Eigen::VectorXd::Zero(task.n_dof_);
+  const Eigen::VectorXd joint_velocity = Eigen::VectorXd::Zero(task.n_dof_);
+
+  CallRecorder recorder(state);
+
+  for(auto _ : state) {
+    recorder.start();
+    benchmark::DoNotOptimize(
+        task.updateSegments(sim_now, joint_position, joint_velocity, segments));
+    recorder.stop();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateSegments)->RangeMultiplier(10)->Range(1,100000)->UseManualTime();
+
+/******************************************************************************
+ * Trajectory generation (arg: number of joints)
+ ******************************************************************************/
+
+//! Solve a single Reflexxes trajectory from an arbitrary state
+static void BM_ComputeTrajectory(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(state.range(0));
+
+  boost::shared_ptr<ReflexxesAPI> rml;
+  boost::shared_ptr<RMLPositionInputParameters> rml_in;
+  boost::shared_ptr<RMLPositionOutputParameters> rml_out;
+  RMLPositionFlags rml_flags;
+  task.configureRML(rml, rml_in, rml_out, rml_flags);
+
+  const Eigen::VectorXd zero = Eigen::VectorXd::Zero(task.n_dof_);
+  Eigen::VectorXd goal_position = Eigen::VectorXd::Zero(task.n_dof_);
+
+  CallRecorder recorder(state);
+
+  size_t i = 0;
+  for(auto _ : state) {
+    // Alternate goals so each solution is different
+    goal_position.setConstant((i++ % 2) ? 1.0 : -1.0);
+
+    recorder.start();
+    task.computeTrajectory(
+        sim_now, zero, zero, zero,
+        ros::Duration(0.0),
+        goal_position, zero,
+        rml, rml_in, rml_out, rml_flags);
+    recorder.stop();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ComputeTrajectory)->Arg(7)->Arg(32)->UseManualTime();
+
+/******************************************************************************
+ * Full control cycle (arg: number of trajectory points)
+ ******************************************************************************/
+
+//! Run updateHook() at 1kHz while following a trajectory
+static void BM_UpdateHook(benchmark::State &state)
+{
+  BenchmarkTrajGenerator task(7);
+
+  RTT::OutputPort<Eigen::VectorXd> position_out("position_out");
+  RTT::OutputPort<Eigen::VectorXd> velocity_out("velocity_out");
+  position_out.connectTo(&task.joint_position_in_);
+  velocity_out.connectTo(&task.joint_velocity_in_);
+  position_out.setDataSample(Eigen::VectorXd::Zero(task.n_dof_));
+  velocity_out.setDataSample(Eigen::VectorXd::Zero(task.n_dof_));
+
+  if(!task.start()) {
+    state.SkipWithError("Could not start the synthetic trajectory generator.");
+    return;
+  }
+
+  // The first update seeds the generator with the current state
+  task.joint_position_sample_.setZero();
+  task.joint_velocity_sample_.setZero();
+  position_out.write(task.joint_position_sample_);
+  velocity_out.write(task.joint_velocity_sample_);
+  task.updateHook();
+
+  JointTrajGeneratorRML::TrajectoryMsgToSegments(
+      SyntheticTrajectory(task.joint_names_, state.range(0), 0.01),
+      task.identity_permutation_, task.n_dof_, sim_now, task.segments_);
+
+  CallRecorder recorder(state);
+
+  for(auto _ : state) {
+    // Perfect tracking: the measured state is the last sample
+    sim_now += ros::Duration(0.001);
+    position_out.write(task.joint_position_sample_);
+    velocity_out.write(task.joint_velocity_sample_);
+
+    recorder.start();
+    task.updateHook();
+    recorder.stop();
+  }
+
+  task.stop();
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateHook)->RangeMultiplier(10)->Range(1,100000)->UseManualTime();
+
+int main(int argc, char** argv)
+{
+  benchmark::Initialize(&argc, argv);
+
+  // Use wall-clock time for anything that bypasses the simulated clock
+  ros::Time::init();
+
+  // Initialize Orocos
+  __os_init(argc, argv);
+
+  RTT::Logger::log().setStdStream(std::cerr);
+  RTT::Logger::log().mayLogStdOut(true);
+  RTT::Logger::log().setLogLevel(RTT::Logger::Warning);
+
+  // Import conman plugin
+  if(!RTT::ComponentLoader::Instance()->import("conman", "" )) {
+    std::cerr<<"Could not import conman package."<<std::endl;
+    return -1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  __os_exit();
+
+  return 0;
+}
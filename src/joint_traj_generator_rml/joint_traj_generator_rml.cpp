@@ -3,6 +3,7 @@
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <cmath>
 
 #include <Eigen/Dense>
 
@@ -42,14 +43,36 @@ JointTrajGeneratorRML::JointTrajGeneratorRML(std::string const& name) :
   ,stop_on_violation_(true)
   ,traj_mode_(INACTIVE)
   ,stop_time_(0.5)
+  ,stream_points_(false)
+  ,stream_queue_size_(10)
+  ,jog_timeout_(0.1)
+  ,blend_segments_(false)
+  ,parameterize_trajectories_(false)
   // RML
   ,rml_zero_(0)
   ,rml_true_(0)
+  ,jog_stopping_(false)
   // Debugging
   ,ros_publish_throttle_(0.02)
+  // Action interface
+  ,goal_commands_(16, GoalCommand())
+  ,goal_events_(16, GoalEvent())
+  ,feedback_buffer_(FeedbackSample())
+  ,action_relay_(goal_events_, feedback_buffer_)
+  ,action_relay_activity_(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.0, &action_relay_, name+"_action"))
+  // Segment planning
+  ,plan_slots_(16)
+  ,plan_requests_(plan_slots_.size(), static_cast<SegmentPlan*>(NULL))
+  ,planned_segments_(plan_slots_.size(), static_cast<SegmentPlan*>(NULL))
+  ,discarded_plans_(0)
+  ,segment_planner_(*this, plan_requests_, planned_segments_)
+  ,segment_planner_activity_(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, 0.0, &segment_planner_, name+"_planner"))
 {
   // Declare properties
   this->addProperty("use_rosparam",use_rosparam_).doc("Fetch parameters from rosparam when configure() is called (true by default).");
+  this->addProperty("use_rostopic",use_rostopic_).doc("Stream the command and desired state ports over ROS topics when configure() is called (true by default).");
   this->addProperty("robot_description",robot_description_).doc("The URDF xml string.");
   this->addProperty("robot_description_param",robot_description_param_).doc("The ROS parameter for the URDF xml string.");
   this->addProperty("root_link",root_link_).doc("The root link for the controller.");
@@ -64,6 +87,11 @@ JointTrajGeneratorRML::JointTrajGeneratorRML(std::string const& name) :
   this->addProperty("sampling_resolution",sampling_resolution_).doc("Sampling resolution in seconds.");
   this->addProperty("stop_on_violation",stop_on_violation_).doc("Stop the trajectory if the tolerances are violated.");
   this->addProperty("stop_time",stop_time_).doc("The time it should take to stop the arm.");
+  this->addProperty("stream_points",stream_points_).doc("Append point commands to the current trajectory instead of preempting it.");
+  this->addProperty("stream_queue_size",stream_queue_size_).doc("Maximum number of streamed points queued behind the active segment, further points replace the last one or are dropped if it cannot be replaced (0 is the same as 1).");
+  this->addProperty("blend_segments",blend_segments_).doc("Pass through consecutive flexible points instead of stopping at each one.");
+  this->addProperty("parameterize_trajectories",parameterize_trajectories_).doc("Plan feasible times for trajectory messages and goals outside of the realtime loop before they're spliced into the current trajectory.");
+  this->addProperty("jog_timeout",jog_timeout_).doc("Time after the last velocity command at which jogging is stopped.");
   this->addProperty("verbose",verbose_).doc("Verbose debug output control.");
 
   // Configure data ports
@@ -73,6 +101,8 @@ JointTrajGeneratorRML::JointTrajGeneratorRML(std::string const& name) :
     .doc("Current joint velocity. (required)");
   this->ports()->addPort("joint_position_cmd_in", joint_position_cmd_in_)
     .doc("Desired joint position, to be acquired as fast as possible.");
+  this->ports()->addPort("joint_velocity_cmd_in", joint_velocity_cmd_in_)
+    .doc("Desired joint velocity for jogging, to be acquired as fast as possible.");
   this->ports()->addPort("joint_position_out", joint_position_out_)
     .doc("Interpolated joint position subject to velocity and acceleration limits.");
   this->ports()->addPort("joint_velocity_out", joint_velocity_out_)
@@ -101,14 +131,16 @@ JointTrajGeneratorRML::JointTrajGeneratorRML(std::string const& name) :
   conman_hook_->setInputExclusivity("joint_position_in", conman::Exclusivity::EXCLUSIVE);
   conman_hook_->setInputExclusivity("joint_velocity_in", conman::Exclusivity::EXCLUSIVE);
   conman_hook_->setInputExclusivity("joint_position_cmd_in", conman::Exclusivity::EXCLUSIVE);
+  conman_hook_->setInputExclusivity("joint_velocity_cmd_in", conman::Exclusivity::EXCLUSIVE);
 }
 
 bool JointTrajGeneratorRML::configureHook()
 {
   // ROS topics
-  if(   !joint_traj_cmd_in_.createStream(rtt_roscomm::topic("~" + this->getName() + "/joint_traj_cmd"))
+  if(use_rostopic_ && (
+        !joint_traj_cmd_in_.createStream(rtt_roscomm::topic("~" + this->getName() + "/joint_traj_cmd"))
      || !joint_traj_point_cmd_in_.createStream(rtt_roscomm::topic("~" + this->getName() + "/joint_traj_point_cmd"))
-     || !joint_state_desired_out_.createStream(rtt_roscomm::topic("~" + this->getName() + "/joint_state_desired")))
+     || !joint_state_desired_out_.createStream(rtt_roscomm::topic("~" + this->getName() + "/joint_state_desired"))))
   {
     RTT::log(RTT::Error) << "ROS Topics could not be streamed..." <<RTT::endlog();
     return false;
@@ -150,14 +182,17 @@ bool JointTrajGeneratorRML::configureHook()
     // Get joint names
     joint_names_.clear();
     joint_names_.reserve(n_dof_);
+    joint_name_index_map_.clear();
     int j=0;
     for(std::vector<KDL::Segment>::iterator it = kdl_chain.segments.begin();
         it != kdl_chain.segments.end();
         ++it)
     {
-      joint_names_.push_back(it->getJoint().getName());
-      joint_name_index_map_[joint_names_.back()] = j;
-      j++;
+      if(it->getJoint().getType() != KDL::Joint::None) {
+        joint_names_.push_back(it->getJoint().getName());
+        joint_name_index_map_[joint_names_.back()] = j;
+        j++;
+      }
     }
   } else {
     RTT::log(RTT::Error) << "URDF string is empty" << RTT::endlog();
@@ -198,6 +233,11 @@ bool JointTrajGeneratorRML::configureHook()
     rosparam->getComponentPrivate("verbose");
     rosparam->getComponentPrivate("stop_on_violation");
     rosparam->getComponentPrivate("stop_time");
+    rosparam->getComponentPrivate("stream_points");
+    rosparam->getComponentPrivate("stream_queue_size");
+    rosparam->getComponentPrivate("jog_timeout");
+    rosparam->getComponentPrivate("blend_segments");
+    rosparam->getComponentPrivate("parameterize_trajectories");
   }
 
   // Resize IO vectors
@@ -205,6 +245,7 @@ bool JointTrajGeneratorRML::configureHook()
   joint_zero_.setConstant(0.0);
   joint_position_.resize(n_dof_);
   joint_position_cmd_.resize(n_dof_);
+  joint_velocity_cmd_.resize(n_dof_);
   joint_position_sample_.resize(n_dof_);
   joint_position_err_.resize(n_dof_);
   joint_velocity_.resize(n_dof_);
@@ -220,11 +261,39 @@ bool JointTrajGeneratorRML::configureHook()
   index_permutation_.resize(n_dof_);
   active_segment_ = TrajSegment(n_dof_,false);
 
+  // Reset the joint name permutation cache
+  cached_joint_names_.clear();
+  cached_joint_names_.reserve(n_dof_);
+  cached_index_permutation_.resize(n_dof_);
+  joint_index_assigned_.assign(n_dof_,false);
+
+  // Preallocate the desired state and action feedback messages
+  joint_state_desired_.name = joint_names_;
+  joint_state_desired_.position.resize(n_dof_);
+  joint_state_desired_.velocity.resize(n_dof_);
+  joint_state_desired_out_.setDataSample(joint_state_desired_);
+
+  this->prepareFeedback();
+  feedback_buffer_.data_sample(feedback_);
+
+  // Preallocate the segment plans
+  free_plans_.clear();
+  free_plans_.reserve(plan_slots_.size());
+  for(std::vector<SegmentPlan>::iterator it = plan_slots_.begin(); it != plan_slots_.end(); ++it) {
+    it->start_position.resize(n_dof_);
+    it->start_velocity.resize(n_dof_);
+    free_plans_.push_back(&(*it));
+  }
+
   // Start the action server
   rtt_action_server_.start();
 
   // Configure RML structures
-  return this->configureRML(rml_, rml_in_, rml_out_, rml_flags_);
+  return
+    this->configureRML(rml_, rml_in_, rml_out_, rml_flags_) &&
+    this->configureRML(rml_param_, rml_param_in_, rml_param_out_, rml_param_flags_) &&
+    this->configureRML(rml_splice_, rml_splice_in_, rml_splice_out_, rml_splice_flags_) &&
+    this->configureRML(rml_vel_in_, rml_vel_out_, rml_vel_flags_);
 }
 
 bool JointTrajGeneratorRML::configureRML(
@@ -267,6 +336,41 @@ bool JointTrajGeneratorRML::configureRML(
   return true;
 }
 
+bool JointTrajGeneratorRML::configureRML(
+    boost::shared_ptr<RMLVelocityInputParameters> &rml_vel_in,
+    boost::shared_ptr<RMLVelocityOutputParameters> &rml_vel_out,
+    RMLVelocityFlags &rml_vel_flags) const
+{
+  // Create velocity interface structures (these share the position interface's ReflexxesAPI)
+  rml_vel_in.reset(new RMLVelocityInputParameters(n_dof_));
+  rml_vel_out.reset(new RMLVelocityOutputParameters(n_dof_));
+
+  rml_vel_flags.SynchronizationBehavior = RMLVelocityFlags::ONLY_TIME_SYNCHRONIZATION;
+
+  for(size_t j = 0; j < n_dof_; j++)
+  {
+    // Get RML parameters from RTT Properties
+    rml_vel_in->MaxAccelerationVector->VecData[j] = max_accelerations_[j];
+    rml_vel_in->MaxJerkVector->VecData[j] = max_jerks_[j];
+
+    // Enable this joint
+    rml_vel_in->SelectionVector->VecData[j] = true;
+  }
+
+  // Check if the reflexxes config is valud
+  if(rml_vel_in->CheckForValidity()) {
+    RTT::log(RTT::Info) << ("RML velocity INPUT Configuration Valid.") << RTT::endlog();
+    RMLLog(RTT::Debug, rml_vel_in);
+  } else {
+    RTT::log(RTT::Error) << ("RML velocity INPUT Configuration Invalid!") << RTT::endlog();
+    RTT::log(RTT::Error) << ("NOTE: MaxAccelerationVector and MaxJerkVector must all be non-zero for a solution to exist.") << RTT::endlog();
+    RMLLog(RTT::Error, rml_vel_in);
+    return false;
+  }
+
+  return true;
+}
+
 bool JointTrajGeneratorRML::SpliceTrajectory(
     JointTrajGeneratorRML::TrajSegments &current_segments,
     const JointTrajGeneratorRML::TrajSegments &new_segments)
@@ -303,14 +407,141 @@ bool JointTrajGeneratorRML::SpliceTrajectory(
   return true;
 }
 
+bool JointTrajGeneratorRML::AppendSegment(
+    JointTrajGeneratorRML::TrajSegments &segments,
+    const JointTrajGeneratorRML::TrajSegment &new_segment,
+    const ros::Duration coalesce_period,
+    const size_t max_segments)
+{
+  if(!segments.empty()) {
+    TrajSegment &back_segment = segments.back();
+
+    // Only points which haven't been pursued yet can be replaced
+    const bool back_replaceable =
+      !back_segment.active &&
+      back_segment.flexible &&
+      !back_segment.goal;
+
+    // The active segment isn't waiting in the queue, and there's always room
+    // for at least one point behind it
+    const size_t n_queued = segments.size() - (segments.front().active ? 1 : 0);
+    const bool queue_full = n_queued >= std::max(max_segments, size_t(1));
+
+    // Drop the point if the queue is full of segments which can't be replaced
+    if(queue_full && !back_replaceable) {
+      return false;
+    }
+
+    if(back_replaceable &&
+       (queue_full || new_segment.start_time - back_segment.start_time < coalesce_period))
+    {
+      // Keep the original arrival time so that a continuous stream still
+      // gets a new segment once per period
+      back_segment.goal_positions = new_segment.goal_positions;
+      back_segment.goal_velocities = new_segment.goal_velocities;
+      back_segment.goal_accelerations = new_segment.goal_accelerations;
+      back_segment.velocities_specified = new_segment.velocities_specified;
+      return false;
+    }
+  }
+
+  // Add the new segment to the end of the trajectory
+  segments.push_back(new_segment);
+  segments.back().queued = true;
+
+  return true;
+}
+
+void JointTrajGeneratorRML::BlendSegments(
+    const Eigen::VectorXd &start_position,
+    const Eigen::VectorXd &max_velocities,
+    const Eigen::VectorXd &max_accelerations,
+    JointTrajGeneratorRML::TrajSegments &segments)
+{
+  if(segments.empty()) {
+    return;
+  }
+
+  // The active segment has already been planned, so start after it
+  TrajSegments::iterator begin = segments.begin();
+  const Eigen::VectorXd *last_position = &start_position;
+  const Eigen::VectorXd *last_velocity = NULL;
+
+  if(begin->active) {
+    last_position = &begin->goal_positions;
+    last_velocity = &begin->goal_velocities;
+    ++begin;
+  }
+
+  const size_t n_dof = start_position.size();
+
+  // Forward pass: pick a direction and bound the speed by what can be reached
+  // from the previous waypoint
+  for(TrajSegments::iterator it = begin; it != segments.end(); ++it)
+  {
+    TrajSegments::iterator next = it; ++next;
+
+    if(it->flexible && !it->velocities_specified) {
+      it->goal_velocities.setZero();
+
+      if(next != segments.end() && next->flexible) {
+        for(size_t j=0; j<n_dof; j++) {
+          const double
+            dist_in = it->goal_positions[j] - (*last_position)[j],
+            dist_out = next->goal_positions[j] - it->goal_positions[j];
+
+          // Stop at the waypoint if the joint changes direction
+          if(dist_in * dist_out <= 0.0) {
+            continue;
+          }
+
+          const double last_speed = (last_velocity == NULL) ? 0.0 : std::abs((*last_velocity)[j]);
+          const double speed = std::min(
+              max_velocities[j],
+              std::min(
+                std::sqrt(max_accelerations[j] * std::min(std::abs(dist_in), std::abs(dist_out))),
+                std::sqrt(last_speed*last_speed + 2.0 * max_accelerations[j] * std::abs(dist_in))));
+
+          it->goal_velocities[j] = (dist_out > 0.0) ? speed : -speed;
+        }
+      }
+    }
+
+    last_position = &it->goal_positions;
+    last_velocity = &it->goal_velocities;
+  }
+
+  // Backward pass: make sure each waypoint can still slow down enough for
+  // the one after it
+  TrajSegments::iterator next = segments.end();
+  for(TrajSegments::iterator it = segments.end(); it != begin; next = it)
+  {
+    --it;
+
+    if(next == segments.end() || !it->flexible || it->velocities_specified || !next->flexible) {
+      continue;
+    }
+
+    for(size_t j=0; j<n_dof; j++) {
+      const double
+        dist_out = std::abs(next->goal_positions[j] - it->goal_positions[j]),
+        next_speed = next->goal_velocities[j],
+        max_speed = std::sqrt(next_speed*next_speed + 2.0 * max_accelerations[j] * dist_out);
+
+      if(std::abs(it->goal_velocities[j]) > max_speed) {
+        it->goal_velocities[j] = (it->goal_velocities[j] > 0.0) ? max_speed : -max_speed;
+      }
+    }
+  }
+}
+
 bool JointTrajGeneratorRML::TrajectoryMsgToSegments(
     const trajectory_msgs::JointTrajectory &msg,
     const std::vector<size_t> &ip,
     const size_t n_dof,
     const ros::Time new_traj_start_time,
     TrajSegments &segments,
-    GoalHandle *gh,
-    size_t *gh_required)
+    ActiveGoalPtr goal)
 {
   // Clear the output segment list
   segments.clear();
@@ -346,13 +577,11 @@ bool JointTrajGeneratorRML::TrajectoryMsgToSegments(
     }
 
     // Add actionlib goal information
-    if(gh != NULL && gh->isValid()) {
-      // Store the pointers
-      new_segment.gh = gh;
-      new_segment.gh_required = gh_required;
+    if(goal) {
+      new_segment.goal = goal;
 
       // Increment required counter
-      (*gh_required)++;
+      goal->segments_required++;
     }
 
     // Compute the start time for the new segment. If this is the first
@@ -366,6 +595,9 @@ bool JointTrajGeneratorRML::TrajectoryMsgToSegments(
     new_segment.goal_time = new_traj_start_time + it->time_from_start;
     new_segment.expected_time = new_segment.goal_time;
 
+    // Flexible points without velocities may be blended
+    new_segment.velocities_specified = (it->velocities.size() > 0);
+
     // Copy in the data (permuted appropriately)
     for(int j=0; j<n_dof; j++) {
       if(j < it->positions.size()) new_segment.goal_positions(ip[j]) = it->positions[j];
@@ -379,6 +611,56 @@ bool JointTrajGeneratorRML::TrajectoryMsgToSegments(
   return true;
 }
 
+bool JointTrajGeneratorRML::getIndexPermutation(
+    const std::vector<std::string> &joint_names,
+    std::vector<size_t> &index_permutation) const
+{
+  // Unnamed joints are given in the native order
+  if(joint_names.empty()) {
+    this->getIdentityIndexPermutation(index_permutation);
+    return true;
+  }
+
+  // Re-use the permutation if this is the same ordering as last time
+  if(!cached_joint_names_.empty() && joint_names == cached_joint_names_) {
+    index_permutation = cached_index_permutation_;
+    return true;
+  }
+
+  if(joint_names.size() != n_dof_) {
+    RTT::log(RTT::Error) << "Received trajectory with "<<joint_names.size()<<" joint names, but this generator controls "<<n_dof_<<" joints." << RTT::endlog();
+    return false;
+  }
+
+  // Permute the joint names properly (the cache is only updated once the
+  // whole ordering has been validated)
+  index_permutation.resize(n_dof_);
+  joint_index_assigned_.assign(n_dof_,false);
+  for(size_t joint_index=0; joint_index<n_dof_; joint_index++)
+  {
+    boost::unordered_map<std::string,size_t>::const_iterator index_it =
+      joint_name_index_map_.find(joint_names[joint_index]);
+
+    if(index_it == joint_name_index_map_.end()) {
+      RTT::log(RTT::Error) << "Received trajectory for unknown joint \""<<joint_names[joint_index]<<"\"." << RTT::endlog();
+      return false;
+    }
+    if(joint_index_assigned_[index_it->second]) {
+      RTT::log(RTT::Error) << "Received trajectory with duplicate joint \""<<joint_names[joint_index]<<"\"." << RTT::endlog();
+      return false;
+    }
+
+    joint_index_assigned_[index_it->second] = true;
+    index_permutation[joint_index] = index_it->second;
+  }
+
+  // Only cache complete, valid permutations
+  cached_joint_names_ = joint_names;
+  cached_index_permutation_ = index_permutation;
+
+  return true;
+}
+
 void JointTrajGeneratorRML::handleSampleError(const std::runtime_error &err)
 {
   RTT::log(RTT::Error) << "Error while sampling trajectory: " << err.what() << RTT::endlog();
@@ -499,6 +781,167 @@ void JointTrajGeneratorRML::computeTrajectory(
       rml, rml_in, rml_out, rml_flags);
 }
 
+void JointTrajGeneratorRML::computeVelocityTrajectory(
+    const Eigen::VectorXd &init_position,
+    const Eigen::VectorXd &init_velocity,
+    const Eigen::VectorXd &init_acceleration,
+    const Eigen::VectorXd &goal_velocity,
+    boost::shared_ptr<ReflexxesAPI> rml,
+    boost::shared_ptr<RMLVelocityInputParameters> rml_vel_in,
+    boost::shared_ptr<RMLVelocityOutputParameters> rml_vel_out,
+    RMLVelocityFlags &rml_vel_flags) const
+{
+  // Update RML input parameters
+  rml_vel_in->SetMaxAccelerationVector(&max_accelerations_[0]);
+  rml_vel_in->SetMaxJerkVector(&max_jerks_[0]);
+
+  for(size_t i=0;i<n_dof_;i++) {
+    rml_vel_in->SetSelectionVectorElement(true,i);
+    // The velocity interface doesn't enforce the velocity limits
+    rml_vel_in->SetTargetVelocityVectorElement(
+        std::max(-max_velocities_[i], std::min(goal_velocity[i], max_velocities_[i])), i);
+  }
+
+  // Set initial state
+  rml_vel_in->SetCurrentPositionVector(init_position.data());
+  rml_vel_in->SetCurrentVelocityVector(init_velocity.data());
+  rml_vel_in->SetCurrentAccelerationVector(init_acceleration.data());
+  rml_vel_in->SetMinimumSynchronizationTime(0.0);
+
+  if(verbose_) RTT::log(RTT::Debug) << ("RML Recomputing velocity trajectory...") << RTT::endlog();
+  if(verbose_) RMLLog(RTT::Info, rml_vel_in);
+
+  // Compute trajectory
+  int rml_result = rml->RMLVelocity(
+      *rml_vel_in.get(),
+      rml_vel_out.get(),
+      rml_vel_flags);
+
+  if(verbose_) RTT::log(RTT::Debug) << "RML OUT: time: "<<rml_vel_out->GetGreatestExecutionTime() << RTT::endlog();
+
+  // Throw exception on result
+  this->handleRMLResult(rml_result);
+}
+
+bool JointTrajGeneratorRML::sampleVelocityTrajectory(
+    const ros::Time rtt_now,
+    const ros::Time jog_start_time,
+    boost::shared_ptr<ReflexxesAPI> rml,
+    boost::shared_ptr<RMLVelocityOutputParameters> rml_vel_out,
+    Eigen::VectorXd &joint_position_sample,
+    Eigen::VectorXd &joint_velocity_sample,
+    Eigen::VectorXd &joint_acceleration_sample) const
+{
+  // Sample the already computed trajectory
+  int rml_result = rml->RMLVelocityAtAGivenSampleTime(
+      std::max(0.0, (rtt_now - jog_start_time).toSec()),
+      rml_vel_out.get());
+
+  this->handleRMLResult(rml_result);
+
+  // Get the new sampled reference
+  for(size_t i=0; i<n_dof_; i++) {
+    joint_position_sample(i) = rml_vel_out->GetNewPositionVectorElement(i);
+    joint_velocity_sample(i) = rml_vel_out->GetNewVelocityVectorElement(i);
+    joint_acceleration_sample(i) = rml_vel_out->GetNewAccelerationVectorElement(i);
+  }
+
+  // Return true if the goal velocity has been reached
+  return rml_result == ReflexxesAPI::RML_FINAL_STATE_REACHED;
+}
+
+bool JointTrajGeneratorRML::parameterizeSegments(
+    const Eigen::VectorXd &start_position,
+    const Eigen::VectorXd &start_velocity,
+    JointTrajGeneratorRML::TrajSegments &segments) const
+{
+  if(segments.empty()) {
+    return true;
+  }
+
+  // Plan a copy so that the segments are untouched if any of them fails
+  TrajSegments planned_segments(segments);
+
+  // Each segment is solved from the goal of the one before it
+  const Eigen::VectorXd *last_position = &start_position;
+  const Eigen::VectorXd *last_velocity = &start_velocity;
+
+  ros::Time segment_start_time = planned_segments.front().start_time;
+  ros::Duration delay(0.0);
+  RMLPositionFlags rml_flags = rml_param_flags_;
+
+  try {
+    for(TrajSegments::iterator it = planned_segments.begin(); it != planned_segments.end(); ++it)
+    {
+      this->planSegment(
+          segment_start_time,
+          *last_position,
+          *last_velocity,
+          joint_zero_,
+          *it,
+          delay,
+          rml_param_, rml_param_in_, rml_param_out_, rml_flags);
+
+      segment_start_time = it->goal_time;
+      last_position = &it->goal_positions;
+      last_velocity = &it->goal_velocities;
+    }
+  } catch (std::runtime_error &err) {
+    RTT::log(RTT::Error) << "Failed to parameterize trajectory: " << err.what() << RTT::endlog();
+    return false;
+  }
+
+  segments.swap(planned_segments);
+
+  return true;
+}
+
+void JointTrajGeneratorRML::planSegment(
+    const ros::Time start_time,
+    const Eigen::VectorXd &start_position,
+    const Eigen::VectorXd &start_velocity,
+    const Eigen::VectorXd &start_acceleration,
+    JointTrajGeneratorRML::TrajSegment &segment,
+    ros::Duration &delay,
+    boost::shared_ptr<ReflexxesAPI> rml,
+    boost::shared_ptr<RMLPositionInputParameters> rml_in,
+    boost::shared_ptr<RMLPositionOutputParameters> rml_out,
+    RMLPositionFlags &rml_flags) const
+{
+  // Compute the time-optimal solution for this segment
+  this->computeTrajectory(
+      start_time,
+      start_position,
+      start_velocity,
+      start_acceleration,
+      ros::Duration(0.0),
+      segment.goal_positions,
+      segment.goal_velocities,
+      rml, rml_in, rml_out, rml_flags);
+
+  const ros::Duration min_duration(rml_out->GetGreatestExecutionTime());
+
+  segment.start_time = start_time;
+
+  if(segment.flexible) {
+    segment.goal_time = start_time + min_duration;
+  } else {
+    // Delay the segment by however much the ones before it were stretched
+    segment.goal_time += delay;
+
+    if(segment.goal_time - start_time < min_duration) {
+      if(verbose_) RTT::log(RTT::Debug) << "Stretching trajectory segment ("<<segment.id<<") to: "<<min_duration << RTT::endlog();
+      delay += (start_time + min_duration) - segment.goal_time;
+      segment.goal_time = start_time + min_duration;
+    }
+  }
+
+  segment.expected_time = segment.goal_time;
+
+  // The goal velocities are part of the plan now
+  segment.velocities_specified = true;
+}
+
 bool JointTrajGeneratorRML::updateSegments(
     const ros::Time rtt_now,
     const Eigen::VectorXd &joint_position,
@@ -523,7 +966,7 @@ bool JointTrajGeneratorRML::updateSegments(
     // This only applies to non-flexible segments
     if(
         (it->achieved) ||                                  // Has already been achieved
-        (it->gh !=NULL && (!it->gh->isValid() || it->gh->getGoalStatus().status != actionlib_msgs::GoalStatus::ACTIVE)) ||
+        (it->goal && !it->goal->active) ||                 // Goal is no longer active
         //(it->achieved && next->flexible) ||
         (!it->flexible && it->expected_time < rtt_now) ||  // Should have finished earlier than now
         (next != segments.end() && !next->flexible && next->start_time <= rtt_now)) // Next segment should have started
@@ -555,7 +998,7 @@ bool JointTrajGeneratorRML::updateSegments(
 
       if(verbose_) {
         RTT::log(RTT::Debug) << "Segment ("<<it->id<<") needs to be removed." <<RTT::endlog();
-        RTT::log(RTT::Debug) << " - goal status: "<< ((it->gh == NULL) ? (-1) : int(it->gh->getGoalStatus().status)) << RTT::endlog();
+        RTT::log(RTT::Debug) << " - goal active: "<< ((!it->goal) ? (-1) : int(it->goal->active)) << RTT::endlog();
         RTT::log(RTT::Debug) << " - achieved: "<<it->achieved  << RTT::endlog();
         RTT::log(RTT::Debug) << " - flexible: "<<it->flexible  <<  RTT::endlog();
         RTT::log(RTT::Debug) << " - start_time: "<<it->start_time  <<  RTT::endlog();
@@ -749,6 +1192,11 @@ bool JointTrajGeneratorRML::readCommands(
 {
   // If the trajectory should be continued or stopped (empty traj command)
   bool continue_traj = true;
+  // If the whole trajectory needs new pass-through velocities
+  bool blend = false;
+
+  // Splice in any trajectories which have been planned since the last update
+  this->readPlannedSegments(rtt_now);
 
   // Read in any newly commanded joint positions
   RTT::FlowStatus point_status = joint_position_cmd_in_.readNewest( joint_position_cmd_ );
@@ -764,6 +1212,9 @@ bool JointTrajGeneratorRML::readCommands(
         rtt_now,
         segments_,
         index_permutation_);
+    // Streamed points are always passed through, so a stream doesn't stop
+    // at each one
+    blend = blend_segments_ || stream_points_;
   }
   // Check if there's a new desired trajectory point
   else if(traj_point_status == RTT::NewData)
@@ -774,6 +1225,8 @@ bool JointTrajGeneratorRML::readCommands(
         rtt_now,
         segments_,
         index_permutation_);
+    // Unless they're streamed, points are inserted as trajectories
+    blend = stream_points_ || (blend_segments_ && !parameterize_trajectories_);
   }
   // Check if there's a new desired trajectory
   else if(traj_status == RTT::NewData)
@@ -784,11 +1237,384 @@ bool JointTrajGeneratorRML::readCommands(
         rtt_now,
         segments_,
         index_permutation_);
+    blend = blend_segments_ && !parameterize_trajectories_;
+  }
+
+  // Plan pass-through velocities for any new waypoints. Parameterized
+  // trajectories have already been blended before they were timed, and
+  // their velocities are fixed so that blending behind them doesn't change
+  // the velocities their times were planned for.
+  if(blend) {
+    BlendSegments(joint_position_sample_, max_velocities_, max_accelerations_, segments_);
+  }
+
+  // Trajectories which are still being planned were commanded before the stop
+  if(!continue_traj) {
+    this->discardPendingPlans();
   }
 
   return continue_traj;
 }
 
+void JointTrajGeneratorRML::readPlannedSegments(
+    const ros::Time &rtt_now)
+{
+  SegmentPlan *plan = NULL;
+
+  while(planned_segments_.Pop(plan))
+  {
+    // The plan can be reused once its segments have been moved out
+    free_plans_.push_back(plan);
+    TrajSegments &new_segments = plan->segments;
+
+    if(discarded_plans_ > 0) {
+      discarded_plans_--;
+      new_segments.clear();
+      continue;
+    }
+
+    if(new_segments.empty()) {
+      continue;
+    }
+
+    // Drop trajectories for goals which were preempted while being planned
+    if(new_segments.front().goal && !new_segments.front().goal->active) {
+      new_segments.clear();
+      continue;
+    }
+
+    // The goal this one preempted has been kept running until now
+    if(new_segments.front().goal) {
+      this->cancelPreemptedGoal();
+    }
+
+    // Delay the trajectory by however long it waited to be planned, but no
+    // further than needed for it not to start in the past
+    const ros::Duration latency = std::min(
+        rtt_now - plan->request_time,
+        rtt_now - new_segments.front().start_time);
+
+    if(latency > ros::Duration(0.0)) {
+      for(TrajSegments::iterator it = new_segments.begin(); it != new_segments.end(); ++it) {
+        it->start_time += latency;
+        it->goal_time += latency;
+        it->expected_time += latency;
+      }
+    }
+
+    if(plan->replace) {
+      segments_.clear();
+    }
+
+    // Find the state the trajectory is spliced onto, like insertSegments()
+    const Eigen::VectorXd *start_position = &joint_position_sample_;
+    const Eigen::VectorXd *start_velocity = &joint_velocity_sample_;
+    const Eigen::VectorXd *start_acceleration = &joint_acceleration_sample_;
+
+    for(TrajSegments::const_iterator it = segments_.begin();
+        it != segments_.end() && it->start_time < new_segments.front().start_time;
+        ++it)
+    {
+      start_position = &it->goal_positions;
+      start_velocity = &it->goal_velocities;
+      start_acceleration = &joint_zero_;
+    }
+
+    // Re-plan the first segment from that state
+    TrajSegment &first_segment = new_segments.front();
+    const ros::Time planned_goal_time = first_segment.goal_time;
+    ros::Duration delay(0.0);
+
+    try {
+      this->planSegment(
+          first_segment.start_time,
+          *start_position,
+          *start_velocity,
+          *start_acceleration,
+          first_segment,
+          delay,
+          rml_splice_, rml_splice_in_, rml_splice_out_, rml_splice_flags_);
+
+      // The rest of the trajectory is only ever delayed, like parameterizeSegments()
+      const ros::Duration rebase_delay = first_segment.goal_time - planned_goal_time;
+      if(rebase_delay > ros::Duration(0.0)) {
+        for(TrajSegments::iterator it = ++new_segments.begin(); it != new_segments.end(); ++it) {
+          it->start_time += rebase_delay;
+          it->goal_time += rebase_delay;
+          it->expected_time += rebase_delay;
+        }
+      }
+    } catch (std::runtime_error &err) {
+      RTT::log(RTT::Warning) << "Could not re-plan the start of a planned trajectory, it will be executed as it was planned." <<RTT::endlog();
+    }
+
+    // Splice the segments in like SpliceTrajectory(), but move them instead
+    // of copying them, so nothing is allocated here. The seam isn't blended,
+    // since they were planned to start from the goal they're spliced onto.
+    segments_.erase(
+        std::lower_bound(
+          segments_.begin(),
+          segments_.end(),
+          new_segments.front(),
+          TrajSegment::StartTimeCompare),
+        segments_.end());
+
+    for(TrajSegments::iterator it = new_segments.begin(); it != new_segments.end(); ++it) {
+      it->queued = true;
+    }
+    segments_.splice(segments_.end(), new_segments);
+  }
+}
+
+void JointTrajGeneratorRML::discardPendingPlans()
+{
+  discarded_plans_ = this->getNumPendingPlans();
+}
+
+void JointTrajGeneratorRML::cancelPreemptedGoal()
+{
+  if(preempted_goal_) {
+    if(preempted_goal_->active) {
+      RTT::log(RTT::Debug) << "Trajectory action goal has been preempted." <<RTT::endlog();
+      preempted_goal_->post(GOAL_CANCELED);
+    }
+    preempted_goal_.reset();
+  }
+}
+
+void JointTrajGeneratorRML::SegmentPlanner::step()
+{
+  SegmentPlan *plan = NULL;
+
+  while(requests_.Pop(plan))
+  {
+    // Blend first so the planned times account for the waypoint velocities
+    if(owner_.blend_segments_) {
+      BlendSegments(plan->start_position, owner_.max_velocities_, owner_.max_accelerations_, plan->segments);
+    }
+
+    if(!owner_.parameterizeSegments(plan->start_position, plan->start_velocity, plan->segments)) {
+      RTT::log(RTT::Warning) << "Could not parameterize trajectory, it will be executed without planned times." <<RTT::endlog();
+    }
+
+    // There's room for every plan, since there are only as many plans as
+    // the buffer holds
+    if(!plans_.Push(plan)) {
+      RTT::log(RTT::Error) << "Dropping planned trajectory, the realtime loop isn't splicing them." <<RTT::endlog();
+    }
+  }
+}
+
+bool JointTrajGeneratorRML::readGoalCommands(
+    const ros::Time &rtt_now)
+{
+  // If the trajectory should be continued or stopped (canceled goal)
+  bool continue_traj = true;
+
+  GoalCommand command;
+
+  while(goal_commands_.Pop(command))
+  {
+    switch(command.type) {
+      case NEW_GOAL:
+        {
+          RTT::log(RTT::Debug) << "New trajectory action goal." <<RTT::endlog();
+
+          // Always preempt the current goal. If the new goal's trajectory is
+          // planned outside of the realtime loop, the current goal keeps
+          // running until that trajectory is spliced in.
+          const bool defer = parameterize_trajectories_ && segment_planner_activity_->isRunning();
+          if(current_goal_ && current_goal_->active) {
+            if(defer && !preempted_goal_) {
+              preempted_goal_ = current_goal_;
+            } else {
+              current_goal_->post(GOAL_CANCELED);
+            }
+          }
+          if(!defer) {
+            this->cancelPreemptedGoal();
+          }
+          current_goal_ = command.goal;
+
+          const size_t pending_plans = this->getNumPendingPlans();
+
+          // Reject goals for joints which this generator doesn't control
+          if(!this->getIndexPermutation(current_goal_->goal->trajectory.joint_names, index_permutation_)) {
+            RTT::log(RTT::Error) << "Rejecting trajectory action goal with invalid joint names." <<RTT::endlog();
+            current_goal_->post(GOAL_REJECTED);
+          } else {
+            // Accept the goal before its segments are queued, so that they
+            // can succeed or abort it
+            current_goal_->post(GOAL_ACCEPTED);
+            this->prepareFeedback();
+
+            // Insert the segments
+            continue_traj = this->insertSegments(
+                current_goal_->goal->trajectory,
+                rtt_now,
+                segments_,
+                index_permutation_,
+                current_goal_);
+
+            // Parameterized trajectories have already been blended
+            if(blend_segments_ && !parameterize_trajectories_) {
+              BlendSegments(joint_position_sample_, max_velocities_, max_accelerations_, segments_);
+            }
+          }
+
+          // Nothing will replace the preempted goal if the new one isn't being planned
+          if(this->getNumPendingPlans() == pending_plans) {
+            this->cancelPreemptedGoal();
+          }
+          break;
+        }
+      case CANCEL_GOAL:
+        {
+          if(command.goal == current_goal_ && current_goal_->active) {
+            RTT::log(RTT::Debug) << "Trajectory action goal has been preempted." <<RTT::endlog();
+            // Preempt the trajectory
+            current_goal_->post(GOAL_CANCELED);
+            this->cancelPreemptedGoal();
+            // Hold current position
+            continue_traj = false;
+          }
+          break;
+        }
+    };
+  }
+
+  // Trajectories which are still being planned were commanded before the stop
+  if(!continue_traj) {
+    this->discardPendingPlans();
+  }
+
+  // Abort the goal if its trajectory has been dropped (and isn't still being planned)
+  if(current_goal_ && current_goal_->active && segments_.empty() && this->getNumPendingPlans() == 0) {
+    RTT::log(RTT::Debug) << "Trajectory action goal has failed." <<RTT::endlog();
+    current_goal_->post(GOAL_ABORTED);
+  }
+
+  return continue_traj;
+}
+
+bool JointTrajGeneratorRML::readVelocityCommands(
+    const ros::Time &rtt_now)
+{
+  // Read in any newly commanded joint velocities
+  if(joint_velocity_cmd_in_.readNewest( joint_velocity_cmd_ ) != RTT::NewData) {
+    return false;
+  }
+
+  if(joint_velocity_cmd_.size() != n_dof_) {
+    RTT::log(RTT::Debug) << "Received velocity command of invalid size." <<RTT::endlog();
+    return false;
+  }
+
+  if(verbose_) RTT::log(RTT::Debug) << "New velocity command." <<RTT::endlog();
+
+  // Retarget from the reference at this update. The samples are still from
+  // the last update, and retargeting from them would hold the reference for
+  // an update every time a command arrives.
+  if(traj_mode_ == JOGGING) {
+    this->sampleVelocityTrajectory(
+        rtt_now,
+        jog_start_time_,
+        rml_, rml_vel_out_,
+        joint_position_sample_,
+        joint_velocity_sample_,
+        joint_acceleration_sample_);
+  } else {
+    this->sampleTrajectory(
+        rtt_now,
+        last_segment_start_time_,
+        rml_, rml_out_,
+        joint_position_sample_,
+        joint_velocity_sample_,
+        joint_acceleration_sample_);
+
+    // Drop the current trajectory, jogging starts from the current reference
+    segments_.clear();
+    this->discardPendingPlans();
+    traj_mode_ = JOGGING;
+  }
+
+  // Retarget the velocity trajectory
+  this->computeVelocityTrajectory(
+      joint_position_sample_,
+      joint_velocity_sample_,
+      joint_acceleration_sample_,
+      joint_velocity_cmd_,
+      rml_, rml_vel_in_, rml_vel_out_, rml_vel_flags_);
+
+  jog_start_time_ = rtt_now;
+  jog_cmd_time_ = rtt_now;
+  jog_stopping_ = false;
+
+  return true;
+}
+
+void JointTrajGeneratorRML::updateJogging(
+    const ros::Time &rtt_now)
+{
+  // Stop if the commands have timed out
+  if(!jog_stopping_ && (rtt_now - jog_cmd_time_).toSec() > jog_timeout_) {
+    if(verbose_) RTT::log(RTT::Debug) << "Velocity commands timed out, stopping." <<RTT::endlog();
+
+    this->sampleVelocityTrajectory(
+        rtt_now,
+        jog_start_time_,
+        rml_, rml_vel_out_,
+        joint_position_sample_,
+        joint_velocity_sample_,
+        joint_acceleration_sample_);
+
+    this->computeVelocityTrajectory(
+        joint_position_sample_,
+        joint_velocity_sample_,
+        joint_acceleration_sample_,
+        joint_zero_,
+        rml_, rml_vel_in_, rml_vel_out_, rml_vel_flags_);
+
+    jog_start_time_ = rtt_now;
+    jog_stopping_ = true;
+  }
+
+  bool stopped = this->sampleVelocityTrajectory(
+      rtt_now,
+      jog_start_time_,
+      rml_, rml_vel_out_,
+      joint_position_sample_,
+      joint_velocity_sample_,
+      joint_acceleration_sample_) && jog_stopping_;
+
+  // Position commands take over from the current reference
+  bool continue_traj = this->readCommands(rtt_now);
+  bool goal_pending = !goal_commands_.empty();
+
+  if(!continue_traj) {
+    jog_cmd_time_ = ros::Time(0,0);
+  }
+
+  if(stopped || !segments_.empty() || goal_pending)
+  {
+    if(verbose_) RTT::log(RTT::Debug) << "Switching from jogging to position control." <<RTT::endlog();
+
+    // Seed the position interface with the jogging reference
+    this->computeTrajectory(
+        rtt_now,
+        joint_position_sample_,
+        joint_velocity_sample_,
+        joint_acceleration_sample_,
+        ros::Duration(stop_time_),
+        joint_position_sample_ + joint_velocity_sample_*stop_time_,
+        joint_zero_,
+        rml_, rml_in_, rml_out_, rml_flags_);
+
+    last_segment_start_time_ = rtt_now;
+    traj_mode_ = FOLLOWING;
+  }
+}
+
 bool JointTrajGeneratorRML::insertSegments(
         const Eigen::VectorXd &point,
         const ros::Time &time,
@@ -802,8 +1628,14 @@ bool JointTrajGeneratorRML::insertSegments(
 
     segment.start_time = time;
     segment.goal_positions = point;
-    segments.clear();
-    segments.push_back(segment);
+
+    if(stream_points_) {
+      // Queue the point behind the current trajectory
+      AppendSegment(segments, segment, ros::Duration(sampling_resolution_), stream_queue_size_);
+    } else {
+      segments.clear();
+      segments.push_back(segment);
+    }
   } else {
     RTT::log(RTT::Debug) << "Received trajectory of invalid size." <<RTT::endlog();
     return false;
@@ -819,9 +1651,30 @@ bool JointTrajGeneratorRML::insertSegments(
     TrajSegments &segments,
     std::vector<size_t> &index_permutation) const
 {
-  // Clear the segments, since this starts immediately
-  segments.clear();
-  // Create a unary trajectory with zero as the desired start time (start immediately)
+  // Queue streamed points behind the current trajectory
+  if(stream_points_) {
+    if(traj_point.positions.size() != n_dof_) {
+      RTT::log(RTT::Debug) << "Received trajectory point of invalid size." <<RTT::endlog();
+      return false;
+    }
+
+    // Points carry no joint names, so they're given in the native order
+    TrajSegment segment(n_dof_,true);
+    segment.start_time = time;
+    segment.velocities_specified = (traj_point.velocities.size() > 0);
+    for(size_t j=0; j<n_dof_; j++) {
+      segment.goal_positions(j) = traj_point.positions[j];
+      if(j < traj_point.velocities.size()) segment.goal_velocities(j) = traj_point.velocities[j];
+      if(j < traj_point.accelerations.size()) segment.goal_accelerations(j) = traj_point.accelerations[j];
+    }
+
+    AppendSegment(segments, segment, ros::Duration(sampling_resolution_), stream_queue_size_);
+
+    return true;
+  }
+
+  // Create a unary trajectory with zero as the desired start time (start
+  // immediately), which replaces the current segments
   trajectory_msgs::JointTrajectory unary_joint_traj;
   unary_joint_traj.points.push_back(traj_point);
 
@@ -833,23 +1686,29 @@ bool JointTrajGeneratorRML::insertSegments(
     const ros::Time &time,
     TrajSegments &segments,
     std::vector<size_t> &index_permutation,
-    GoalHandle *gh,
-    size_t *gh_required) const
+    ActiveGoalPtr goal) const
 {
   // Check if the traj is empty
   if(trajectory.points.size() == 0) {
     if(verbose_) RTT::log(RTT::Debug) << "Received empty trajectory, stopping arm." <<RTT::endlog();
     return false;
   } else {
+    // Get the proper index permutation, and leave the current trajectory
+    // untouched if the joints can't be matched
+    if(!this->getIndexPermutation(trajectory.joint_names, index_permutation)) {
+      RTT::log(RTT::Error) << "Rejecting trajectory with invalid joint names." <<RTT::endlog();
+      return true;
+    }
+
     // Create a new list of segments to be spliced in
     TrajSegments new_segments;
     // By default, set the start time to now
     ros::Time new_traj_start_time = time;
 
-    // If the header stamp is non-zero, then determine which points we should pursue
-    if(trajectory.header.stamp.isZero()) {
-      segments.clear();
-    } else {
+    // A zero header stamp replaces the current segments, otherwise determine
+    // which points we should pursue
+    const bool replace = trajectory.header.stamp.isZero();
+    if(!replace) {
       // Offset the NTP-corrected time to get the RTT-time
       // Correct the timestamp so that its relative to the realtime clock
       // TODO: make it so this can be disabled or make two different ports
@@ -864,9 +1723,6 @@ bool JointTrajGeneratorRML::insertSegments(
       }
     }
 
-    // Get the proper index permutation
-    this->getIndexPermutation(trajectory.joint_names, index_permutation);
-
     // Convert the trajectory message to a list of segments for splicing
     TrajectoryMsgToSegments(
         trajectory,
@@ -874,10 +1730,58 @@ bool JointTrajGeneratorRML::insertSegments(
         n_dof_,
         new_traj_start_time,
         new_segments,
-        gh,
-        gh_required);
+        goal);
+
+    // Plan the new segments from the state where they'll be spliced in
+    if(parameterize_trajectories_) {
+      const Eigen::VectorXd *start_position = &joint_position_sample_;
+      const Eigen::VectorXd *start_velocity = &joint_velocity_sample_;
+
+      for(TrajSegments::const_iterator it = segments.begin();
+          !replace && it != segments.end() && it->start_time < new_traj_start_time;
+          ++it)
+      {
+        start_position = &it->goal_positions;
+        start_velocity = &it->goal_velocities;
+      }
+
+      // Hand the segments off to the planner, since solving them all could
+      // take longer than an update. They're spliced in once they're planned.
+      if(segment_planner_activity_->isRunning()) {
+        if(free_plans_.empty()) {
+          RTT::log(RTT::Error) << "Rejecting trajectory, too many trajectories are waiting to be planned." <<RTT::endlog();
+          return true;
+        }
+
+        SegmentPlan *plan = free_plans_.back();
+        plan->segments.swap(new_segments);
+        plan->start_position = *start_position;
+        plan->start_velocity = *start_velocity;
+        plan->request_time = time;
+        plan->replace = replace;
+
+        // There's room for every plan
+        plan_requests_.Push(plan);
+        free_plans_.pop_back();
+        segment_planner_activity_->trigger();
+
+        return true;
+      }
+
+      // Blend first so the planned times account for the waypoint velocities
+      if(blend_segments_) {
+        BlendSegments(*start_position, max_velocities_, max_accelerations_, new_segments);
+      }
+
+      if(!this->parameterizeSegments(*start_position, *start_velocity, new_segments)) {
+        RTT::log(RTT::Warning) << "Could not parameterize trajectory, it will be executed without planned times." <<RTT::endlog();
+      }
+    }
 
     // Update the trajectory
+    if(replace) {
+      segments.clear();
+    }
     SpliceTrajectory(segments, new_segments);
   }
 
@@ -897,6 +1801,7 @@ bool JointTrajGeneratorRML::startHook()
   joint_position_in_.clear();
   joint_velocity_in_.clear();
   joint_position_cmd_in_.clear();
+  joint_velocity_cmd_in_.clear();
   joint_traj_point_cmd_in_.clear();
   joint_traj_cmd_in_.clear();
 
@@ -906,6 +1811,25 @@ bool JointTrajGeneratorRML::startHook()
   // Always start in inactive state
   traj_mode_ = INACTIVE;
 
+  // Drop any goals received before the component was stopped
+  this->flushGoalCommands();
+
+  // Start talking to actionlib
+  action_relay_activity_->start();
+
+  // Drop any trajectories planned before the component was stopped
+  plan_requests_.clear();
+  planned_segments_.clear();
+  discarded_plans_ = 0;
+  free_plans_.clear();
+  for(std::vector<SegmentPlan>::iterator it = plan_slots_.begin(); it != plan_slots_.end(); ++it) {
+    it->segments.clear();
+    free_plans_.push_back(&(*it));
+  }
+
+  // Start planning segment times
+  segment_planner_activity_->start();
+
   return true;
 }
 
@@ -983,62 +1907,8 @@ void JointTrajGeneratorRML::updateHook()
       // Read the command inputs
       bool continue_traj = this->readCommands(rtt_now);
 
-      // Handle actionlib goal
-      if(current_gh_.isValid())
-      {
-        switch(current_gh_.getGoalStatus().status) {
-          case actionlib_msgs::GoalStatus::PENDING:
-            {
-              // Update the trajectory
-              RTT::log(RTT::Debug) << "New trajectory action goal." <<RTT::endlog();
-
-              // Reset the segment counter
-              gh_segments_required_ = 0;
-
-              // Insert the segments
-              continue_traj = this->insertSegments(
-                  current_gh_.getGoal()->trajectory,
-                  rtt_now,
-                  segments_,
-                  index_permutation_,
-                  &current_gh_, &gh_segments_required_);
-
-              // Accept the goal
-              current_gh_.setAccepted();
-              break;
-            }
-          case actionlib_msgs::GoalStatus::RECALLING:
-          case actionlib_msgs::GoalStatus::PREEMPTING:
-            {
-              RTT::log(RTT::Debug) << "Trajectory action goal has been preempted." <<RTT::endlog();
-              // Preempt the trajectory
-              current_gh_.setCanceled();
-              // Hold current position
-              continue_traj = false;
-              break;
-            }
-          case actionlib_msgs::GoalStatus::ACTIVE:
-            {
-              if(segments_.empty()) {
-                RTT::log(RTT::Debug) << "Trajectory action goal has failed." <<RTT::endlog();
-                current_gh_.setAborted();
-              }
-              break;
-            }
-          case actionlib_msgs::GoalStatus::PREEMPTED:
-          case actionlib_msgs::GoalStatus::SUCCEEDED:
-          case actionlib_msgs::GoalStatus::ABORTED:
-          case actionlib_msgs::GoalStatus::REJECTED:
-          case actionlib_msgs::GoalStatus::RECALLED:
-            // replace the current goalhandle with an invalid one
-            // NO! if we do this, we won't send any samples afterwards
-            current_gh_ = GoalHandle();
-            break;
-          default:
-            RTT::log(RTT::Warning) << "Trajectory action goal is in a bad state." <<RTT::endlog();
-            break;
-        };
-      }
+      // Handle actionlib goals and cancelations
+      continue_traj = this->readGoalCommands(rtt_now) && continue_traj;
 
       // Check if the trajectory should be continued
       if(!continue_traj) {
@@ -1048,6 +1918,18 @@ void JointTrajGeneratorRML::updateHook()
     }
   }
 
+  // Velocity commands preempt the position interface once it's running
+  if(traj_mode_ == FOLLOWING || traj_mode_ == JOGGING)
+  {
+    try {
+      this->readVelocityCommands(rtt_now);
+    } catch (std::runtime_error &err) {
+      RMLLog(RTT::Error, rml_vel_in_);
+      this->handleSampleError(err);
+      return;
+    }
+  }
+
   // Switch behavior based on the current mode
   switch(traj_mode_)
   {
@@ -1195,6 +2077,20 @@ void JointTrajGeneratorRML::updateHook()
           traj_mode_ = FOLLOWING;
         }
 
+        break;
+      }
+
+    case JOGGING:
+      // Sample the velocity trajectory without tolerance checking
+      {
+        try {
+          this->updateJogging(rtt_now);
+        } catch (std::runtime_error &err) {
+          RMLLog(RTT::Error, rml_vel_in_);
+          this->handleSampleError(err);
+          return;
+        }
+
         break;
       }
   };
@@ -1213,37 +2109,35 @@ void JointTrajGeneratorRML::updateHook()
   {
     // Publish controller desired state
     joint_state_desired_.header.stamp = rtt_rosclock::host_now();
-    joint_state_desired_.position.resize(n_dof_);
-    joint_state_desired_.velocity.resize(n_dof_);
     std::copy(joint_position_sample_.data(), joint_position_sample_.data() + n_dof_, joint_state_desired_.position.begin());
     std::copy(joint_velocity_sample_.data(), joint_velocity_sample_.data() + n_dof_, joint_state_desired_.velocity.begin());
     joint_state_desired_out_.write(joint_state_desired_);
 
     // Publish action feedback
-    if(current_gh_.isValid() && current_gh_.getGoalStatus().status == actionlib_msgs::GoalStatus::ACTIVE) {
-      feedback_.header = joint_state_desired_.header;
-
-      feedback_.joint_names = joint_names_;
-
-      feedback_.desired.positions.resize(n_dof_);
-      feedback_.desired.velocities.resize(n_dof_);
-      feedback_.actual.positions.resize(n_dof_);
-      feedback_.actual.velocities.resize(n_dof_);
-      feedback_.error.positions.resize(n_dof_);
-      feedback_.error.velocities.resize(n_dof_);
+    if(current_goal_ && current_goal_->active) {
+      // The feedback message was sized when the goal was accepted
+      Feedback &feedback = feedback_.feedback;
+      feedback.header = joint_state_desired_.header;
 
-      std::copy(joint_position_sample_.data(), joint_position_sample_.data() + n_dof_, feedback_.desired.positions.begin());
-      std::copy(joint_velocity_sample_.data(), joint_velocity_sample_.data() + n_dof_, feedback_.desired.velocities.begin());
+      std::copy(joint_position_sample_.data(), joint_position_sample_.data() + n_dof_, feedback.desired.positions.begin());
+      std::copy(joint_velocity_sample_.data(), joint_velocity_sample_.data() + n_dof_, feedback.desired.velocities.begin());
 
-      std::copy(joint_position_.data(), joint_position_.data() + n_dof_, feedback_.actual.positions.begin());
-      std::copy(joint_velocity_.data(), joint_velocity_.data() + n_dof_, feedback_.actual.velocities.begin());
+      std::copy(joint_position_.data(), joint_position_.data() + n_dof_, feedback.actual.positions.begin());
+      std::copy(joint_velocity_.data(), joint_velocity_.data() + n_dof_, feedback.actual.velocities.begin());
 
-      std::copy(joint_position_err_.data(), joint_position_err_.data() + n_dof_, feedback_.error.positions.begin());
-      std::copy(joint_velocity_err_.data(), joint_velocity_err_.data() + n_dof_, feedback_.error.velocities.begin());
+      std::copy(joint_position_err_.data(), joint_position_err_.data() + n_dof_, feedback.error.positions.begin());
+      std::copy(joint_velocity_err_.data(), joint_velocity_err_.data() + n_dof_, feedback.error.velocities.begin());
 
-      current_gh_.publishFeedback(feedback_);
+      // Hand off to the relay so a slow client can't stall this loop
+      feedback_buffer_.Set(feedback_);
+      action_relay_activity_->trigger();
     }
   }
+
+  // Let the relay perform any goal state transitions
+  if(!goal_events_.empty()) {
+    action_relay_activity_->trigger();
+  }
 }
 
 void JointTrajGeneratorRML::stopHook()
@@ -1254,6 +2148,92 @@ void JointTrajGeneratorRML::stopHook()
   joint_velocity_in_.clear();
   // Clear segments / abort goal
   segments_.clear();
+
+  // Stop planning segment times, a goal whose trajectory is still being
+  // planned won't get it
+  segment_planner_activity_->stop();
+  this->cancelPreemptedGoal();
+  if(current_goal_ && current_goal_->active) {
+    current_goal_->post(GOAL_ABORTED);
+  }
+
+  // Flush any goal state transitions after the relay has stopped
+  action_relay_activity_->stop();
+  action_relay_.step();
+
+  // Goals which haven't been handled yet won't be
+  this->flushGoalCommands();
+}
+
+void JointTrajGeneratorRML::flushGoalCommands()
+{
+  GoalCommand command;
+
+  while(goal_commands_.Pop(command))
+  {
+    // Nothing else will answer these, and the relay isn't running
+    if(command.type == NEW_GOAL && command.goal->gh.isValid()) {
+      RTT::log(RTT::Warning) << "Rejecting action goal which was received before the component stopped." << RTT::endlog();
+      command.goal->gh.setRejected();
+    }
+  }
+}
+
+void JointTrajGeneratorRML::prepareFeedback()
+{
+  // These only allocate if the goal's joint count differs from the last one
+  Feedback &feedback = feedback_.feedback;
+  feedback.joint_names = joint_names_;
+  feedback.desired.positions.resize(n_dof_);
+  feedback.desired.velocities.resize(n_dof_);
+  feedback.actual.positions.resize(n_dof_);
+  feedback.actual.velocities.resize(n_dof_);
+  feedback.error.positions.resize(n_dof_);
+  feedback.error.velocities.resize(n_dof_);
+
+  feedback_.goal = current_goal_;
+}
+
+void JointTrajGeneratorRML::ActionRelay::step()
+{
+  // Perform the requested goal state transitions in order
+  while(events_.Pop(event_)) {
+    GoalHandle &gh = event_.goal->gh;
+
+    switch(event_.type) {
+      case GOAL_ACCEPTED:
+        gh.setAccepted();
+        break;
+      case GOAL_REJECTED:
+        gh.setRejected();
+        break;
+      case GOAL_SUCCEEDED:
+        gh.setSucceeded();
+        break;
+      case GOAL_ABORTED:
+        gh.setAborted();
+        break;
+      case GOAL_CANCELED:
+        gh.setCanceled();
+        break;
+    };
+
+    // Release the goal handle here once it's done, so that actionlib never
+    // has to clean it up from the realtime loop
+    if(event_.type != GOAL_ACCEPTED) {
+      event_.goal->gh = GoalHandle();
+      event_.goal->goal.reset();
+    }
+
+    event_ = GoalEvent();
+  }
+
+  // Publish the latest feedback
+  feedback_buffer_.Get(sample_);
+
+  if(sample_.goal && sample_.goal->gh.isValid() && sample_.goal->gh.getGoalStatus().status == actionlib_msgs::GoalStatus::ACTIVE) {
+    sample_.goal->gh.publishFeedback(sample_.feedback);
+  }
 }
 
 void JointTrajGeneratorRML::cleanupHook()
@@ -1264,6 +2244,7 @@ void JointTrajGeneratorRML::errorHook()
 {
   // Clear segments / abort goal
   segments_.clear();
+  action_relay_activity_->trigger();
 }
 
 
@@ -1300,24 +2281,52 @@ void JointTrajGeneratorRML::RMLLog(
   RTT::log(level) << " - AlternativeTargetVelocityVector: "<<*(rml_in->AlternativeTargetVelocityVector) << RTT::endlog();
 }
 
+void JointTrajGeneratorRML::RMLLog(
+    const RTT::LoggerLevel level,
+    const boost::shared_ptr<RMLVelocityInputParameters> rml_vel_in)
+{
+  RTT::log(level) << "RML VELOCITY INPUT: "<< RTT::endlog();
+  RTT::log(level) << " - NumberOfDOFs:               "<<rml_vel_in->NumberOfDOFs << RTT::endlog();
+  RTT::log(level) << " - MinimumSynchronizationTime: "<<rml_vel_in->MinimumSynchronizationTime << RTT::endlog();
+
+  RTT::log(level) << " - SelectionVector: "<<*(rml_vel_in->SelectionVector) << RTT::endlog();
+
+  RTT::log(level) << " - CurrentPositionVector:     "<<*(rml_vel_in->CurrentPositionVector) << RTT::endlog();
+  RTT::log(level) << " - CurrentVelocityVector:     "<<*(rml_vel_in->CurrentVelocityVector) << RTT::endlog();
+  RTT::log(level) << " - CurrentAccelerationVector: "<<*(rml_vel_in->CurrentAccelerationVector) << RTT::endlog();
+
+  RTT::log(level) << " - MaxAccelerationVector: "<<*(rml_vel_in->MaxAccelerationVector) << RTT::endlog();
+  RTT::log(level) << " - MaxJerkVector:         "<<*(rml_vel_in->MaxJerkVector) << RTT::endlog();
+
+  RTT::log(level) << " - TargetVelocityVector:  "<<*(rml_vel_in->TargetVelocityVector) << RTT::endlog();
+}
+
 void JointTrajGeneratorRML::goalCallback(JointTrajGeneratorRML::GoalHandle gh)
 {
   RTT::log(RTT::Info) << "Recieved action goal." << RTT::endlog();
   if(this->getTaskState() != RTT::TaskContext::Running) {
     RTT::log(RTT::Error) << "Rejected action goal, component not running." << RTT::endlog();
-    current_gh_.setRejected();
+    gh.setRejected();
     return;
   }
 
-  // Always preempt the current goal and accept the new one
-  if(current_gh_.isValid() && current_gh_.getGoalStatus().status == actionlib_msgs::GoalStatus::ACTIVE) {
-    current_gh_.setCanceled();
+  // Hand the goal to the realtime loop, which preempts the current goal and
+  // accepts or rejects the new one
+  last_goal_.reset(new ActiveGoal(gh, &goal_events_));
+  if(!goal_commands_.Push(GoalCommand(NEW_GOAL, last_goal_))) {
+    RTT::log(RTT::Error) << "Rejected action goal, too many pending goal commands." << RTT::endlog();
+    gh.setRejected();
   }
-  current_gh_ = gh;
-  RTT::log(RTT::Debug) << "Action goal status is :" << (int)current_gh_.getGoalStatus().status << RTT::endlog();
 }
 
 void JointTrajGeneratorRML::cancelCallback(JointTrajGeneratorRML::GoalHandle gh)
 {
   RTT::log(RTT::Info) << "Recieved action preemption." << RTT::endlog();
+
+  // Older goals have already been preempted by the last one
+  if(last_goal_ && last_goal_->id == gh.getGoalID().id) {
+    if(!goal_commands_.Push(GoalCommand(CANCEL_GOAL, last_goal_))) {
+      RTT::log(RTT::Error) << "Could not cancel action goal, too many pending goal commands." << RTT::endlog();
+    }
+  }
 }
@@ -4,9 +4,15 @@
 #include <iostream>
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <rtt/RTT.hpp>
 #include <rtt/Port.hpp>
+#include <rtt/Activity.hpp>
+#include <rtt/base/RunnableInterface.hpp>
+#include <rtt/base/DataObjectLockFree.hpp>
+#include <rtt/base/BufferLockFree.hpp>
 
 #include <kdl/jntarrayvel.hpp>
 #include <kdl/tree.hpp>
@@ -39,6 +45,67 @@ namespace lcsr_controllers {
     ACTION_DEFINITION(control_msgs::FollowJointTrajectoryAction);
     typedef actionlib::ServerGoalHandle<control_msgs::FollowJointTrajectoryAction> GoalHandle;
 
+    //! Actionlib state transitions requested by the realtime loop
+    typedef enum {
+      GOAL_ACCEPTED = 0,
+      GOAL_REJECTED = 1,
+      GOAL_SUCCEEDED = 2,
+      GOAL_ABORTED = 3,
+      GOAL_CANCELED = 4
+    } GoalEventType;
+
+    struct ActiveGoal;
+    typedef boost::shared_ptr<ActiveGoal> ActiveGoalPtr;
+
+    //! A state transition for a given goal
+    struct GoalEvent {
+      GoalEvent() : type(GOAL_ACCEPTED) { }
+      GoalEvent(const GoalEventType type_, const ActiveGoalPtr &goal_) : type(type_), goal(goal_) { }
+      GoalEventType type;
+      ActiveGoalPtr goal;
+    };
+
+    typedef RTT::base::BufferLockFree<GoalEvent> GoalEvents;
+
+    /** \brief An action goal shared between the realtime loop and the action relay
+     *
+     * The goal handle is only used by the action relay (and by the action
+     * server callbacks which create it), since actionlib locks the server
+     * whenever it's inspected or changed. The realtime loop only reads the
+     * goal message and tracks the goal's progress, and requests state
+     * transitions through post().
+     */
+    struct ActiveGoal : public boost::enable_shared_from_this<ActiveGoal>
+    {
+      ActiveGoal(GoalHandle gh_, GoalEvents *events_) :
+        gh(gh_),
+        id(gh_.getGoalID().id),
+        goal(gh_.getGoal()),
+        active(false),
+        segments_required(0),
+        events(events_)
+      { }
+
+      GoalHandle gh;
+      std::string id;
+      GoalConstPtr goal;
+
+      // Realtime state
+      bool active;
+      size_t segments_required;
+
+      //! Queue a state transition for the action relay
+      void post(const GoalEventType type) {
+        active = (type == GOAL_ACCEPTED);
+        if(!events->Push(GoalEvent(type, shared_from_this()))) {
+          RTT::log(RTT::Error) << "Action goal event queue is full, dropping event." << RTT::endlog();
+        }
+      }
+
+    private:
+      GoalEvents *events;
+    };
+
     // RTT Properties
     bool use_rosparam_;
     bool use_rostopic_;
@@ -59,11 +126,17 @@ namespace lcsr_controllers {
     bool verbose_;
     bool stop_on_violation_;
     double stop_time_;
+    bool stream_points_;
+    unsigned int stream_queue_size_;
+    double jog_timeout_;
+    bool blend_segments_;
+    bool parameterize_trajectories_;
 
     typedef enum {
       INACTIVE = 0,
       FOLLOWING = 1,
-      RECOVERING = 2
+      RECOVERING = 2,
+      JOGGING = 3
     } Mode;
 
     Mode traj_mode_;
@@ -73,6 +146,7 @@ namespace lcsr_controllers {
     RTT::InputPort<Eigen::VectorXd> joint_position_in_;
     RTT::InputPort<Eigen::VectorXd> joint_velocity_in_;
     RTT::InputPort<Eigen::VectorXd> joint_position_cmd_in_;
+    RTT::InputPort<Eigen::VectorXd> joint_velocity_cmd_in_;
 
     RTT::OutputPort<Eigen::VectorXd> joint_position_out_;
     RTT::OutputPort<Eigen::VectorXd> joint_velocity_out_;
@@ -109,31 +183,31 @@ namespace lcsr_controllers {
         active(false),
         achieved(false),
         flexible(flexible_),
+        velocities_specified(false),
         start_time(ros::Time(0,0)),
         goal_time(ros::Time(0,0)), 
         expected_time(ros::Time(0,0)), 
         goal_positions(Eigen::VectorXd::Constant(n_dof,0.0)),
         goal_velocities(Eigen::VectorXd::Constant(n_dof,0.0)),
         goal_accelerations(Eigen::VectorXd::Constant(n_dof,0.0)),
-        gh(NULL),
-        gh_required(NULL)
+        goal()
       {
         id = segment_count++;
       }
 
 
       ~TrajSegment() {
-        // If the goal handle is valid, check if the goal should succeed or abort
-        if(queued && gh && gh->isValid() && gh->getGoalStatus().status == actionlib_msgs::GoalStatus::ACTIVE) {
+        // If the goal is still active, check if the goal should succeed or abort
+        if(queued && goal && goal->active) {
           if(achieved) {
-            *gh_required -= 1;
-            if(*gh_required == 0) {
+            goal->segments_required -= 1;
+            if(goal->segments_required == 0) {
               RTT::log(RTT::Debug) << "All goal trajectory segments have been acheived. Setting goal succeeded." << RTT::endlog();
-              gh->setSucceeded();
+              goal->post(GOAL_SUCCEEDED);
             }
           } else {
             RTT::log(RTT::Debug) << "Trajectory segment ("<<id<<") removed without being achieved. Aborting goal." << RTT::endlog();
-            gh->setAborted();
+            goal->post(GOAL_ABORTED);
           }
         }
       }
@@ -143,6 +217,7 @@ namespace lcsr_controllers {
       bool active;
       bool achieved;
       bool flexible;
+      bool velocities_specified;
       ros::Time start_time;
       ros::Time goal_time;
       ros::Time expected_time;
@@ -150,9 +225,8 @@ namespace lcsr_controllers {
       Eigen::VectorXd goal_velocities;
       Eigen::VectorXd goal_accelerations;
 
-      // Associated goal handle
-      GoalHandle *gh;
-      size_t *gh_required;
+      // Associated action goal
+      ActiveGoalPtr goal;
 
       //! End-Time comparison function for binary search
       static bool StartTimeCompare(const TrajSegment &s1, const TrajSegment &s2) { 
@@ -180,14 +254,92 @@ namespace lcsr_controllers {
         const size_t n_dof,
         const ros::Time trajectory_start_time,
         TrajSegments &segments,
-        GoalHandle *gh = NULL,
-        size_t *gh_required = NULL);
+        ActiveGoalPtr goal = ActiveGoalPtr());
 
     //! Update the one trajectory with points from another
     static bool SpliceTrajectory(
         TrajSegments &current_segments,
         const TrajSegments &new_segments);
 
+    /** \brief Append a flexible point to the end of a trajectory
+     *
+     * This is used for streaming commands. If the last segment hasn't been
+     * activated yet and it was received less than coalesce_period before the
+     * new one (or max_segments segments are already queued behind the active
+     * one), its goal is replaced by the new one instead of growing the queue.
+     * If the queue is full and the last segment can't be replaced, the new
+     * point is dropped, so the queue never grows past max_segments. A
+     * max_segments of zero is the same as one.
+     *
+     * Returns: true if the segment was appended, false if it was coalesced
+     * or dropped
+     */
+    static bool AppendSegment(
+        TrajSegments &segments,
+        const TrajSegment &new_segment,
+        const ros::Duration coalesce_period,
+        const size_t max_segments);
+
+    /** \brief Assign pass-through velocities to consecutive flexible segments
+     *
+     * Each flexible segment which is followed by another flexible segment and
+     * whose goal velocities weren't given explicitly is assigned a goal
+     * velocity, so that it's passed through instead of stopped at. Joints
+     * which reverse direction at a waypoint stop there. Speeds are bounded by
+     * max_velocities and by the distance needed to accelerate from the
+     * previous waypoint and decelerate to the next one with max_accelerations,
+     * so the path still stops at its last flexible waypoint. The active
+     * segment is left as-is, since it has already been planned.
+     */
+    static void BlendSegments(
+        const Eigen::VectorXd &start_position,
+        const Eigen::VectorXd &max_velocities,
+        const Eigen::VectorXd &max_accelerations,
+        TrajSegments &segments);
+
+    /** \brief Assign feasible times to a list of segments before they're spliced
+     *
+     * Starting from the given state, this solves each segment in turn with the
+     * scratch trajectory generator to find the minimum time needed to reach it
+     * subject to the velocity, acceleration, and jerk limits. Flexible
+     * segments are given that time as their planned goal time (they're still
+     * executed as fast as possible). Timed segments which can't be reached in
+     * time are stretched, and all the segments after them are delayed by the
+     * same amount.
+     *
+     * The segments are planned in a copy, which replaces them only once every
+     * segment has been solved.
+     *
+     * Returns: false if the trajectory generator failed, in which case the
+     * segments are left unchanged
+     */
+    bool parameterizeSegments(
+        const Eigen::VectorXd &start_position,
+        const Eigen::VectorXd &start_velocity,
+        TrajSegments &segments) const;
+
+    /** \brief Assign a feasible time to a single segment
+     *
+     * This solves the segment from the given state and start time, as
+     * parameterizeSegments() does for each segment. Timed segments are first
+     * delayed by delay, and delay is increased by however much they're
+     * stretched. The segment's goal velocities are marked as specified, so
+     * that blending doesn't change them afterwards.
+     *
+     * Throws: std::runtime_error if the trajectory generator fails
+     */
+    void planSegment(
+        const ros::Time start_time,
+        const Eigen::VectorXd &start_position,
+        const Eigen::VectorXd &start_velocity,
+        const Eigen::VectorXd &start_acceleration,
+        TrajSegment &segment,
+        ros::Duration &delay,
+        boost::shared_ptr<ReflexxesAPI> rml,
+        boost::shared_ptr<RMLPositionInputParameters> rml_in,
+        boost::shared_ptr<RMLPositionOutputParameters> rml_out,
+        RMLPositionFlags &rml_flags) const;
+
     //! Configure some RML structures from this tasks's properties
     bool configureRML(
         boost::shared_ptr<ReflexxesAPI> &rml,
@@ -195,6 +347,12 @@ namespace lcsr_controllers {
         boost::shared_ptr<RMLPositionOutputParameters> &rml_out,
         RMLPositionFlags &rml_flags) const;
 
+    //! Configure the RML velocity-interface structures from this tasks's properties
+    bool configureRML(
+        boost::shared_ptr<RMLVelocityInputParameters> &rml_vel_in,
+        boost::shared_ptr<RMLVelocityOutputParameters> &rml_vel_out,
+        RMLVelocityFlags &rml_vel_flags) const;
+
     /** \brief Update the segments and determine if the traj needs to be
      * recomputed.
      *
@@ -250,6 +408,34 @@ namespace lcsr_controllers {
         boost::shared_ptr<RMLPositionOutputParameters> rml_out,
         RMLPositionFlags &rml_flags) const;
 
+    /** \brief Compute a velocity-interface trajectory initialized by an arbitrary state
+     *
+     * The goal velocity is bounded by max_velocities_, since the RML velocity
+     * interface only limits accelerations and jerks.
+     */
+    void computeVelocityTrajectory(
+        const Eigen::VectorXd &init_position,
+        const Eigen::VectorXd &init_velocity,
+        const Eigen::VectorXd &init_acceleration,
+        const Eigen::VectorXd &goal_velocity,
+        boost::shared_ptr<ReflexxesAPI> rml,
+        boost::shared_ptr<RMLVelocityInputParameters> rml_vel_in,
+        boost::shared_ptr<RMLVelocityOutputParameters> rml_vel_out,
+        RMLVelocityFlags &rml_vel_flags) const;
+
+    /** \brief Sample the velocity-interface trajectory
+     *
+     * Returns: true if the goal velocity has been reached
+     */
+    bool sampleVelocityTrajectory(
+        const ros::Time rtt_now,
+        const ros::Time jog_start_time,
+        boost::shared_ptr<ReflexxesAPI> rml,
+        boost::shared_ptr<RMLVelocityOutputParameters> rml_vel_out,
+        Eigen::VectorXd &joint_position_sample,
+        Eigen::VectorXd &joint_velocity_sample,
+        Eigen::VectorXd &joint_acceleration_sample) const;
+
     /** \brief Sample the trajectory based on the current set of segments and robot state
      * This function does not change the state of the component, so it can be
      * used easily in testing or with lookaheads.
@@ -279,6 +465,11 @@ namespace lcsr_controllers {
         const RTT::LoggerLevel level,
         const boost::shared_ptr<RMLPositionInputParameters> rml_in);
 
+    //! Output information about some RML velocity input parameters
+    static void RMLLog(
+        const RTT::LoggerLevel level,
+        const boost::shared_ptr<RMLVelocityInputParameters> rml_vel_in);
+
     void setMaxVelocity(const int i, const double d) {
       rml_in_->SetMaxVelocityVectorElement(d,i);
     }
@@ -295,6 +486,39 @@ namespace lcsr_controllers {
     bool readCommands(
         const ros::Time &rtt_now);
 
+    /** \brief Splice any trajectories which the segment planner has finished into segments_
+     *
+     * Each planned trajectory is delayed by however long it waited to be
+     * planned (but no further than needed for it not to start in the past),
+     * and its first segment is re-planned from the state it's spliced onto,
+     * since the state it was planned from is out of date by now. If the
+     * first segment then takes longer, the rest of the trajectory is delayed
+     * by the same amount.
+     */
+    void readPlannedSegments(
+        const ros::Time &rtt_now);
+
+    //! Drop the trajectories which are still being planned once they're planned
+    void discardPendingPlans();
+
+    //! Number of trajectories handed to the segment planner which haven't been spliced
+    size_t getNumPendingPlans() const { return plan_slots_.size() - free_plans_.size(); }
+
+    //! Read the velocity command input port and (re)start jogging if there's a new command
+    bool readVelocityCommands(
+        const ros::Time &rtt_now);
+
+    /** \brief Sample the jogging reference
+     *
+     * This decelerates to a stop once no velocity command has arrived for
+     * jog_timeout_, and switches to position control once stopped or once
+     * position commands arrive.
+     *
+     * Throws: std::runtime_error if Reflexxes fails
+     */
+    void updateJogging(
+        const ros::Time &rtt_now);
+
     //! Update a trajectory from an Eigen::VectorXd
     bool insertSegments(
         const Eigen::VectorXd &point,
@@ -309,14 +533,19 @@ namespace lcsr_controllers {
         TrajSegments &segments,
         std::vector<size_t> &index_permutation) const;
 
-    //! Update a trajectory from a trajectory_msgs::JointTrajectory
+    /** \brief Update a trajectory from a trajectory_msgs::JointTrajectory
+     *
+     * If parameterize_trajectories_ is set while the segment planner is
+     * running, the new segments are handed off to it instead of being spliced
+     * into segments here, and the current segments are left running. Once
+     * they're planned, readPlannedSegments() splices them into segments_.
+     */
     bool insertSegments(
         const trajectory_msgs::JointTrajectory &trajectory,
         const ros::Time &time,
         TrajSegments &segments,
         std::vector<size_t> &index_permutation,
-        GoalHandle *gh = NULL,
-        size_t *gh_required = NULL) const;
+        ActiveGoalPtr goal = ActiveGoalPtr()) const;
 
     //! Get an identity permutation f(x) = x
     void getIdentityIndexPermutation(
@@ -328,47 +557,66 @@ namespace lcsr_controllers {
       }
     }
 
-    //! Get an index permutation based on the joint names
-    void getIndexPermutation(
+    /** \brief Get an index permutation based on the joint names
+     *
+     * The permutation for the most recently seen joint name ordering is
+     * cached, so streams of messages with the same ordering only pay for a
+     * single equality check.
+     *
+     * Returns: false if the joint names don't describe exactly the joints
+     * of this generator (unknown, duplicate, or missing joints), in which
+     * case the cache is left unchanged
+     */
+    bool getIndexPermutation(
         const std::vector<std::string> &joint_names,
-        std::vector<size_t> &index_permutation) const
-    {
-      index_permutation.resize(n_dof_);
-      // Check if joint names are given
-      if(joint_names.size() == n_dof_) {
-        // Permute the joint names properly
-        int joint_index=0;
-        for(std::vector<std::string>::const_iterator it = joint_names.begin();
-            it != joint_names.end();
-            ++it)
-        {
-          index_permutation[joint_index] = joint_name_index_map_.find(*it)->second;
-          joint_index++;
-        }
-      } else {
-        this->getIdentityIndexPermutation(index_permutation);
-      }
-    }
+        std::vector<size_t> &index_permutation) const;
 
     //! Trajectory Generator
     boost::shared_ptr<ReflexxesAPI> rml_;
     boost::shared_ptr<RMLPositionInputParameters> rml_in_;
     boost::shared_ptr<RMLPositionOutputParameters> rml_out_;
     RMLPositionFlags rml_flags_;
+    boost::shared_ptr<RMLVelocityInputParameters> rml_vel_in_;
+    boost::shared_ptr<RMLVelocityOutputParameters> rml_vel_out_;
+    RMLVelocityFlags rml_vel_flags_;
+
+    //! Scratch trajectory generator for planning segment times (owned by the segment planner while it's running)
+    boost::shared_ptr<ReflexxesAPI> rml_param_;
+    boost::shared_ptr<RMLPositionInputParameters> rml_param_in_;
+    boost::shared_ptr<RMLPositionOutputParameters> rml_param_out_;
+    RMLPositionFlags rml_param_flags_;
+
+    //! Scratch trajectory generator for re-planning spliced segments in the realtime loop
+    boost::shared_ptr<ReflexxesAPI> rml_splice_;
+    boost::shared_ptr<RMLPositionInputParameters> rml_splice_in_;
+    boost::shared_ptr<RMLPositionOutputParameters> rml_splice_out_;
+    RMLPositionFlags rml_splice_flags_;
+
     RMLDoubleVector rml_zero_;
     RMLBoolVector rml_true_;
     ros::Time last_segment_start_time_;
 
+    // Jogging state
+    ros::Time jog_start_time_;
+    ros::Time jog_cmd_time_;
+    bool jog_stopping_;
+
     // Robot model
     std::vector<std::string> joint_names_;
-    std::map<std::string,size_t> joint_name_index_map_;
+    boost::unordered_map<std::string,size_t> joint_name_index_map_;
     std::vector<size_t> index_permutation_;
 
+    // Joint name permutation cache
+    mutable std::vector<std::string> cached_joint_names_;
+    mutable std::vector<size_t> cached_index_permutation_;
+    mutable std::vector<bool> joint_index_assigned_;
+
     // State
     Eigen::VectorXd
       joint_zero_,
       joint_position_,
       joint_position_cmd_,
+      joint_velocity_cmd_,
       joint_position_sample_,
       joint_position_err_,
       joint_velocity_,
@@ -389,14 +637,142 @@ namespace lcsr_controllers {
     // Conman interface
     boost::shared_ptr<conman::Hook> conman_hook_;
 
+  protected:
+
+    //! Requests from the action server callbacks to the realtime loop
+    typedef enum {
+      NEW_GOAL = 0,
+      CANCEL_GOAL = 1
+    } GoalCommandType;
+
+    struct GoalCommand {
+      GoalCommand() : type(NEW_GOAL) { }
+      GoalCommand(const GoalCommandType type_, const ActiveGoalPtr &goal_) : type(type_), goal(goal_) { }
+      GoalCommandType type;
+      ActiveGoalPtr goal;
+    };
+
+    //! Goal being executed by the realtime loop
+    ActiveGoalPtr current_goal_;
+    //! Last goal received by the action server callbacks
+    ActiveGoalPtr last_goal_;
+
+    //! Goal commands to the realtime loop
+    RTT::base::BufferLockFree<GoalCommand> goal_commands_;
+    //! Goal state transitions to the action relay
+    GoalEvents goal_events_;
+
+    //! Handle new goals and cancelations in the realtime loop
+    bool readGoalCommands(const ros::Time &rtt_now);
+
+    //! Reject the goals still in the goal command queue and empty it
+    void flushGoalCommands();
+
   private:
 
-    //! Current action goal
-    GoalHandle current_gh_;
-    size_t gh_segments_required_;
+    //! Action feedback message and the goal it belongs to
+    struct FeedbackSample {
+      ActiveGoalPtr goal;
+      Feedback feedback;
+    };
+
+    /** \brief Talks to actionlib outside of the realtime loop
+     *
+     * This performs the goal state transitions requested by the realtime loop,
+     * in order, and then publishes the latest feedback.
+     */
+    class ActionRelay : public RTT::base::RunnableInterface {
+    public:
+      ActionRelay(
+          GoalEvents &events,
+          RTT::base::DataObjectLockFree<FeedbackSample> &feedback_buffer) :
+        events_(events),
+        feedback_buffer_(feedback_buffer)
+      { }
+      virtual bool initialize() { return true; }
+      virtual void step();
+      virtual void finalize() { }
+    private:
+      GoalEvents &events_;
+      RTT::base::DataObjectLockFree<FeedbackSample> &feedback_buffer_;
+      GoalEvent event_;
+      FeedbackSample sample_;
+    };
+
+    //! Action feedback, preallocated when the goal is accepted
+    FeedbackSample feedback_;
+    //! Latest feedback handed off to the relay
+    RTT::base::DataObjectLockFree<FeedbackSample> feedback_buffer_;
+    ActionRelay action_relay_;
+    boost::scoped_ptr<RTT::Activity> action_relay_activity_;
+
+    //! Size the feedback message for the current goal
+    void prepareFeedback();
+
+    //! New segments to be planned, or planned segments to be spliced
+    struct SegmentPlan {
+      SegmentPlan() : replace(false) { }
+      TrajSegments segments;
+      //! The state the segments are planned from
+      Eigen::VectorXd start_position;
+      Eigen::VectorXd start_velocity;
+      //! When the segments were handed off to the planner
+      ros::Time request_time;
+      //! Clear the current segments before splicing, since these start immediately
+      bool replace;
+    };
+
+    /** \brief Plans passed between the realtime loop and the segment planner
+     *
+     * Only pointers into plan_slots_ are passed, so neither side copies the
+     * segments, and the realtime loop never allocates a plan.
+     */
+    typedef RTT::base::BufferLockFree<SegmentPlan*> SegmentPlans;
+
+    /** \brief Plans segment times outside of the realtime loop
+     *
+     * This blends and parameterizes each requested trajectory in turn with
+     * the scratch trajectory generator, and hands the planned segments back
+     * to the realtime loop.
+     */
+    class SegmentPlanner : public RTT::base::RunnableInterface {
+    public:
+      SegmentPlanner(
+          const JointTrajGeneratorRML &owner,
+          SegmentPlans &requests,
+          SegmentPlans &plans) :
+        owner_(owner),
+        requests_(requests),
+        plans_(plans)
+      { }
+      virtual bool initialize() { return true; }
+      virtual void step();
+      virtual void finalize() { }
+    private:
+      const JointTrajGeneratorRML &owner_;
+      SegmentPlans &requests_;
+      SegmentPlans &plans_;
+    };
+
+    //! Preallocated plans, at most this many trajectories can be waiting to be planned
+    std::vector<SegmentPlan> plan_slots_;
+    //! Plans which aren't in use (only used by the realtime loop)
+    mutable std::vector<SegmentPlan*> free_plans_;
+    //! Trajectories waiting to be planned (queued by the const insertSegments)
+    mutable SegmentPlans plan_requests_;
+    //! Planned trajectories waiting to be spliced
+    SegmentPlans planned_segments_;
+    //! Number of planned trajectories to drop instead of splicing, see discardPendingPlans()
+    size_t discarded_plans_;
+    SegmentPlanner segment_planner_;
+    boost::scoped_ptr<RTT::Activity> segment_planner_activity_;
+
+    //! Goal which keeps running until the current goal's trajectory has been planned
+    ActiveGoalPtr preempted_goal_;
+
+    //! Cancel the preempted goal, if there is one
+    void cancelPreemptedGoal();
 
-    //! Action feedback message
-    Feedback feedback_;
     //! Action result message
     Result result_;
 
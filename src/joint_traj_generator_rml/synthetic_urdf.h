@@ -0,0 +1,38 @@
+#ifndef __LCSR_CONTROLLERS_SYNTHETIC_URDF_H
+#define __LCSR_CONTROLLERS_SYNTHETIC_URDF_H
+
+#include <cmath>
+#include <string>
+#include <sstream>
+
+/******************************************************************************
+ * A synthetic robot, shared by the trajectory generator tests and benchmarks
+ ******************************************************************************/
+
+namespace lcsr_controllers {
+
+  //! Create a serial chain of revolute joints named joint_0 ... joint_{n-1},
+  //! between links named link_0 ... link_n
+  inline std::string SyntheticURDF(const size_t n_dof)
+  {
+    std::ostringstream urdf;
+    urdf << "<?xml version=\"1.0\"?>" << std::endl;
+    urdf << "<robot name=\"synthetic_" << n_dof << "\">" << std::endl;
+    for(size_t j=0; j<=n_dof; j++) {
+      urdf << "  <link name=\"link_" << j << "\"/>" << std::endl;
+    }
+    for(size_t j=0; j<n_dof; j++) {
+      urdf << "  <joint name=\"joint_" << j << "\" type=\"revolute\">" << std::endl;
+      urdf << "    <parent link=\"link_" << j << "\"/>" << std::endl;
+      urdf << "    <child link=\"link_" << j+1 << "\"/>" << std::endl;
+      urdf << "    <origin xyz=\"0 0 0.1\" rpy=\"0 " << ((j % 2) ? -M_PI/2 : M_PI/2) << " 0\"/>" << std::endl;
+      urdf << "    <axis xyz=\"0 0 1\"/>" << std::endl;
+      urdf << "    <limit lower=\"-3.0\" upper=\"3.0\" effort=\"10.0\" velocity=\"2.5\"/>" << std::endl;
+      urdf << "  </joint>" << std::endl;
+    }
+    urdf << "</robot>" << std::endl;
+    return urdf.str();
+  }
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_SYNTHETIC_URDF_H
@@ -2,6 +2,10 @@
 #include <string>
 #include <vector>
 #include <iterator>
+#include <sstream>
+#include <cmath>
+
+#include <unistd.h>
 
 #include <rtt/os/startstop.h>
 
@@ -24,6 +28,7 @@ using namespace boost::assign;
 using ::testing::ElementsAre;
 
 #include "joint_traj_generator_rml.h"
+#include "synthetic_urdf.h"
 using namespace lcsr_controllers;
 
 #include <ros/ros.h>
@@ -176,6 +181,159 @@ TEST_F(StaticTest, SpliceInterruptingTrajectory)
   EXPECT_EQ(segments_current.size(),1.5*n_base_traj_points); 
 }
 
+TEST_F(StaticTest, AppendStreamedSegments) 
+{
+  JointTrajGeneratorRML::TrajSegments segments;
+  const ros::Duration period(0.001);
+
+  JointTrajGeneratorRML::TrajSegment segment(n_dof, true);
+  segment.start_time = now;
+  segment.goal_positions.setConstant(1.0);
+
+  // The first point is always appended
+  EXPECT_TRUE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 10));
+  ASSERT_EQ(segments.size(),1);
+  EXPECT_TRUE(segments.back().queued);
+
+  // A point within the same period replaces the last one
+  segment.start_time = now + ros::Duration(0.0005);
+  segment.goal_positions.setConstant(2.0);
+  EXPECT_FALSE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 10));
+  ASSERT_EQ(segments.size(),1);
+  EXPECT_EQ(segments.back().goal_positions[0], 2.0);
+  EXPECT_EQ(segments.back().start_time, now);
+
+  // A point in the next period is appended
+  segment.start_time = now + ros::Duration(0.0015);
+  segment.goal_positions.setConstant(3.0);
+  EXPECT_TRUE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 10));
+  ASSERT_EQ(segments.size(),2);
+
+  // The active segment doesn't count against the queue size
+  segments.front().active = true;
+  segment.start_time = now + ros::Duration(0.0016);
+  segment.goal_positions.setConstant(4.0);
+  EXPECT_TRUE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 2));
+  ASSERT_EQ(segments.size(),3);
+  EXPECT_EQ(segments.front().goal_positions[0], 2.0);
+
+  // A full queue replaces the last point
+  segment.start_time = now + ros::Duration(1.0);
+  segment.goal_positions.setConstant(5.0);
+  EXPECT_FALSE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 2));
+  ASSERT_EQ(segments.size(),3);
+  EXPECT_EQ(segments.back().goal_positions[0], 5.0);
+
+  // Active segments are never replaced, even with a queue size of zero
+  segments.pop_back();
+  segments.pop_back();
+  segment.start_time = now + ros::Duration(2.0);
+  segment.goal_positions.setConstant(6.0);
+  EXPECT_TRUE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 0));
+  ASSERT_EQ(segments.size(),2);
+  EXPECT_EQ(segments.front().goal_positions[0], 2.0);
+
+  // A queue size of zero always replaces the last queued point
+  segment.start_time = now + ros::Duration(3.0);
+  segment.goal_positions.setConstant(7.0);
+  EXPECT_FALSE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 0));
+  ASSERT_EQ(segments.size(),2);
+  EXPECT_EQ(segments.back().goal_positions[0], 7.0);
+
+  // A full queue which ends in a timed point drops new points
+  segments.back().flexible = false;
+  segment.start_time = now + ros::Duration(4.0);
+  segment.goal_positions.setConstant(8.0);
+  EXPECT_FALSE(JointTrajGeneratorRML::AppendSegment(segments, segment, period, 1));
+  ASSERT_EQ(segments.size(),2);
+  EXPECT_EQ(segments.back().goal_positions[0], 7.0);
+}
+
+TEST_F(StaticTest, BlendSegments) 
+{
+  JointTrajGeneratorRML::TrajSegments segments;
+  const Eigen::VectorXd start_position = Eigen::VectorXd::Zero(n_dof);
+  const Eigen::VectorXd max_velocities = Eigen::VectorXd::Constant(n_dof, 1.0);
+  const Eigen::VectorXd max_accelerations = Eigen::VectorXd::Constant(n_dof, 2.0);
+
+  // Joint 0 moves monotonically, joint 1 reverses at each waypoint
+  for(int i=0; i<3; i++) {
+    JointTrajGeneratorRML::TrajSegment segment(n_dof, true);
+    segment.goal_positions[0] = i + 1.0;
+    segment.goal_positions[1] = (i % 2) ? 0.0 : 1.0;
+    segments.push_back(segment);
+  }
+
+  JointTrajGeneratorRML::BlendSegments(start_position, max_velocities, max_accelerations, segments);
+
+  std::vector<double> joint_0_velocities, joint_1_velocities;
+  for(JointTrajGeneratorRML::TrajSegments::iterator it = segments.begin(); it != segments.end(); ++it) {
+    joint_0_velocities.push_back(it->goal_velocities[0]);
+    joint_1_velocities.push_back(it->goal_velocities[1]);
+    // Joints which don't move are never given a velocity
+    EXPECT_EQ(it->goal_velocities.tail(n_dof-2).norm(), 0.0);
+  }
+
+  // Interior waypoints are passed through at the velocity limit, and the last one is a stop
+  EXPECT_THAT(joint_0_velocities, ElementsAre(1.0, 1.0, 0.0));
+  EXPECT_THAT(joint_1_velocities, ElementsAre(0.0, 0.0, 0.0));
+
+  // Explicit velocities are kept
+  segments.front().velocities_specified = true;
+  segments.front().goal_velocities.setConstant(0.5);
+  JointTrajGeneratorRML::BlendSegments(start_position, max_velocities, max_accelerations, segments);
+  EXPECT_EQ(segments.front().goal_velocities[0], 0.5);
+}
+
+//! Exposes the joint name permutation of a generator with the given joints
+class PermutationTraj : public JointTrajGeneratorRML
+{
+public:
+  PermutationTraj(const std::vector<std::string> &joint_names) :
+    JointTrajGeneratorRML("test_traj_rml_permutation")
+  {
+    n_dof_ = joint_names.size();
+    joint_names_ = joint_names;
+    for(size_t j=0; j<n_dof_; j++) {
+      joint_name_index_map_[joint_names[j]] = j;
+    }
+    cached_index_permutation_.resize(n_dof_);
+    joint_index_assigned_.assign(n_dof_,false);
+  }
+
+  using JointTrajGeneratorRML::getIndexPermutation;
+};
+
+TEST(PermutationTest, RejectedOrderingKeepsCache)
+{
+  RecordProperty("description",
+                 "This tests that an invalid joint ordering, which fails "
+                 "partway through, doesn't corrupt the cached permutation of "
+                 "the last valid ordering.");
+
+  std::vector<std::string> joint_names, good_names, unknown_names, duplicate_names;
+  joint_names += "a", "b", "c";
+  good_names += "c", "a", "b";
+  unknown_names += "b", "a", "x";
+  duplicate_names += "b", "c", "b";
+
+  PermutationTraj task(joint_names);
+  std::vector<size_t> index_permutation(joint_names.size());
+
+  ASSERT_TRUE(task.getIndexPermutation(good_names, index_permutation));
+  EXPECT_THAT(index_permutation, ElementsAre(2,0,1));
+
+  EXPECT_FALSE(task.getIndexPermutation(unknown_names, index_permutation));
+
+  ASSERT_TRUE(task.getIndexPermutation(good_names, index_permutation));
+  EXPECT_THAT(index_permutation, ElementsAre(2,0,1));
+
+  EXPECT_FALSE(task.getIndexPermutation(duplicate_names, index_permutation));
+
+  ASSERT_TRUE(task.getIndexPermutation(good_names, index_permutation));
+  EXPECT_THAT(index_permutation, ElementsAre(2,0,1));
+}
+
 class InstanceTest : public StaticTest 
 {
 public:
@@ -632,6 +790,660 @@ TEST_F(InstanceTest, FlexibleTraj)
   EXPECT_EQ(segments.size(),1);
 }
 
+//! A generator configured for a synthetic chain, with the jogging internals exposed
+class JogTraj : public JointTrajGeneratorRML
+{
+public:
+  JogTraj(const size_t n_dof) :
+    JointTrajGeneratorRML("test_traj_rml_jog")
+  {
+    use_rosparam_ = false;
+    use_rostopic_ = false;
+    robot_description_ = SyntheticURDF(n_dof);
+    std::ostringstream tip_link;
+    tip_link << "link_" << n_dof;
+    root_link_ = "link_0";
+    tip_link_ = tip_link.str();
+
+    sampling_resolution_ = 0.001;
+    goal_position_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E-3);
+    goal_velocity_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E-3);
+    position_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E3);
+    velocity_tolerance_ = Eigen::VectorXd::Constant(n_dof,1E3);
+    max_velocities_ = Eigen::VectorXd::Constant(n_dof,2.5);
+    max_accelerations_ = Eigen::VectorXd::Constant(n_dof,5.0);
+    max_jerks_ = Eigen::VectorXd::Constant(n_dof,20.0);
+  }
+
+  using JointTrajGeneratorRML::readVelocityCommands;
+  using JointTrajGeneratorRML::updateJogging;
+  using JointTrajGeneratorRML::joint_velocity_cmd_in_;
+  using JointTrajGeneratorRML::joint_position_cmd_in_;
+  using JointTrajGeneratorRML::joint_position_sample_;
+  using JointTrajGeneratorRML::joint_velocity_sample_;
+  using JointTrajGeneratorRML::joint_acceleration_sample_;
+  using JointTrajGeneratorRML::rml_;
+  using JointTrajGeneratorRML::rml_in_;
+  using JointTrajGeneratorRML::rml_out_;
+  using JointTrajGeneratorRML::rml_flags_;
+  using JointTrajGeneratorRML::last_segment_start_time_;
+};
+
+class JogTest : public ::testing::Test
+{
+public:
+  size_t n_dof;
+  JogTraj task;
+  RTT::OutputPort<Eigen::VectorXd> velocity_cmd_out;
+  RTT::OutputPort<Eigen::VectorXd> position_cmd_out;
+  ros::Time now;
+  ros::Duration dt;
+
+  JogTest() :
+    n_dof(3),
+    task(n_dof),
+    velocity_cmd_out("velocity_cmd_out"),
+    position_cmd_out("position_cmd_out"),
+    now(1000,0),
+    dt(0.001)
+  {
+    velocity_cmd_out.connectTo(&task.joint_velocity_cmd_in_);
+    position_cmd_out.connectTo(&task.joint_position_cmd_in_);
+  }
+
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(task.configure());
+
+    // Start at rest, following a trajectory
+    const Eigen::VectorXd zero = Eigen::VectorXd::Zero(n_dof);
+    task.joint_position_sample_.setZero();
+    task.joint_velocity_sample_.setZero();
+    task.joint_acceleration_sample_.setZero();
+    task.computeTrajectory(
+        now, zero, zero, zero, ros::Duration(0.0), zero, zero,
+        task.rml_, task.rml_in_, task.rml_out_, task.rml_flags_);
+    task.last_segment_start_time_ = now;
+    task.segments_.push_back(JointTrajGeneratorRML::TrajSegment(n_dof,true));
+    task.traj_mode_ = JointTrajGeneratorRML::FOLLOWING;
+  }
+
+  void jog(const double velocity)
+  {
+    velocity_cmd_out.write(Eigen::VectorXd::Constant(n_dof,velocity));
+    ASSERT_TRUE(task.readVelocityCommands(now));
+  }
+};
+
+TEST_F(JogTest, EnterJogging)
+{
+  RecordProperty("description",
+                 "This tests that a velocity command preempts the position "
+                 "interface, and that jogging starts from the last reference.");
+
+  // Nothing happens without a new command
+  EXPECT_FALSE(task.readVelocityCommands(now));
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::FOLLOWING);
+
+  // Commands of the wrong size are ignored
+  velocity_cmd_out.write(Eigen::VectorXd::Constant(n_dof+1,1.0));
+  EXPECT_FALSE(task.readVelocityCommands(now));
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::FOLLOWING);
+
+  jog(1.0);
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::JOGGING);
+  EXPECT_TRUE(task.segments_.empty());
+
+  // The reference accelerates smoothly from rest
+  now += dt;
+  task.updateJogging(now);
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::JOGGING);
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_GT(task.joint_velocity_sample_[i], 0.0);
+    EXPECT_LT(task.joint_velocity_sample_[i], 0.1);
+  }
+}
+
+TEST_F(JogTest, ClampVelocity)
+{
+  RecordProperty("description",
+                 "This tests that commanded velocities beyond the limits are "
+                 "clamped to the limits.");
+
+  task.jog_timeout_ = 100.0;
+  jog(10.0);
+
+  double max_velocity = 0.0;
+  for(size_t t=0; t<3000; t++) {
+    now += dt;
+    task.updateJogging(now);
+    max_velocity = std::max(max_velocity, task.joint_velocity_sample_.maxCoeff());
+  }
+
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::JOGGING);
+  EXPECT_LE(max_velocity, 2.5 + 1E-6);
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_NEAR(task.joint_velocity_sample_[i], 2.5, 1E-6);
+  }
+}
+
+TEST_F(JogTest, StopOnTimeout)
+{
+  RecordProperty("description",
+                 "This tests that jogging decelerates to a stop within the "
+                 "acceleration limits once the velocity commands time out, "
+                 "and then hands over to position control.");
+
+  task.jog_timeout_ = 0.1;
+  jog(1.0);
+
+  // Keep jogging until the commands time out
+  const ros::Time timeout_time = now + ros::Duration(task.jog_timeout_);
+  while(now <= timeout_time) {
+    now += dt;
+    task.updateJogging(now);
+    ASSERT_EQ(task.traj_mode_, JointTrajGeneratorRML::JOGGING);
+  }
+  const double timeout_velocity = task.joint_velocity_sample_[0];
+  EXPECT_GT(timeout_velocity, 0.0);
+
+  // Come to a stop without reversing or exceeding the acceleration limit
+  size_t t = 0;
+  while(task.traj_mode_ == JointTrajGeneratorRML::JOGGING && t++ < 10000) {
+    now += dt;
+    task.updateJogging(now);
+    EXPECT_GE(task.joint_velocity_sample_[0], -1E-9);
+    EXPECT_LE(std::abs(task.joint_acceleration_sample_[0]), 5.0 + 1E-6);
+  }
+
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::FOLLOWING);
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_NEAR(task.joint_velocity_sample_[i], 0.0, 1E-6);
+  }
+}
+
+TEST_F(JogTest, RetargetWithoutStutter)
+{
+  RecordProperty("description",
+                 "This tests that a velocity command every update keeps the "
+                 "reference moving, instead of holding it whenever a command "
+                 "arrives.");
+
+  task.jog_timeout_ = 100.0;
+  jog(1.0);
+  now += dt;
+  task.updateJogging(now);
+
+  double last_position = task.joint_position_sample_[0];
+  double last_velocity = task.joint_velocity_sample_[0];
+
+  for(size_t t=0; t<500; t++) {
+    now += dt;
+    jog(1.0);
+    task.updateJogging(now);
+
+    // The reference accelerates every update
+    EXPECT_GT(task.joint_position_sample_[0], last_position) << "at update " << t;
+    EXPECT_GE(task.joint_velocity_sample_[0], last_velocity - 1E-9) << "at update " << t;
+    last_position = task.joint_position_sample_[0];
+    last_velocity = task.joint_velocity_sample_[0];
+  }
+
+  // The same as a single command
+  EXPECT_NEAR(task.joint_velocity_sample_[0], 1.0, 1E-6);
+}
+
+TEST_F(JogTest, LeaveJoggingForPositionCommand)
+{
+  RecordProperty("description",
+                 "This tests that a position command while jogging hands over "
+                 "to position control from the current jogging reference.");
+
+  task.jog_timeout_ = 100.0;
+  jog(1.0);
+
+  for(size_t t=0; t<100; t++) {
+    now += dt;
+    task.updateJogging(now);
+  }
+  ASSERT_EQ(task.traj_mode_, JointTrajGeneratorRML::JOGGING);
+  const Eigen::VectorXd jog_velocity = task.joint_velocity_sample_;
+
+  position_cmd_out.write(Eigen::VectorXd::Constant(n_dof,0.5));
+  now += dt;
+  task.updateJogging(now);
+
+  EXPECT_EQ(task.traj_mode_, JointTrajGeneratorRML::FOLLOWING);
+  EXPECT_FALSE(task.segments_.empty());
+  // The handover keeps the reference continuous
+  EXPECT_NEAR(task.joint_velocity_sample_[0], jog_velocity[0], 0.01);
+}
+
+class PlanTraj : public JogTraj
+{
+public:
+  PlanTraj(const size_t n_dof) : JogTraj(n_dof) { }
+
+  using JointTrajGeneratorRML::insertSegments;
+  using JointTrajGeneratorRML::readPlannedSegments;
+  using JointTrajGeneratorRML::discardPendingPlans;
+  using JointTrajGeneratorRML::getNumPendingPlans;
+  using JointTrajGeneratorRML::index_permutation_;
+};
+
+//! Wait for the planner, splicing its trajectories in at the given time
+static bool SplicePlans(PlanTraj &task, const ros::Time &time)
+{
+  for(size_t attempt=0; attempt<1000 && task.getNumPendingPlans() > 0; attempt++) {
+    usleep(1000);
+    task.readPlannedSegments(time);
+  }
+  return task.getNumPendingPlans() == 0;
+}
+
+class PlanTest : public ::testing::Test
+{
+public:
+  size_t n_dof;
+  PlanTraj task;
+  Eigen::VectorXd zero;
+  ros::Time now;
+
+  PlanTest() :
+    n_dof(3),
+    task(n_dof),
+    zero(Eigen::VectorXd::Zero(n_dof)),
+    now(1000,0)
+  { }
+
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(task.configure());
+    task.joint_position_sample_.setZero();
+    task.joint_velocity_sample_.setZero();
+    task.joint_acceleration_sample_.setZero();
+  }
+
+  //! A zero-stamped trajectory through 0.5, 1.0, 1.5, ...
+  trajectory_msgs::JointTrajectory trajectory(const size_t n_points)
+  {
+    trajectory_msgs::JointTrajectory traj_msg;
+    traj_msg.points.resize(n_points);
+    for(size_t p=0; p<traj_msg.points.size(); p++) {
+      traj_msg.points[p].positions.assign(n_dof, 0.5 * (p + 1));
+    }
+    return traj_msg;
+  }
+
+  //! A flexible segment to a position
+  JointTrajGeneratorRML::TrajSegment segment(const double position)
+  {
+    JointTrajGeneratorRML::TrajSegment segment(n_dof,true);
+    segment.start_time = now;
+    segment.goal_time = now;
+    segment.goal_positions.setConstant(position);
+    return segment;
+  }
+};
+
+TEST_F(PlanTest, ParameterizeSegments)
+{
+  RecordProperty("description",
+                 "This tests that each flexible segment is given a feasible "
+                 "duration, starting where the one before it ends.");
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  segments.push_back(segment(1.0));
+  segments.push_back(segment(-1.0));
+  segments.push_back(segment(0.5));
+
+  ASSERT_TRUE(task.parameterizeSegments(zero, zero, segments));
+
+  ros::Time start_time = now;
+  for(JointTrajGeneratorRML::TrajSegments::const_iterator it = segments.begin();
+      it != segments.end();
+      ++it)
+  {
+    EXPECT_EQ(it->start_time, start_time);
+    EXPECT_GT(it->goal_time, it->start_time);
+    EXPECT_EQ(it->expected_time, it->goal_time);
+    start_time = it->goal_time;
+  }
+}
+
+TEST_F(PlanTest, FailedParameterizationKeepsSegments)
+{
+  RecordProperty("description",
+                 "This tests that the segments are left untouched when a "
+                 "segment after the first can't be solved.");
+
+  JointTrajGeneratorRML::TrajSegments segments;
+  segments.push_back(segment(1.0));
+  segments.push_back(segment(-1.0));
+  segments.push_back(segment(0.5));
+  // A goal velocity beyond the limits is invalid Reflexxes input
+  segments.back().goal_velocities.setConstant(10.0 * task.max_velocities_[0]);
+
+  const JointTrajGeneratorRML::TrajSegments original(segments);
+
+  EXPECT_FALSE(task.parameterizeSegments(zero, zero, segments));
+
+  ASSERT_EQ(segments.size(), original.size());
+  JointTrajGeneratorRML::TrajSegments::const_iterator it = segments.begin(), original_it = original.begin();
+  for(; it != segments.end(); ++it, ++original_it) {
+    EXPECT_EQ(it->start_time, original_it->start_time);
+    EXPECT_EQ(it->goal_time, original_it->goal_time);
+    EXPECT_EQ(it->expected_time, original_it->expected_time);
+  }
+}
+
+TEST_F(PlanTest, PlanOutsideOfRealtimeLoop)
+{
+  RecordProperty("description",
+                 "This tests that a trajectory to be parameterized is planned "
+                 "by the segment planner, and only replaces the current "
+                 "segments once it has been planned.");
+
+  task.parameterize_trajectories_ = true;
+  ASSERT_TRUE(task.startHook());
+  task.segments_.push_back(segment(0.0));
+
+  const trajectory_msgs::JointTrajectory traj_msg = trajectory(3);
+  ASSERT_TRUE(task.insertSegments(traj_msg, now, task.segments_, task.index_permutation_));
+
+  // The current segments are kept until the planner has finished
+  EXPECT_EQ(task.segments_.size(), 1);
+  EXPECT_EQ(task.getNumPendingPlans(), 1);
+
+  ASSERT_TRUE(SplicePlans(task, now));
+
+  ASSERT_EQ(task.segments_.size(), traj_msg.points.size());
+  for(JointTrajGeneratorRML::TrajSegments::const_iterator it = task.segments_.begin();
+      it != task.segments_.end();
+      ++it)
+  {
+    EXPECT_TRUE(it->queued);
+    EXPECT_GT(it->goal_time, it->start_time);
+  }
+
+  task.stopHook();
+}
+
+TEST_F(PlanTest, RebasePlannedTrajectory)
+{
+  RecordProperty("description",
+                 "This tests that a planned trajectory is delayed by the time "
+                 "it took to plan, and that it's re-planned from the state it "
+                 "is spliced onto.");
+
+  task.parameterize_trajectories_ = true;
+  ASSERT_TRUE(task.startHook());
+
+  const trajectory_msgs::JointTrajectory traj_msg = trajectory(3);
+  ASSERT_TRUE(task.insertSegments(traj_msg, now, task.segments_, task.index_permutation_));
+
+  // The reference moves away while the trajectory is being planned
+  const ros::Time splice_time = now + ros::Duration(0.5);
+  task.joint_position_sample_.setConstant(-1.0);
+
+  ASSERT_TRUE(SplicePlans(task, splice_time));
+  ASSERT_EQ(task.segments_.size(), traj_msg.points.size());
+
+  // The same trajectory planned from the new state at the splice time
+  JointTrajGeneratorRML::TrajSegments expected_segments;
+  JointTrajGeneratorRML::TrajectoryMsgToSegments(
+      traj_msg, task.index_permutation_, n_dof, splice_time, expected_segments);
+  ASSERT_TRUE(task.parameterizeSegments(task.joint_position_sample_, zero, expected_segments));
+
+  EXPECT_EQ(task.segments_.front().start_time, splice_time);
+  JointTrajGeneratorRML::TrajSegments::const_iterator it = task.segments_.begin();
+  JointTrajGeneratorRML::TrajSegments::const_iterator expected_it = expected_segments.begin();
+  for(; it != task.segments_.end(); ++it, ++expected_it) {
+    EXPECT_NEAR((it->start_time - expected_it->start_time).toSec(), 0.0, 1E-6);
+    EXPECT_NEAR((it->goal_time - expected_it->goal_time).toSec(), 0.0, 1E-6);
+  }
+
+  task.stopHook();
+}
+
+TEST_F(PlanTest, DiscardPendingPlans)
+{
+  RecordProperty("description",
+                 "This tests that trajectories which are still being planned "
+                 "when the trajectory is stopped are never spliced in.");
+
+  task.parameterize_trajectories_ = true;
+  ASSERT_TRUE(task.startHook());
+  task.segments_.push_back(segment(0.0));
+
+  ASSERT_TRUE(task.insertSegments(trajectory(3), now, task.segments_, task.index_permutation_));
+  task.discardPendingPlans();
+
+  ASSERT_TRUE(SplicePlans(task, now));
+  EXPECT_EQ(task.segments_.size(), 1);
+
+  task.stopHook();
+}
+
+//! A generator whose action goal mailbox can be driven directly
+class GoalTraj : public PlanTraj
+{
+public:
+  GoalTraj(const size_t n_dof) : PlanTraj(n_dof) { }
+
+  using JointTrajGeneratorRML::readGoalCommands;
+  using JointTrajGeneratorRML::current_goal_;
+
+  //! A goal without an action server, for the given trajectory
+  ActiveGoalPtr makeGoal(const trajectory_msgs::JointTrajectory &trajectory)
+  {
+    ActiveGoalPtr goal(new ActiveGoal(GoalHandle(), &goal_events_));
+    boost::shared_ptr<Goal> goal_msg(new Goal());
+    goal_msg->trajectory = trajectory;
+    goal->goal = goal_msg;
+    return goal;
+  }
+
+  bool sendGoal(const ActiveGoalPtr &goal) { return goal_commands_.Push(GoalCommand(NEW_GOAL, goal)); }
+  bool cancelGoal(const ActiveGoalPtr &goal) { return goal_commands_.Push(GoalCommand(CANCEL_GOAL, goal)); }
+
+  //! Take the goal state transitions which would have been sent to the relay
+  std::vector<std::pair<ActiveGoalPtr, GoalEventType> > takeEvents()
+  {
+    std::vector<std::pair<ActiveGoalPtr, GoalEventType> > events;
+    GoalEvent event;
+    while(goal_events_.Pop(event)) {
+      events.push_back(std::make_pair(event.goal, event.type));
+    }
+    return events;
+  }
+};
+
+class GoalTest : public ::testing::Test
+{
+public:
+  typedef std::vector<std::pair<JointTrajGeneratorRML::ActiveGoalPtr, JointTrajGeneratorRML::GoalEventType> > Events;
+
+  size_t n_dof;
+  GoalTraj task;
+  trajectory_msgs::JointTrajectory traj_msg;
+  ros::Time now;
+
+  GoalTest() :
+    n_dof(3),
+    task(n_dof),
+    now(1000,0)
+  {
+    traj_msg.points.resize(2);
+    for(size_t p=0; p<traj_msg.points.size(); p++) {
+      traj_msg.points[p].positions.assign(n_dof, 0.5 * (p + 1));
+    }
+    for(size_t j=0; j<n_dof; j++) {
+      std::ostringstream joint_name;
+      joint_name << "joint_" << j;
+      traj_msg.joint_names.push_back(joint_name.str());
+    }
+  }
+
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(task.configure());
+    task.joint_position_sample_.setZero();
+    task.joint_velocity_sample_.setZero();
+    task.joint_acceleration_sample_.setZero();
+  }
+
+  virtual void TearDown()
+  {
+    task.stopHook();
+  }
+};
+
+TEST_F(GoalTest, AcceptGoal)
+{
+  RecordProperty("description",
+                 "This tests that a new goal is accepted and its trajectory "
+                 "is queued.");
+
+  JointTrajGeneratorRML::ActiveGoalPtr goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+
+  const Events events = task.takeEvents();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].first, goal);
+  EXPECT_EQ(events[0].second, JointTrajGeneratorRML::GOAL_ACCEPTED);
+
+  EXPECT_EQ(task.current_goal_, goal);
+  EXPECT_TRUE(goal->active);
+  EXPECT_EQ(task.segments_.size(), traj_msg.points.size());
+}
+
+TEST_F(GoalTest, RejectInvalidJointNames)
+{
+  RecordProperty("description",
+                 "This tests that a goal for unknown joints is rejected "
+                 "without touching the current trajectory.");
+
+  traj_msg.joint_names[0] = "not_a_joint";
+  JointTrajGeneratorRML::ActiveGoalPtr goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+
+  const Events events = task.takeEvents();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].first, goal);
+  EXPECT_EQ(events[0].second, JointTrajGeneratorRML::GOAL_REJECTED);
+  EXPECT_FALSE(goal->active);
+  EXPECT_TRUE(task.segments_.empty());
+}
+
+TEST_F(GoalTest, PreemptGoal)
+{
+  RecordProperty("description",
+                 "This tests that a new goal cancels the current one before "
+                 "it's accepted.");
+
+  JointTrajGeneratorRML::ActiveGoalPtr first_goal = task.makeGoal(traj_msg);
+  JointTrajGeneratorRML::ActiveGoalPtr second_goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(first_goal));
+  ASSERT_TRUE(task.sendGoal(second_goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+
+  const Events events = task.takeEvents();
+  ASSERT_EQ(events.size(), 3);
+  EXPECT_EQ(events[0].first, first_goal);
+  EXPECT_EQ(events[0].second, JointTrajGeneratorRML::GOAL_ACCEPTED);
+  EXPECT_EQ(events[1].first, first_goal);
+  EXPECT_EQ(events[1].second, JointTrajGeneratorRML::GOAL_CANCELED);
+  EXPECT_EQ(events[2].first, second_goal);
+  EXPECT_EQ(events[2].second, JointTrajGeneratorRML::GOAL_ACCEPTED);
+
+  EXPECT_EQ(task.current_goal_, second_goal);
+  EXPECT_EQ(task.segments_.size(), traj_msg.points.size());
+}
+
+TEST_F(GoalTest, CancelGoal)
+{
+  RecordProperty("description",
+                 "This tests that canceling the current goal stops the "
+                 "trajectory, and that canceling any other goal does nothing.");
+
+  JointTrajGeneratorRML::ActiveGoalPtr goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+  task.takeEvents();
+
+  // A goal which isn't being executed can't be canceled
+  ASSERT_TRUE(task.cancelGoal(task.makeGoal(traj_msg)));
+  EXPECT_TRUE(task.readGoalCommands(now));
+  EXPECT_TRUE(task.takeEvents().empty());
+  EXPECT_TRUE(goal->active);
+
+  ASSERT_TRUE(task.cancelGoal(goal));
+  EXPECT_FALSE(task.readGoalCommands(now));
+
+  const Events events = task.takeEvents();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].first, goal);
+  EXPECT_EQ(events[0].second, JointTrajGeneratorRML::GOAL_CANCELED);
+  EXPECT_FALSE(goal->active);
+}
+
+TEST_F(GoalTest, PreemptGoalOncePlanned)
+{
+  RecordProperty("description",
+                 "This tests that a goal keeps running until the trajectory "
+                 "of the goal which preempted it has been planned.");
+
+  // The relay takes the events once it's started, so only the goal states
+  // are checked here
+  task.parameterize_trajectories_ = true;
+  ASSERT_TRUE(task.startHook());
+
+  JointTrajGeneratorRML::ActiveGoalPtr first_goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(first_goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+  ASSERT_TRUE(SplicePlans(task, now));
+  ASSERT_EQ(task.segments_.size(), traj_msg.points.size());
+  EXPECT_TRUE(first_goal->active);
+
+  JointTrajGeneratorRML::ActiveGoalPtr second_goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(second_goal));
+  EXPECT_TRUE(task.readGoalCommands(now));
+
+  // The first goal is still running
+  EXPECT_TRUE(second_goal->active);
+  EXPECT_TRUE(first_goal->active);
+  EXPECT_EQ(task.segments_.front().goal, first_goal);
+
+  // It's canceled once the second goal's trajectory replaces it
+  ASSERT_TRUE(SplicePlans(task, now));
+  EXPECT_FALSE(first_goal->active);
+  EXPECT_TRUE(second_goal->active);
+  EXPECT_EQ(task.segments_.front().goal, second_goal);
+}
+
+TEST_F(GoalTest, DropGoalsOnRestart)
+{
+  RecordProperty("description",
+                 "This tests that goals which were queued before the "
+                 "component stopped aren't executed once it's restarted.");
+
+  ASSERT_TRUE(task.startHook());
+
+  JointTrajGeneratorRML::ActiveGoalPtr goal = task.makeGoal(traj_msg);
+  ASSERT_TRUE(task.sendGoal(goal));
+
+  task.stopHook();
+  ASSERT_TRUE(task.startHook());
+
+  EXPECT_TRUE(task.readGoalCommands(now));
+  EXPECT_FALSE(goal->active);
+  EXPECT_FALSE(task.current_goal_);
+  EXPECT_TRUE(task.segments_.empty());
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,345 @@
+#include <iostream>
+#include <map>
+#include <cmath>
+
+#include <Eigen/Dense>
+
+#include <kdl/tree.hpp>
+#include <kdl/chain.hpp>
+
+#include <kdl_parser/kdl_parser.hpp>
+#include <ocl/Component.hpp>
+
+#include <rtt_rosparam/rosparam.h>
+#include <rtt_rosclock/rtt_rosclock.h>
+
+#include <tf_conversions/tf_kdl.h>
+
+#include <rtt_ros_tools/tools.h>
+#include <kdl_urdf_tools/tools.h>
+#include "multi_cartesian_logistic_servo.h"
+
+using namespace lcsr_controllers;
+
+MultiCartesianLogisticServo::MultiCartesianLogisticServo(std::string const& name) :
+  TaskContext(name)
+  // Properties
+  ,robot_description_("")
+  ,robot_description_param_("/robot_description")
+  ,root_link_("")
+  ,tf_period_(0.005)
+  ,max_linear_rate_(0.0)
+  ,max_angular_rate_(0.0)
+  ,max_linear_error_(0.0)
+  ,max_angular_error_(0.0)
+  ,linear_p_gain_(0.0)
+  ,angular_p_gain_(0.0)
+  // Working variables
+  ,n_dof_(0)
+  ,tf_cache_(name)
+  ,ros_publish_throttle_(0.02)
+{
+  // Declare properties
+  this->addProperty("robot_description",robot_description_)
+    .doc("The URDF xml string.");
+  this->addProperty("robot_description_param",robot_description_param_)
+    .doc("The ROS parameter name for the URDF xml string.");
+
+  this->addProperty("root_link",root_link_)
+    .doc("The root link for the controller.");
+  this->addProperty("tip_links",tip_links_)
+    .doc("The tip links for the controller.");
+  this->addProperty("target_frames",target_frames_)
+    .doc("The target frames to track with each of tip_links.");
+  this->addProperty("tf_period",tf_period_)
+    .doc("The period, in seconds, at which the target frames are looked up outside of the realtime thread.");
+  this->addProperty("max_linear_rate",max_linear_rate_);
+  this->addProperty("max_linear_error",max_linear_error_);
+  this->addProperty("max_angular_rate",max_angular_rate_);
+  this->addProperty("max_angular_error",max_angular_error_);
+  this->addProperty("linear_p_gain",linear_p_gain_);
+  this->addProperty("angular_p_gain",angular_p_gain_);
+
+  this->addAttribute("joint_names",joint_names_);
+
+  // Configure data ports
+  this->ports()->addPort("positions_in", positions_in_port_)
+    .doc("Input port: nx1 vector of joint positions, in the order of joint_names. (n joints)");
+}
+
+bool MultiCartesianLogisticServo::configureHook()
+{
+  // ROS parameters
+  boost::shared_ptr<rtt_rosparam::ROSParam> rosparam = this->getProvider<rtt_rosparam::ROSParam>("rosparam");
+  // Get private parameters
+  rosparam->getComponentPrivate("root_link");
+  rosparam->getComponentPrivate("tip_links");
+  rosparam->getComponentPrivate("target_frames");
+  rosparam->getComponentPrivate("max_linear_rate");
+  rosparam->getComponentPrivate("max_linear_error");
+  rosparam->getComponentPrivate("max_angular_rate");
+  rosparam->getComponentPrivate("max_angular_error");
+  rosparam->getComponentPrivate("linear_p_gain");
+  rosparam->getComponentPrivate("angular_p_gain");
+  rosparam->getComponentPrivate("tf_period");
+
+  rosparam->getComponentPrivate("robot_description_param");
+  rosparam->getParam(robot_description_param_, "robot_description");
+  if(robot_description_.length() == 0) {
+    RTT::log(RTT::Error) << "No robot description! Reading from parameter \"" << robot_description_param_ << "\"" << RTT::endlog();
+    return false;
+  }
+
+  if(tip_links_.empty() || tip_links_.size() != target_frames_.size()) {
+    RTT::log(RTT::Error) << "There must be one target frame for each tip link, but there are "
+      << tip_links_.size() << " tip links and " << target_frames_.size() << " target frames." << RTT::endlog();
+    return false;
+  }
+
+  if(this->hasPeer("tf")) {
+    TaskContext* tf_task = this->getPeer("tf");
+    tf_lookup_transform_ = tf_task->getOperation("lookupTransform"); // void reset(void)
+    tf_broadcast_transform_ = tf_task->getOperation("broadcastTransform"); // void reset(void)
+
+    if(!tf_lookup_transform_.ready()) {
+      RTT::log(RTT::Error) << "Could not get operation `lookupTransform`" << RTT::endlog();
+      return false;
+    }
+    if(!tf_broadcast_transform_.ready()) {
+      RTT::log(RTT::Error) << "Could not get operation `broadcastTransform`" << RTT::endlog();
+      return false;
+    }
+  } else {
+    ROS_ERROR("MultiCartesianLogisticServo controller is not connected to tf!");
+    return false;
+  }
+
+  // Initialize the KDL tree (the chain to the first tip is rebuilt below)
+  {
+    urdf::Model urdf_model;
+    KDL::Chain kdl_chain;
+    unsigned int n_dof;
+    if(!kdl_urdf_tools::initialize_kinematics_from_urdf(
+          robot_description_, root_link_, tip_links_[0],
+          n_dof, kdl_chain, kdl_tree_, urdf_model))
+    {
+      RTT::log(RTT::Error) << "Could not initialize robot kinematics!" << RTT::endlog();
+      return false;
+    }
+  }
+
+  // Remove the output ports from the last configuration
+  this->cleanupHook();
+
+  // Merge the chains from the root to each tip, so segments which they share
+  // are only computed once
+  std::map<std::string, int> segment_indices;
+  targets_.resize(tip_links_.size());
+
+  for(unsigned int k=0; k<tip_links_.size(); k++) {
+    RTT::log(RTT::Debug) << "Initializing kinematic parameters from \"" << root_link_ << "\" to \"" << tip_links_[k] <<"\"" << RTT::endlog();
+
+    KDL::Chain kdl_chain;
+    if(!kdl_tree_.getChain(root_link_, tip_links_[k], kdl_chain)) {
+      RTT::log(RTT::Error) << "Could not get the chain from \"" << root_link_ << "\" to \"" << tip_links_[k] << "\"" << RTT::endlog();
+      this->cleanupHook();
+      return false;
+    }
+
+    int parent = -1;
+    for(std::vector<KDL::Segment>::const_iterator it=kdl_chain.segments.begin();
+        it != kdl_chain.segments.end();
+        it++)
+    {
+      std::map<std::string, int>::const_iterator index = segment_indices.find(it->getName());
+      if(index != segment_indices.end()) {
+        parent = index->second;
+        continue;
+      }
+
+      segments_.push_back(*it);
+      segment_parents_.push_back(parent);
+      if(it->getJoint().getType() != KDL::Joint::None) {
+        segment_joints_.push_back(n_dof_++);
+        joint_names_.push_back(it->getJoint().getName());
+      } else {
+        segment_joints_.push_back(-1);
+      }
+
+      parent = segments_.size() - 1;
+      segment_indices[it->getName()] = parent;
+    }
+
+    Target &target = targets_[k];
+    target.tip_link = tip_links_[k];
+    target.target_frame = target_frames_[k];
+    target.segment = parent;
+
+    // Each target gets its own output port
+    target.framevel_out_port.reset(new RTT::OutputPort<KDL::FrameVel>("framevel_out_"+tip_links_[k]));
+    this->ports()->addPort(*target.framevel_out_port)
+      .doc("Output port: KDL::FrameVel of frame that moves subject to rate limits towards "+target_frames_[k]);
+  }
+
+  // Resize working variables
+  positions_.resize(n_dof_);
+  segment_frames_.resize(segments_.size());
+
+  return true;
+}
+
+bool MultiCartesianLogisticServo::startHook()
+{
+  // Start looking up the target frames (failures are logged by the cache)
+  tf_cache_.clear();
+  for(std::vector<Target>::iterator target = targets_.begin();
+      target != targets_.end();
+      ++target)
+  {
+    target->target_frame_handle = tf_cache_.addFramePair("/"+root_link_, target->target_frame);
+
+    // Initialize TF messages
+    target->target_frame_limited_msg.header.frame_id = root_link_;
+    target->target_frame_limited_msg.child_frame_id = target->target_frame+"_limited";
+
+    target->target_frame_unbounded_msg.header.frame_id = root_link_;
+    target->target_frame_unbounded_msg.child_frame_id = target->target_frame+"_unbounded";
+  }
+  if(!tf_cache_.start(tf_lookup_transform_, tf_period_)) {
+    return false;
+  }
+
+  // TODO: get last update time from Conman
+  last_update_time_ = rtt_rosclock::rtt_now();
+
+  // Read in the current joint positions
+  RTT::FlowStatus positions_data = positions_in_port_.readNewest( positions_ );
+  if(positions_data != RTT::NewData || positions_.size() != static_cast<int>(n_dof_)) {
+    tf_cache_.stop();
+    return false;
+  }
+
+  // Compute the current tip frames, and start commanding them
+  this->compute_segment_frames();
+  for(std::vector<Target>::iterator target = targets_.begin();
+      target != targets_.end();
+      ++target)
+  {
+    target->tip_frame_cur = (target->segment < 0) ? KDL::Frame::Identity() : segment_frames_[target->segment];
+    target->saturation.reset(target->tip_frame_cur);
+  }
+
+  return true;
+}
+
+void MultiCartesianLogisticServo::compute_segment_frames()
+{
+  for(unsigned int i=0; i<segments_.size(); i++) {
+    const double q = (segment_joints_[i] < 0) ? 0.0 : positions_(segment_joints_[i]);
+    if(segment_parents_[i] < 0) {
+      segment_frames_[i] = segments_[i].pose(q);
+    } else {
+      segment_frames_[i] = segment_frames_[segment_parents_[i]] * segments_[i].pose(q);
+    }
+  }
+}
+
+void MultiCartesianLogisticServo::updateHook()
+{
+  update_time_ = rtt_rosclock::rtt_now();
+  ros::Duration period = update_time_ - last_update_time_;
+  last_update_time_ = update_time_;
+
+  // Read in the current joint positions
+  RTT::FlowStatus positions_data = positions_in_port_.readNewest( positions_ );
+  if(positions_data != RTT::NewData || positions_.size() != static_cast<int>(n_dof_)) {
+    return;
+  }
+
+  // Compute every tip pose in the base frame
+  this->compute_segment_frames();
+
+  const bool integrate = period.toSec() > 1E-8;
+  if(!integrate) {
+    RTT::log(RTT::Warning) << "MultiCartesianLogisticServo: Period went backwards or is exceptionally small. Not changing output poses." << RTT::endlog();
+  }
+
+  // Move each command frame towards its desired frame
+  for(std::vector<Target>::iterator target = targets_.begin();
+      target != targets_.end();
+      ++target)
+  {
+    target->tip_frame_cur = (target->segment < 0) ? KDL::Frame::Identity() : segment_frames_[target->segment];
+
+    // Get the current desired pose in the base frame
+    if(tf_cache_.getTransform(target->target_frame_handle, target->tip_frame_des) != TransformCache::OK) {
+      continue;
+    }
+    if(!SE3LogisticSaturation::IsFinite(target->tip_frame_des)) {
+      RTT::log(RTT::Fatal) << "Transform to " << target->target_frame << " contained NaNs! Fleeing." <<RTT::endlog();
+      continue;
+    }
+
+    // The rate and error limits may have been changed since the last update
+    target->saturation.setGains(linear_p_gain_, angular_p_gain_);
+    target->saturation.setRateLimits(max_linear_rate_, max_angular_rate_);
+    target->saturation.setErrorLimits(max_linear_error_, max_angular_error_);
+
+    // Don't integrate nans. They're rude and unpleasant.
+    if(integrate && !target->saturation.update(target->tip_frame_cur, target->tip_frame_des, period.toSec())) {
+      RTT::log(RTT::Fatal) << "MultiCartesianLogisticServo: NaNs detected for " << target->tip_link << ". Run for the hills." << RTT::endlog();
+      this->error();
+      return;
+    }
+
+    // Send position target
+    target->saturation.getCommand(target->tip_framevel_cmd);
+    target->framevel_out_port->write( target->tip_framevel_cmd );
+  }
+
+  // Publish debug frames to ros
+  if(ros_publish_throttle_.ready(0.02))
+  {
+    const ros::Time now = rtt_rosclock::host_now();
+    for(std::vector<Target>::iterator target = targets_.begin();
+        target != targets_.end();
+        ++target)
+    {
+      tf::transformKDLToMsg(target->saturation.getCommandFrame(), target->target_frame_limited_msg.transform);
+      target->target_frame_limited_msg.header.stamp = now;
+      tf_broadcast_transform_(target->target_frame_limited_msg);
+
+      tf::transformKDLToMsg(target->saturation.getUnboundedFrame(), target->target_frame_unbounded_msg.transform);
+      target->target_frame_unbounded_msg.header.stamp = now;
+      tf_broadcast_transform_(target->target_frame_unbounded_msg);
+    }
+  }
+}
+
+void MultiCartesianLogisticServo::stopHook()
+{
+  positions_in_port_.clear();
+  tf_cache_.stop();
+}
+
+void MultiCartesianLogisticServo::cleanupHook()
+{
+  for(std::vector<Target>::iterator target = targets_.begin();
+      target != targets_.end();
+      ++target)
+  {
+    if(target->framevel_out_port) {
+      this->ports()->removePort(target->framevel_out_port->getName());
+    }
+  }
+  targets_.clear();
+
+  n_dof_ = 0;
+  joint_names_.clear();
+  segments_.clear();
+  segment_parents_.clear();
+  segment_joints_.clear();
+}
+
+ORO_CREATE_COMPONENT_LIBRARY()
+ORO_LIST_COMPONENT_TYPE(lcsr_controllers::MultiCartesianLogisticServo)
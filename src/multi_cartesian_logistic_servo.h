@@ -0,0 +1,128 @@
+#ifndef __LCSR_CONTROLLERS_MULTI_CARTESIAN_LOGISTIC_SERVO_H
+#define __LCSR_CONTROLLERS_MULTI_CARTESIAN_LOGISTIC_SERVO_H
+
+#include <iostream>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <Eigen/Dense>
+
+#include <rtt/RTT.hpp>
+#include <rtt/Port.hpp>
+
+#include <kdl/tree.hpp>
+#include <kdl/segment.hpp>
+#include <kdl/framevel.hpp>
+
+#include <tf/tf.h>
+
+#include <geometry_msgs/TransformStamped.h>
+
+#include "transform_cache/transform_cache.h"
+#include "saturation/se3_logistic_saturation.h"
+
+namespace lcsr_controllers {
+
+  /** \brief CartesianLogisticServo for several tip frames at once
+   *
+   * Each tip link in tip_links tracks the frame with the same index in
+   * target_frames, with the same rate and error limits as
+   * CartesianLogisticServo. The tips can be on one chain or on several
+   * branches of the robot's kinematic tree below root_link.
+   *
+   * The joints are those on the paths from root_link to the tips, in the
+   * order the paths are walked, each listed once (see the joint_names
+   * attribute). Forward kinematics is computed once per update over the
+   * union of the paths, and the servo law then runs for every target in
+   * one loop. Each target's command is written to its own output port,
+   * framevel_out_<tip_link>.
+   */
+  class MultiCartesianLogisticServo : public RTT::TaskContext
+  {
+    // RTT Properties
+    std::string robot_description_;
+    std::string robot_description_param_;
+    std::string root_link_;
+    std::vector<std::string> tip_links_;
+    std::vector<std::string> target_frames_;
+    double tf_period_;
+    double max_linear_rate_;
+    double max_angular_rate_;
+    double max_linear_error_;
+    double max_angular_error_;
+    double linear_p_gain_;
+    double angular_p_gain_;
+
+    // RTT Attributes
+    std::vector<std::string> joint_names_;
+
+    // RTT Ports
+    RTT::InputPort<Eigen::VectorXd> positions_in_port_;
+
+    // RTT Debug Ports
+    RTT::OperationCaller<geometry_msgs::TransformStamped(const std::string&,
+      const std::string&)> tf_lookup_transform_;
+    RTT::OperationCaller<void(const geometry_msgs::TransformStamped&)>
+      tf_broadcast_transform_;
+
+  public:
+    MultiCartesianLogisticServo(std::string const& name);
+    virtual bool configureHook();
+    virtual bool startHook();
+    virtual void updateHook();
+    virtual void stopHook();
+    virtual void cleanupHook();
+
+  private:
+
+    //! Compute the frame of every segment from the joint positions
+    void compute_segment_frames();
+
+    // Kinematic properties
+    unsigned int n_dof_;
+    KDL::Tree kdl_tree_;
+
+    // Segments on the paths from the root to the tips, each after its parent
+    std::vector<KDL::Segment> segments_;
+    //! Index of each segment's parent, or -1 for segments on the root link
+    std::vector<int> segment_parents_;
+    //! Index of each segment's joint position, or -1 for fixed joints
+    std::vector<int> segment_joints_;
+
+    // Working variables
+    Eigen::VectorXd positions_;
+    std::vector<KDL::Frame> segment_frames_;
+
+    struct Target {
+      std::string tip_link;
+      std::string target_frame;
+      //! Index of the tip link's segment, or -1 for the root link
+      int segment;
+
+      TransformCache::Handle target_frame_handle;
+      SE3LogisticSaturation saturation;
+
+      KDL::Frame tip_frame_cur;
+      KDL::Frame tip_frame_des;
+      KDL::FrameVel tip_framevel_cmd;
+
+      boost::shared_ptr<RTT::OutputPort<KDL::FrameVel> > framevel_out_port;
+      geometry_msgs::TransformStamped target_frame_limited_msg;
+      geometry_msgs::TransformStamped target_frame_unbounded_msg;
+    };
+    std::vector<Target> targets_;
+
+    // Target frames, looked up outside of the realtime thread
+    TransformCache tf_cache_;
+
+    rtt_ros_tools::PeriodicThrottle ros_publish_throttle_;
+
+    ros::Time update_time_;
+    ros::Time last_update_time_;
+
+  };
+}
+
+
+#endif // ifndef __LCSR_CONTROLLERS_MULTI_CARTESIAN_LOGISTIC_SERVO_H
@@ -0,0 +1,130 @@
+
+#include <vector>
+#include <algorithm>
+
+#include <kdl/frames.hpp>
+#include <kdl/framevel.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include "../test_fixtures.h"
+#include "se3_logistic_saturation.h"
+#include "kdl_logistic_saturation.h"
+using namespace lcsr_controllers;
+
+//! A target which jumps to a new random pose every 100 updates, and a current
+//! frame which follows a random walk
+struct Problem
+{
+  Problem(const unsigned int n_updates) :
+    current(n_updates),
+    desired(n_updates)
+  {
+    std::srand(0);
+    current[0] = RandomFrame();
+    desired[0] = RandomFrame();
+    for(unsigned int t=1; t<n_updates; t++) {
+      current[t] = current[t-1];
+      current[t].Integrate(
+          KDL::Twist(
+            KDL::Vector(Random(-0.5, 0.5), Random(-0.5, 0.5), Random(-0.5, 0.5)),
+            KDL::Vector(Random(-1.0, 1.0), Random(-1.0, 1.0), Random(-1.0, 1.0))),
+          1.0/PERIOD);
+      desired[t] = (t % 100 == 0) ? RandomFrame() : desired[t-1];
+    }
+  }
+
+  static const double PERIOD;
+  static const double LINEAR_P_GAIN, ANGULAR_P_GAIN;
+  static const double MAX_LINEAR_RATE, MAX_ANGULAR_RATE;
+  static const double MAX_LINEAR_ERROR, MAX_ANGULAR_ERROR;
+
+  std::vector<KDL::Frame> current;
+  std::vector<KDL::Frame> desired;
+};
+
+const double Problem::PERIOD = 0.001;
+const double Problem::LINEAR_P_GAIN = 5.0;
+const double Problem::ANGULAR_P_GAIN = 5.0;
+const double Problem::MAX_LINEAR_RATE = 0.2;
+const double Problem::MAX_ANGULAR_RATE = 0.5;
+const double Problem::MAX_LINEAR_ERROR = 0.05;
+const double Problem::MAX_ANGULAR_ERROR = 0.2;
+
+static const unsigned int N_UPDATES = 10000;
+
+//! Configure either implementation of the servo law with the problem's limits
+template <class Saturation>
+static void Configure(Saturation &saturation, const Problem &problem)
+{
+  saturation.setGains(Problem::LINEAR_P_GAIN, Problem::ANGULAR_P_GAIN);
+  saturation.setRateLimits(Problem::MAX_LINEAR_RATE, Problem::MAX_ANGULAR_RATE);
+  saturation.setErrorLimits(Problem::MAX_LINEAR_ERROR, Problem::MAX_ANGULAR_ERROR);
+  saturation.reset(problem.current[0]);
+}
+
+//! Largest difference between the two command frames over the updates
+static double MaxError(const Problem &problem)
+{
+  KDLLogisticSaturation reference;
+  SE3LogisticSaturation saturation;
+  Configure(reference, problem);
+  Configure(saturation, problem);
+
+  double max_error = 0.0;
+  for(unsigned int t=0; t<N_UPDATES; t++) {
+    reference.update(problem.current[t], problem.desired[t], Problem::PERIOD);
+    saturation.update(problem.current[t], problem.desired[t], Problem::PERIOD);
+
+    const KDL::Twist error = KDL::diff(reference.getCommandFrame(), saturation.getCommandFrame());
+    max_error = std::max(max_error, std::max(error.vel.Norm(), error.rot.Norm()));
+  }
+
+  return max_error;
+}
+
+/******************************************************************************
+ * Saturation
+ ******************************************************************************/
+
+static void BM_KDL(benchmark::State& state)
+{
+  Problem problem(N_UPDATES);
+
+  KDLLogisticSaturation saturation;
+  Configure(saturation, problem);
+
+  KDL::FrameVel command;
+  unsigned int t = 0;
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(saturation.update(problem.current[t], problem.desired[t], Problem::PERIOD));
+    saturation.getCommand(command);
+    benchmark::DoNotOptimize(command);
+    t = (t + 1 < N_UPDATES) ? t + 1 : 0;
+  }
+}
+BENCHMARK(BM_KDL);
+
+static void BM_Fused(benchmark::State& state)
+{
+  Problem problem(N_UPDATES);
+
+  SE3LogisticSaturation saturation;
+  Configure(saturation, problem);
+
+  KDL::FrameVel command;
+  unsigned int t = 0;
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(saturation.update(problem.current[t], problem.desired[t], Problem::PERIOD));
+    saturation.getCommand(command);
+    benchmark::DoNotOptimize(command);
+    t = (t + 1 < N_UPDATES) ? t + 1 : 0;
+  }
+
+  state.counters["max_error"] = MaxError(problem);
+}
+BENCHMARK(BM_Fused);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,135 @@
+#ifndef __LCSR_CONTROLLERS_KDL_LOGISTIC_SATURATION_H
+#define __LCSR_CONTROLLERS_KDL_LOGISTIC_SATURATION_H
+
+#include <cmath>
+#include <algorithm>
+
+#include <kdl/frames.hpp>
+#include <kdl/framevel.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief The servo law as CartesianLogisticServo computed it with KDL
+   *
+   * This is kept as the reference for SE3LogisticSaturation in the tests and
+   * benchmarks. It has the same interface, but the exact logistic function,
+   * and it doesn't reset itself when the result isn't finite.
+   */
+  class KDLLogisticSaturation {
+  public:
+    KDLLogisticSaturation() :
+      linear_p_gain_(0.0),
+      angular_p_gain_(0.0),
+      max_linear_rate_(0.0),
+      max_angular_rate_(0.0),
+      max_linear_error_(0.0),
+      max_angular_error_(0.0),
+      t_cmd_(KDL::Twist::Zero())
+    { }
+
+    void setGains(const double linear_p_gain, const double angular_p_gain)
+    {
+      linear_p_gain_ = linear_p_gain;
+      angular_p_gain_ = angular_p_gain;
+    }
+
+    void setRateLimits(const double max_linear_rate, const double max_angular_rate)
+    {
+      max_linear_rate_ = max_linear_rate;
+      max_angular_rate_ = max_angular_rate;
+    }
+
+    void setErrorLimits(const double max_linear_error, const double max_angular_error)
+    {
+      max_linear_error_ = max_linear_error;
+      max_angular_error_ = max_angular_error;
+    }
+
+    void reset(const KDL::Frame &current)
+    {
+      cmd_ = current;
+      cmd_unbounded_ = current;
+      t_cmd_ = KDL::Twist::Zero();
+    }
+
+    bool update(const KDL::Frame &current, const KDL::Frame &desired, const double period)
+    {
+      KDL::Twist t_cmd_des = KDL::diff(cmd_unbounded_, desired);
+      KDL::Twist t_cmd_diff;
+      t_cmd_diff.vel = linear_p_gain_ * t_cmd_des.vel;
+      t_cmd_diff.rot = angular_p_gain_ * t_cmd_des.rot;
+      sigm_scale(t_cmd_diff.vel, max_linear_rate_);
+      sigm_scale(t_cmd_diff.rot, max_angular_rate_);
+
+      cmd_unbounded_.Integrate(cmd_unbounded_.M.Inverse()*t_cmd_diff, 1.0/period);
+
+      KDL::Twist t_cur_cmd = KDL::diff(current, cmd_unbounded_);
+      double cur_cmd_angle = t_cur_cmd.rot.Norm();
+      double reflected_cur_cmd_angle = std::min(std::abs(cur_cmd_angle), M_PI-std::abs(cur_cmd_angle));
+      t_cur_cmd.rot.Normalize();
+      t_cur_cmd.rot = t_cur_cmd.rot * reflected_cur_cmd_angle;
+
+      sigm_scale(t_cur_cmd.vel, max_linear_error_);
+      sigm_scale(t_cur_cmd.rot, max_angular_error_);
+
+      KDL::Frame cmd_last = cmd_;
+      cmd_ = current;
+      cmd_.Integrate(cmd_.M.Inverse()*t_cur_cmd, 1.0);
+      t_cmd_ = KDL::diff(cmd_last, cmd_);
+
+      return !(IsNaN(cmd_) || IsNaN(cmd_unbounded_));
+    }
+
+    const KDL::Frame& getCommandFrame() const { return cmd_; }
+    const KDL::Frame& getUnboundedFrame() const { return cmd_unbounded_; }
+    const KDL::Twist& getCommandTwist() const { return t_cmd_; }
+
+    void getCommand(KDL::FrameVel &command) const
+    {
+      command = cmd_;
+      command.M.w = t_cmd_.rot;
+      command.p.v = t_cmd_.vel;
+    }
+
+  private:
+    static double sigm(const double x, const double s)
+    {
+      return s*(2.0/(1.0 + exp(-2.0*x/s)) - 1.0);
+    }
+
+    static void sigm_scale(KDL::Vector &vec, const double s)
+    {
+      const double n = sigm(vec.Norm(), s);
+      vec.Normalize();
+      vec = vec * n;
+    }
+
+    static bool IsNaN(const KDL::Frame &F)
+    {
+      for(unsigned i=0; i<3; i++) {
+        if(std::isnan(F.p[i])) {
+          return true;
+        }
+      }
+      for(unsigned i=0; i<3; i++) {
+        if(std::isnan(F.M.GetRot()[i])) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    double linear_p_gain_;
+    double angular_p_gain_;
+    double max_linear_rate_;
+    double max_angular_rate_;
+    double max_linear_error_;
+    double max_angular_error_;
+
+    KDL::Frame cmd_;
+    KDL::Frame cmd_unbounded_;
+    KDL::Twist t_cmd_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_KDL_LOGISTIC_SATURATION_H
@@ -0,0 +1,191 @@
+#include <cmath>
+#include <algorithm>
+
+#include "se3_logistic_saturation.h"
+
+using namespace lcsr_controllers;
+
+typedef Eigen::Map<Eigen::Vector3d> VectorMap;
+typedef Eigen::Map<const Eigen::Vector3d> ConstVectorMap;
+typedef Eigen::Map<Eigen::Matrix<double,3,3,Eigen::RowMajor> > RotationMap;
+typedef Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> > ConstRotationMap;
+
+//! Rotation vector of a rotation matrix
+static inline Eigen::Vector3d Log(const Eigen::Matrix3d &R)
+{
+  // 2*sin(angle)*axis and cos(angle)
+  const Eigen::Vector3d v(R(2,1) - R(1,2), R(0,2) - R(2,0), R(1,0) - R(0,1));
+  const double s = 0.5 * v.norm();
+  const double c = 0.5 * (R.trace() - 1.0);
+  const double angle = std::atan2(s, c);
+
+  if(s > 1E-6) {
+    return v * (0.5 * angle / s);
+  } else if(c > 0.0) {
+    // Close to identity, angle ~= sin(angle)
+    return 0.5 * v;
+  }
+
+  // Close to a half turn, the axis is in the symmetric part of R
+  int i;
+  R.diagonal().maxCoeff(&i);
+  const int j = (i + 1) % 3, k = (i + 2) % 3;
+  Eigen::Vector3d axis;
+  axis(i) = std::sqrt(std::max(0.0, (R(i,i) - c) / (1.0 - c)));
+  axis(j) = (R(i,j) + R(j,i)) / (2.0 * (1.0 - c) * axis(i));
+  axis(k) = (R(i,k) + R(k,i)) / (2.0 * (1.0 - c) * axis(i));
+  if(axis.dot(v) < 0.0) {
+    axis = -axis;
+  }
+
+  return angle * axis;
+}
+
+//! Rotation matrix of a rotation vector
+static inline Eigen::Matrix3d Exp(const Eigen::Vector3d &w)
+{
+  const double angle = w.norm();
+  Eigen::Matrix3d W;
+  W <<
+    0.0, -w(2), w(1),
+    w(2), 0.0, -w(0),
+    -w(1), w(0), 0.0;
+
+  if(angle < 1E-9) {
+    return Eigen::Matrix3d::Identity() + W;
+  }
+
+  // Rodrigues' formula
+  const double a = std::sin(angle) / angle;
+  const double b = (1.0 - std::cos(angle)) / (angle * angle);
+  return Eigen::Matrix3d::Identity() + a * W + b * W * W;
+}
+
+//! Scale a vector to a length of s*tanh(|x|/s)
+static inline Eigen::Vector3d Saturate(const Eigen::Vector3d &x, const double s)
+{
+  return x * SE3LogisticSaturation::ScaleFactor(x.norm(), s);
+}
+
+SE3LogisticSaturation::SE3LogisticSaturation() :
+  linear_p_gain_(0.0),
+  angular_p_gain_(0.0),
+  max_linear_rate_(0.0),
+  max_angular_rate_(0.0),
+  max_linear_error_(0.0),
+  max_angular_error_(0.0),
+  command_twist_(KDL::Twist::Zero())
+{
+}
+
+void SE3LogisticSaturation::setGains(
+    const double linear_p_gain,
+    const double angular_p_gain)
+{
+  linear_p_gain_ = linear_p_gain;
+  angular_p_gain_ = angular_p_gain;
+}
+
+void SE3LogisticSaturation::setRateLimits(
+    const double max_linear_rate,
+    const double max_angular_rate)
+{
+  max_linear_rate_ = max_linear_rate;
+  max_angular_rate_ = max_angular_rate;
+}
+
+void SE3LogisticSaturation::setErrorLimits(
+    const double max_linear_error,
+    const double max_angular_error)
+{
+  max_linear_error_ = max_linear_error;
+  max_angular_error_ = max_angular_error;
+}
+
+void SE3LogisticSaturation::reset(const KDL::Frame &current)
+{
+  unbounded_frame_ = current;
+  command_frame_ = current;
+  command_twist_ = KDL::Twist::Zero();
+}
+
+bool SE3LogisticSaturation::update(
+    const KDL::Frame &current,
+    const KDL::Frame &desired,
+    const double period)
+{
+  ConstVectorMap p_cur(current.p.data), p_des(desired.p.data);
+  ConstRotationMap R_cur(current.M.data), R_des(desired.M.data);
+  VectorMap p_ub(unbounded_frame_.p.data), p_cmd(command_frame_.p.data);
+  RotationMap R_ub(unbounded_frame_.M.data), R_cmd(command_frame_.M.data);
+  VectorMap v_cmd(command_twist_.vel.data), w_cmd(command_twist_.rot.data);
+
+  // Move the unbounded frame towards the desired frame, subject to the rate limits
+  const Eigen::Vector3d v = Saturate(linear_p_gain_ * (p_des - p_ub), max_linear_rate_);
+  const Eigen::Vector3d w = Saturate(angular_p_gain_ * Log(R_des * R_ub.transpose()), max_angular_rate_);
+  p_ub += period * v;
+  R_ub = Exp(period * w) * R_ub;
+
+  // Get the twist from the current frame to the unbounded frame, taking the
+  // shorter way around when the angle is over a quarter turn
+  Eigen::Vector3d e_p = p_ub - p_cur;
+  Eigen::Vector3d e_r = Log(R_ub * R_cur.transpose());
+  const double angle = e_r.norm();
+  if(angle > 0.0) {
+    e_r *= std::min(angle, M_PI - angle) / angle;
+  }
+
+  // Bound the command frame by the maximum error from the current frame
+  e_p = Saturate(e_p, max_linear_error_);
+  e_r = Saturate(e_r, max_angular_error_);
+  const Eigen::Matrix3d R_cmd_next = Exp(e_r) * R_cur;
+
+  // The command frame is rebuilt from the current frame every update, so a
+  // non-finite command doesn't outlive the update which produced it
+  const Eigen::Vector3d p_cmd_next = p_cur + e_p;
+  v_cmd = p_cmd_next - p_cmd;
+  w_cmd = Log(R_cmd_next * R_cmd.transpose());
+  p_cmd = p_cmd_next;
+  R_cmd = R_cmd_next;
+
+  // Any NaN or infinity in either frame makes the sum non-finite
+  if(!std::isfinite(p_ub.sum() + R_ub.sum() + p_cmd.sum() + R_cmd.sum())) {
+    this->reset(current);
+    return false;
+  }
+
+  return true;
+}
+
+void SE3LogisticSaturation::getCommand(KDL::FrameVel &command) const
+{
+  command = command_frame_;
+  command.M.w = command_twist_.rot;
+  command.p.v = command_twist_.vel;
+}
+
+double SE3LogisticSaturation::ScaleFactor(const double x, const double s)
+{
+  if(s <= 0.0) {
+    return 0.0;
+  }
+
+  // Beyond this, tanh(y) is 1 to within the approximation's error
+  const double y = x / s;
+  if(y >= 6.3) {
+    return 1.0 / y;
+  }
+
+  // Lambert's continued fraction for tanh(y)/y, truncated after the y^8 terms
+  const double y2 = y * y;
+  return
+    (34459425.0 + y2 * (4729725.0 + y2 * (135135.0 + y2 * (990.0 + y2)))) /
+    (34459425.0 + y2 * (16216200.0 + y2 * (945945.0 + y2 * (13860.0 + y2 * 45.0))));
+}
+
+bool SE3LogisticSaturation::IsFinite(const KDL::Frame &frame)
+{
+  return std::isfinite(
+      ConstVectorMap(frame.p.data).sum() +
+      ConstRotationMap(frame.M.data).sum());
+}
@@ -0,0 +1,95 @@
+#ifndef __LCSR_CONTROLLERS_SE3_LOGISTIC_SATURATION_H
+#define __LCSR_CONTROLLERS_SE3_LOGISTIC_SATURATION_H
+
+#include <Eigen/Dense>
+
+#include <kdl/frames.hpp>
+#include <kdl/framevel.hpp>
+
+namespace lcsr_controllers {
+
+  /** \brief Rate- and error-limited tracking of a target frame
+   *
+   * This is the servo law of CartesianLogisticServo. Each update, an
+   * unbounded command frame moves towards the target with a proportional
+   * twist, which is saturated by the maximum linear and angular rates. The
+   * command frame is then the unbounded frame, pulled back to within the
+   * maximum linear and angular errors of the current frame.
+   *
+   * Vectors are saturated with the logistic function s*tanh(|x|/s), like
+   * CartesianLogisticServo's sigm_scale(). Instead of calling exp(), tanh is
+   * evaluated with a rational approximation which is within 7e-6 of the
+   * exact value, so a saturated vector is within 7e-6*s of the exact one.
+   * Vectors which are small relative to s are scaled with a much smaller
+   * error.
+   *
+   * The error twists, the saturation and the integration of both frames are
+   * computed in one pass on fixed-size Eigen types, mapped onto the KDL
+   * frames' storage, and the result is checked for NaNs and infinities with a
+   * single sum.
+   */
+  class SE3LogisticSaturation {
+  public:
+    SE3LogisticSaturation();
+
+    //! Set the proportional gains from the unbounded frame's error to its twist
+    void setGains(
+        const double linear_p_gain,
+        const double angular_p_gain);
+
+    //! Set the maximum twist of the unbounded frame (m/s, rad/s)
+    void setRateLimits(
+        const double max_linear_rate,
+        const double max_angular_rate);
+
+    //! Set the maximum distance of the command frame from the current frame (m, rad)
+    void setErrorLimits(
+        const double max_linear_error,
+        const double max_angular_error);
+
+    //! Put the command and unbounded frames at the current frame, at rest
+    void reset(const KDL::Frame &current);
+
+    /** \brief Step the command frame towards the desired frame
+     *
+     * A limit of zero (or less) holds that part of the command at the
+     * current frame.
+     *
+     * Returns: false if the result isn't finite, in which case both frames
+     * are reset to the current frame, as with reset()
+     */
+    bool update(
+        const KDL::Frame &current,
+        const KDL::Frame &desired,
+        const double period);
+
+    //! The error-limited command frame
+    const KDL::Frame& getCommandFrame() const { return command_frame_; }
+    //! The rate-limited frame, before it's bounded by the maximum error
+    const KDL::Frame& getUnboundedFrame() const { return unbounded_frame_; }
+    //! The change in the command frame over the last update
+    const KDL::Twist& getCommandTwist() const { return command_twist_; }
+    //! Get the command frame along with its twist over the last update
+    void getCommand(KDL::FrameVel &command) const;
+
+    //! Compute s*tanh(x/s)/x, for x/s >= 0, without exp()
+    static double ScaleFactor(const double x, const double s);
+
+    //! True if a frame has no NaNs or infinities
+    static bool IsFinite(const KDL::Frame &frame);
+
+  private:
+    double linear_p_gain_;
+    double angular_p_gain_;
+    double max_linear_rate_;
+    double max_angular_rate_;
+    double max_linear_error_;
+    double max_angular_error_;
+
+    KDL::Frame unbounded_frame_;
+    KDL::Frame command_frame_;
+    KDL::Twist command_twist_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_SE3_LOGISTIC_SATURATION_H
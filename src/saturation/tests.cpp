@@ -0,0 +1,226 @@
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <kdl/frames.hpp>
+#include <kdl/framevel.hpp>
+
+#include <gtest/gtest.h>
+
+#include "../test_fixtures.h"
+#include "se3_logistic_saturation.h"
+#include "kdl_logistic_saturation.h"
+using namespace lcsr_controllers;
+
+/******************************************************************************
+ * Each test runs SE3LogisticSaturation next to the servo law it replaced
+ * (KDLLogisticSaturation) and checks that their frames agree, or checks the
+ * cases where the two are documented to differ.
+ ******************************************************************************/
+
+//! Largest linear (m) or angular (rad) difference between two frames
+static double FrameError(const KDL::Frame &a, const KDL::Frame &b)
+{
+  const KDL::Twist error = KDL::diff(a, b);
+  return std::max(error.vel.Norm(), error.rot.Norm());
+}
+
+class SE3LogisticSaturationTest : public ::testing::Test {
+public:
+  double period;
+  double tolerance;
+  SE3LogisticSaturation saturation;
+  KDLLogisticSaturation reference;
+
+  virtual void SetUp() {
+    period = 0.001;
+    // The logistic function is approximated to within 7e-6*s
+    tolerance = 1E-5;
+
+    std::srand(0);
+    this->setLimits(0.2, 0.5, 0.05, 0.2);
+  }
+
+  void setLimits(
+      const double max_linear_rate,
+      const double max_angular_rate,
+      const double max_linear_error,
+      const double max_angular_error)
+  {
+    saturation.setGains(5.0, 5.0);
+    saturation.setRateLimits(max_linear_rate, max_angular_rate);
+    saturation.setErrorLimits(max_linear_error, max_angular_error);
+    reference.setGains(5.0, 5.0);
+    reference.setRateLimits(max_linear_rate, max_angular_rate);
+    reference.setErrorLimits(max_linear_error, max_angular_error);
+  }
+
+  void reset(const KDL::Frame &current) {
+    saturation.reset(current);
+    reference.reset(current);
+  }
+
+  //! Update both laws and check that their frames agree
+  void update(const KDL::Frame &current, const KDL::Frame &desired) {
+    EXPECT_TRUE(saturation.update(current, desired, period));
+    EXPECT_TRUE(reference.update(current, desired, period));
+    EXPECT_LT(FrameError(saturation.getUnboundedFrame(), reference.getUnboundedFrame()), tolerance);
+    EXPECT_LT(FrameError(saturation.getCommandFrame(), reference.getCommandFrame()), tolerance);
+  }
+};
+
+TEST(ScaleFactor, ErrorBound)
+{
+  const double s = 0.5;
+
+  // The saturated length is within 7e-6*s of s*tanh(|x|/s), and much closer
+  // when |x| is small compared to s
+  double max_error = 0.0, max_small_error = 0.0;
+  for(unsigned int k=0; k<=200000; k++) {
+    const double x = 10.0 * s * k / 200000.0;
+    const double error = std::abs(x * SE3LogisticSaturation::ScaleFactor(x, s) - s * std::tanh(x / s));
+    max_error = std::max(max_error, error);
+    if(x <= s) {
+      max_small_error = std::max(max_small_error, error);
+    }
+  }
+
+  EXPECT_LT(max_error, 7E-6 * s);
+  EXPECT_LT(max_small_error, 1E-12 * s);
+
+  // Short vectors are left as-is, and a limit of zero (or less) zeroes them
+  EXPECT_DOUBLE_EQ(SE3LogisticSaturation::ScaleFactor(0.0, s), 1.0);
+  EXPECT_EQ(SE3LogisticSaturation::ScaleFactor(1.0, 0.0), 0.0);
+  EXPECT_EQ(SE3LogisticSaturation::ScaleFactor(1.0, -1.0), 0.0);
+}
+
+TEST_F(SE3LogisticSaturationTest, MatchesKDL)
+{
+  // Track a jumping target from a randomly moving frame
+  KDL::Frame current = RandomFrame(), desired = RandomFrame();
+  this->reset(current);
+
+  for(unsigned int t=0; t<2000; t++) {
+    current.Integrate(
+        KDL::Twist(
+          KDL::Vector(Random(-0.5, 0.5), Random(-0.5, 0.5), Random(-0.5, 0.5)),
+          KDL::Vector(Random(-1.0, 1.0), Random(-1.0, 1.0), Random(-1.0, 1.0))),
+        1.0/period);
+    if(t % 100 == 0) {
+      desired = RandomFrame();
+    }
+
+    this->update(current, desired);
+  }
+
+  // The command twist is the change in the command frame
+  KDL::FrameVel command, reference_command;
+  saturation.getCommand(command);
+  reference.getCommand(reference_command);
+  EXPECT_LT((command.p.v - reference_command.p.v).Norm(), tolerance);
+  EXPECT_LT((command.M.w - reference_command.M.w).Norm(), tolerance);
+}
+
+TEST_F(SE3LogisticSaturationTest, HalfTurn)
+{
+  // KDL's GetRot() takes any angle within 1e-6 of a half turn about an axis
+  // which isn't aligned with the current frame as exactly a half turn, so the
+  // current frame is aligned with the root frame for the comparison
+  KDL::Frame current(KDL::Vector(Random(-1.0, 1.0), Random(-1.0, 1.0), Random(-1.0, 1.0)));
+  const KDL::Vector axes[3] = {
+    KDL::Vector(1.0, 0.0, 0.0),
+    KDL::Vector(0.0, 1.0, 0.0),
+    KDL::Vector(0.0, 0.0, 1.0)};
+
+  for(unsigned int i=0; i<3; i++) {
+    // Within 1e-6 rad of a half turn, the rotation vector is taken from the
+    // symmetric part of the rotation matrix, but its direction is still
+    // resolved by the antisymmetric part
+    const KDL::Frame desired = KDL::Frame(KDL::Rotation::Rot(axes[i], M_PI - 8E-7)) * current;
+    this->reset(current);
+    for(unsigned int t=0; t<10; t++) {
+      this->update(current, desired);
+    }
+  }
+
+  for(unsigned int i=0; i<3; i++) {
+    // At exactly a half turn, either direction is as short, but the frame
+    // still turns about the axis at the rate limit
+    current.M = RandomFrame().M;
+    const KDL::Frame desired = KDL::Frame(KDL::Rotation::Rot(axes[i], M_PI)) * current;
+    saturation.reset(current);
+    EXPECT_TRUE(saturation.update(current, desired, period));
+
+    const KDL::Vector turn = KDL::diff(current.M, saturation.getUnboundedFrame().M);
+    EXPECT_NEAR(turn.Norm(), period * 0.5 * std::tanh(5.0 * M_PI / 0.5), tolerance * period);
+    EXPECT_NEAR(std::abs(KDL::dot(turn, axes[i])), turn.Norm(), tolerance * period);
+  }
+}
+
+TEST_F(SE3LogisticSaturationTest, ZeroLimits)
+{
+  KDL::Frame current = RandomFrame();
+  const KDL::Frame desired = RandomFrame();
+
+  // Zero rate limits hold the unbounded frame where it was reset
+  this->setLimits(0.0, 0.0, 0.05, 0.2);
+  this->reset(current);
+  const KDL::Frame start = current;
+  for(unsigned int t=0; t<10; t++) {
+    current.Integrate(KDL::Twist(KDL::Vector(0.1, 0.0, 0.0), KDL::Vector(0.0, 0.2, 0.0)), 1.0/period);
+    this->update(current, desired);
+    EXPECT_EQ(FrameError(saturation.getUnboundedFrame(), start), 0.0);
+  }
+
+  // Zero error limits hold the command frame at the current frame
+  this->setLimits(0.2, 0.5, 0.0, 0.0);
+  this->reset(current);
+  for(unsigned int t=0; t<10; t++) {
+    current.Integrate(KDL::Twist(KDL::Vector(0.1, 0.0, 0.0), KDL::Vector(0.0, 0.2, 0.0)), 1.0/period);
+    this->update(current, desired);
+    EXPECT_LT(FrameError(saturation.getCommandFrame(), current), 1E-12);
+  }
+}
+
+TEST_F(SE3LogisticSaturationTest, NaNInputs)
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const KDL::Frame current = RandomFrame(), desired = RandomFrame();
+
+  KDL::Frame nan_position = desired;
+  nan_position.p = KDL::Vector(nan, 0.0, 0.0);
+  KDL::Frame nan_rotation = desired;
+  nan_rotation.M = KDL::Rotation(nan, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0);
+
+  const KDL::Frame nan_desired[2] = {nan_position, nan_rotation};
+
+  for(unsigned int i=0; i<2; i++) {
+    saturation.reset(current);
+    for(unsigned int t=0; t<10; t++) {
+      EXPECT_TRUE(saturation.update(current, desired, period));
+    }
+
+    // A non-finite result resets both frames to the current frame, at rest
+    EXPECT_FALSE(saturation.update(current, nan_desired[i], period));
+    EXPECT_TRUE(SE3LogisticSaturation::IsFinite(saturation.getCommandFrame()));
+    EXPECT_TRUE(SE3LogisticSaturation::IsFinite(saturation.getUnboundedFrame()));
+    EXPECT_EQ(FrameError(saturation.getCommandFrame(), current), 0.0);
+    EXPECT_EQ(FrameError(saturation.getUnboundedFrame(), current), 0.0);
+    EXPECT_EQ(saturation.getCommandTwist().vel.Norm(), 0.0);
+    EXPECT_EQ(saturation.getCommandTwist().rot.Norm(), 0.0);
+
+    // The old law reports the same update as failed
+    reference.reset(current);
+    EXPECT_FALSE(reference.update(current, nan_desired[i], period));
+
+    // Once the target is finite again, the servo recovers
+    EXPECT_TRUE(saturation.update(current, desired, period));
+    EXPECT_TRUE(SE3LogisticSaturation::IsFinite(saturation.getCommandFrame()));
+  }
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
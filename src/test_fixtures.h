@@ -0,0 +1,33 @@
+#ifndef __LCSR_CONTROLLERS_TEST_FIXTURES_H
+#define __LCSR_CONTROLLERS_TEST_FIXTURES_H
+
+#include <cmath>
+#include <cstdlib>
+
+#include <kdl/frames.hpp>
+
+/******************************************************************************
+ * Random problems shared by the tests and benchmarks
+ *
+ * These draw from std::rand(), so seeding it with std::srand() before
+ * building a problem makes the problem the same on every run.
+ ******************************************************************************/
+
+namespace lcsr_controllers {
+
+  //! Uniformly distributed number in [low, high]
+  inline double Random(const double low, const double high)
+  {
+    return low + (high - low) * std::rand() / double(RAND_MAX);
+  }
+
+  //! Pose with a random orientation and a position within a 2m cube
+  inline KDL::Frame RandomFrame()
+  {
+    return KDL::Frame(
+        KDL::Rotation::RPY(Random(-M_PI, M_PI), Random(-M_PI/2.0, M_PI/2.0), Random(-M_PI, M_PI)),
+        KDL::Vector(Random(-1.0, 1.0), Random(-1.0, 1.0), Random(-1.0, 1.0)));
+  }
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_TEST_FIXTURES_H
@@ -0,0 +1,121 @@
+
+#include <tf_conversions/tf_kdl.h>
+
+#include "transform_cache.h"
+
+using namespace lcsr_controllers;
+
+TransformCache::FramePair::FramePair(
+    const std::string &target_frame,
+    const std::string &source_frame) :
+  target_frame(target_frame),
+  source_frame(source_frame),
+  buffer(new RTT::base::DataObjectLockFree<Sample>(Sample())),
+  warned(false)
+{
+}
+
+TransformCache::TransformCache(const std::string &name) :
+  name_(name),
+  listener_(*this)
+{
+}
+
+TransformCache::~TransformCache()
+{
+  this->stop();
+}
+
+TransformCache::Handle TransformCache::addFramePair(
+    const std::string &target_frame,
+    const std::string &source_frame)
+{
+  frame_pairs_.push_back(FramePair(target_frame, source_frame));
+  return frame_pairs_.size() - 1;
+}
+
+void TransformCache::clear()
+{
+  frame_pairs_.clear();
+}
+
+bool TransformCache::start(
+    const LookupTransform &lookup,
+    const double period)
+{
+  this->stop();
+
+  lookup_ = lookup;
+  if(!lookup_.ready()) {
+    RTT::log(RTT::Error) << "TransformCache: the lookupTransform operation isn't ready." << RTT::endlog();
+    return false;
+  }
+
+  // Fill in the transforms before the realtime thread starts reading them
+  this->update();
+
+  listener_activity_.reset(
+      new RTT::Activity(ORO_SCHED_OTHER, RTT::os::LowestPriority, period, &listener_, name_ + "_tf_cache"));
+  return listener_activity_->start();
+}
+
+void TransformCache::stop()
+{
+  if(listener_activity_) {
+    listener_activity_->stop();
+    listener_activity_.reset();
+  }
+}
+
+void TransformCache::update()
+{
+  for(std::vector<FramePair>::iterator it = frame_pairs_.begin(); it != frame_pairs_.end(); ++it) {
+    try {
+      transform_msg_ = lookup_(it->target_frame, it->source_frame);
+      tf::transformMsgToKDL(transform_msg_.transform, it->sample.frame);
+      it->sample.stamp = transform_msg_.header.stamp;
+      it->sample.status = OK;
+      it->warned = false;
+    } catch (std::exception &ex) {
+      // Only warn when the lookups start failing
+      if(!it->warned) {
+        RTT::log(RTT::Warning) << "Could not look up transform from \"" << it->target_frame <<
+          "\" to \"" << it->source_frame << "\": " << ex.what() << RTT::endlog();
+        it->warned = true;
+      }
+      if(it->sample.status == OK) {
+        it->sample.status = STALE;
+      }
+    }
+
+    it->buffer->Set(it->sample);
+  }
+}
+
+TransformCache::Status TransformCache::getTransform(
+    const Handle handle,
+    KDL::Frame &frame) const
+{
+  ros::Time stamp;
+  return this->getTransform(handle, frame, stamp);
+}
+
+TransformCache::Status TransformCache::getTransform(
+    const Handle handle,
+    KDL::Frame &frame,
+    ros::Time &stamp) const
+{
+  if(handle >= frame_pairs_.size()) {
+    return UNAVAILABLE;
+  }
+
+  Sample sample;
+  frame_pairs_[handle].buffer->Get(sample);
+
+  if(sample.status != UNAVAILABLE) {
+    frame = sample.frame;
+    stamp = sample.stamp;
+  }
+
+  return sample.status;
+}
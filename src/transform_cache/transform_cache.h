@@ -0,0 +1,110 @@
+#ifndef __LCSR_CONTROLLERS_TRANSFORM_CACHE_H
+#define __LCSR_CONTROLLERS_TRANSFORM_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <rtt/RTT.hpp>
+#include <rtt/Activity.hpp>
+#include <rtt/base/RunnableInterface.hpp>
+#include <rtt/base/DataObjectLockFree.hpp>
+
+#include <ros/time.h>
+#include <kdl/frames.hpp>
+#include <geometry_msgs/TransformStamped.h>
+
+namespace lcsr_controllers {
+
+  /** \brief Lock-free cache of tf transforms for realtime components
+   *
+   * Looking up a transform through the tf component's lookupTransform
+   * operation builds strings, searches the tf buffer, and reports misses by
+   * throwing. This moves the lookups into a listener activity which runs
+   * outside of the realtime thread. Each frame pair is registered once, and
+   * its latest transform is kept in a lock-free slot which the realtime
+   * thread reads with its handle.
+   *
+   * Frame pairs can only be added or cleared while the cache is stopped.
+   */
+  class TransformCache {
+  public:
+    typedef RTT::OperationCaller<geometry_msgs::TransformStamped(const std::string&, const std::string&)> LookupTransform;
+    typedef unsigned int Handle;
+
+    enum Status {
+      //! The transform is from the latest lookup
+      OK = 0,
+      //! The latest lookup failed, so the transform is from an earlier one
+      STALE = 1,
+      //! No lookup has succeeded yet (or the handle is invalid)
+      UNAVAILABLE = -1
+    };
+
+    TransformCache(const std::string &name);
+    ~TransformCache();
+
+    //! Register a frame pair, and get its handle
+    Handle addFramePair(const std::string &target_frame, const std::string &source_frame);
+    //! Remove all frame pairs
+    void clear();
+
+    /** \brief Look up every frame pair once, and then start the listener
+     *
+     * The listener looks up every frame pair with the lookup operation once
+     * per period (in seconds).
+     */
+    bool start(const LookupTransform &lookup, const double period);
+    //! Stop the listener
+    void stop();
+
+    //! Get the latest transform of a frame pair (realtime-safe)
+    Status getTransform(const Handle handle, KDL::Frame &frame) const;
+    //! Get the latest transform of a frame pair and its time stamp (realtime-safe)
+    Status getTransform(const Handle handle, KDL::Frame &frame, ros::Time &stamp) const;
+
+  private:
+    struct Sample {
+      Sample() : status(UNAVAILABLE) { }
+      Status status;
+      ros::Time stamp;
+      KDL::Frame frame;
+    };
+
+    struct FramePair {
+      FramePair(const std::string &target_frame, const std::string &source_frame);
+      std::string target_frame;
+      std::string source_frame;
+      //! The listener's latest sample
+      Sample sample;
+      //! The latest sample, handed off to the realtime thread
+      boost::shared_ptr<RTT::base::DataObjectLockFree<Sample> > buffer;
+      bool warned;
+    };
+
+    //! Looks up every frame pair outside of the realtime thread
+    class Listener : public RTT::base::RunnableInterface {
+    public:
+      Listener(TransformCache &owner) : owner_(owner) { }
+      virtual bool initialize() { return true; }
+      virtual void step() { owner_.update(); }
+      virtual void finalize() { }
+    private:
+      TransformCache &owner_;
+    };
+
+    void update();
+
+    std::string name_;
+    LookupTransform lookup_;
+    std::vector<FramePair> frame_pairs_;
+    geometry_msgs::TransformStamped transform_msg_;
+
+    Listener listener_;
+    boost::scoped_ptr<RTT::Activity> listener_activity_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_TRANSFORM_CACHE_H
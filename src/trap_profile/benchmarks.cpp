@@ -0,0 +1,142 @@
+
+#include <vector>
+#include <cstdlib>
+
+#include <Eigen/Dense>
+
+#include <kdl/velocityprofile_trap.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include "../test_fixtures.h"
+#include "trap_profiles.h"
+using namespace lcsr_controllers;
+
+//! Limits and displacements which differ between joints, so that joints are
+//! in different phases at any given sample time
+struct Problem
+{
+  Problem(const size_t n_dof) :
+    max_velocities(n_dof),
+    max_accelerations(n_dof),
+    start_positions(n_dof),
+    end_positions(n_dof)
+  {
+    std::srand(0);
+    for(size_t i=0; i<n_dof; i++) {
+      max_velocities[i] = Random(0.5, 2.0);
+      max_accelerations[i] = Random(1.0, 5.0);
+      start_positions[i] = Random(-1.0, 1.0);
+      end_positions[i] = Random(-1.0, 1.0);
+    }
+  }
+
+  Eigen::VectorXd
+    max_velocities,
+    max_accelerations,
+    start_positions,
+    end_positions;
+};
+
+static const double SAMPLE_PERIOD = 0.001;
+static const double SAMPLE_WINDOW = 2.0;
+
+/******************************************************************************
+ * Planning
+ ******************************************************************************/
+
+static void BM_KDL_SetProfile(benchmark::State& state)
+{
+  const size_t n_dof = state.range(0);
+  Problem problem(n_dof);
+
+  std::vector<KDL::VelocityProfile_Trap> profiles(n_dof);
+  for(size_t i=0; i<n_dof; i++) {
+    profiles[i] = KDL::VelocityProfile_Trap(problem.max_velocities[i], problem.max_accelerations[i]);
+  }
+
+  for(auto _ : state) {
+    for(size_t i=0; i<n_dof; i++) {
+      profiles[i].SetProfile(problem.start_positions[i], problem.end_positions[i]);
+    }
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_dof);
+}
+BENCHMARK(BM_KDL_SetProfile)->Arg(7)->Arg(32);
+
+static void BM_TrapProfiles_SetProfiles(benchmark::State& state)
+{
+  const size_t n_dof = state.range(0);
+  const bool synchronize = state.range(1);
+  Problem problem(n_dof);
+
+  TrapProfiles profiles(n_dof);
+  profiles.setLimits(problem.max_velocities, problem.max_accelerations);
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(profiles.setProfiles(0.0, problem.start_positions, problem.end_positions, synchronize));
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_dof);
+}
+BENCHMARK(BM_TrapProfiles_SetProfiles)->Args({7,0})->Args({32,0})->Args({7,1})->Args({32,1});
+
+/******************************************************************************
+ * Sampling
+ ******************************************************************************/
+
+static void BM_KDL_Sample(benchmark::State& state)
+{
+  const size_t n_dof = state.range(0);
+  Problem problem(n_dof);
+
+  std::vector<KDL::VelocityProfile_Trap> profiles(n_dof);
+  for(size_t i=0; i<n_dof; i++) {
+    profiles[i] = KDL::VelocityProfile_Trap(problem.max_velocities[i], problem.max_accelerations[i]);
+    profiles[i].SetProfile(problem.start_positions[i], problem.end_positions[i]);
+  }
+
+  Eigen::VectorXd positions(n_dof), velocities(n_dof);
+  double time = 0.0;
+
+  for(auto _ : state) {
+    for(size_t i=0; i<n_dof; i++) {
+      positions[i] = profiles[i].Pos(time);
+      velocities[i] = profiles[i].Vel(time);
+    }
+    benchmark::DoNotOptimize(positions.data());
+    benchmark::DoNotOptimize(velocities.data());
+    time = (time > SAMPLE_WINDOW) ? 0.0 : time + SAMPLE_PERIOD;
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_dof);
+}
+BENCHMARK(BM_KDL_Sample)->Arg(7)->Arg(32);
+
+static void BM_TrapProfiles_Sample(benchmark::State& state)
+{
+  const size_t n_dof = state.range(0);
+  Problem problem(n_dof);
+
+  TrapProfiles profiles(n_dof);
+  profiles.setLimits(problem.max_velocities, problem.max_accelerations);
+  profiles.setProfiles(0.0, problem.start_positions, problem.end_positions);
+
+  Eigen::VectorXd positions(n_dof), velocities(n_dof);
+  double time = 0.0;
+
+  for(auto _ : state) {
+    profiles.sample(time, positions, velocities);
+    benchmark::DoNotOptimize(positions.data());
+    benchmark::DoNotOptimize(velocities.data());
+    time = (time > SAMPLE_WINDOW) ? 0.0 : time + SAMPLE_PERIOD;
+  }
+
+  state.SetItemsProcessed(state.iterations() * n_dof);
+}
+BENCHMARK(BM_TrapProfiles_Sample)->Arg(7)->Arg(32);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,291 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include <Eigen/Dense>
+
+#include <gtest/gtest.h>
+
+#include "trap_profiles.h"
+using namespace lcsr_controllers;
+
+/******************************************************************************
+ * Each test plans profiles and then samples them densely, checking that the
+ * position and velocity are continuous, that the limits are respected, and
+ * that every profile starts and ends in the right state.
+ ******************************************************************************/
+
+class TrapProfilesTest : public ::testing::Test {
+public:
+  size_t n_dof;
+  double t_step;
+  double tolerance;
+  double start_time;
+  Eigen::VectorXd max_velocities, max_accelerations;
+  TrapProfiles profiles;
+
+  virtual void SetUp() {
+    n_dof = 3;
+    t_step = 1E-4;
+    tolerance = 1E-9;
+    start_time = 2.0;
+
+    max_velocities.resize(n_dof);
+    max_velocities << 1.0, 0.5, 2.0;
+    max_accelerations.resize(n_dof);
+    max_accelerations << 2.0, 1.0, 8.0;
+
+    profiles.resize(n_dof);
+    profiles.setLimits(max_velocities, max_accelerations);
+  }
+
+  //! Sample every profile from before its start to after its end
+  void CheckProfiles(
+      const Eigen::VectorXd &start_positions,
+      const Eigen::VectorXd &start_velocities,
+      const Eigen::VectorXd &end_positions)
+  {
+    Eigen::VectorXd positions(n_dof), velocities(n_dof);
+    Eigen::VectorXd last_positions(n_dof), last_velocities(n_dof);
+
+    // The clamped start velocity
+    const Eigen::VectorXd clamped_velocities =
+      start_velocities.cwiseMax(-max_velocities).cwiseMin(max_velocities);
+
+    // Before the start, the start state is returned
+    profiles.sample(start_time - 0.5, positions, velocities);
+    for(size_t i=0; i<n_dof; i++) {
+      EXPECT_NEAR(positions[i], start_positions[i], tolerance) << "joint " << i;
+      EXPECT_NEAR(velocities[i], clamped_velocities[i], tolerance) << "joint " << i;
+    }
+
+    profiles.sample(start_time, last_positions, last_velocities);
+    for(size_t i=0; i<n_dof; i++) {
+      EXPECT_NEAR(last_positions[i], start_positions[i], tolerance) << "joint " << i;
+      EXPECT_NEAR(last_velocities[i], clamped_velocities[i], tolerance) << "joint " << i;
+    }
+
+    const double end_time = profiles.endTime() + 0.5;
+    for(double t = start_time + t_step; t < end_time; t += t_step) {
+      profiles.sample(t, positions, velocities);
+
+      for(size_t i=0; i<n_dof; i++) {
+        // Limits
+        ASSERT_LE(std::abs(velocities[i]), max_velocities[i] + tolerance) << "joint " << i << " at " << t;
+
+        // Continuity: the velocity changes by at most the acceleration limit,
+        // and the position by at most the fastest velocity over the step
+        ASSERT_LE(
+            std::abs(velocities[i] - last_velocities[i]),
+            max_accelerations[i] * t_step + tolerance) << "joint " << i << " at " << t;
+        ASSERT_LE(
+            std::abs(positions[i] - last_positions[i]),
+            std::max(std::abs(velocities[i]), std::abs(last_velocities[i])) * t_step
+            + 0.5 * max_accelerations[i] * t_step * t_step + tolerance) << "joint " << i << " at " << t;
+
+        // End state
+        if(t >= profiles.endTime(i)) {
+          ASSERT_NEAR(positions[i], end_positions[i], 1E-6) << "joint " << i << " at " << t;
+          ASSERT_NEAR(velocities[i], 0.0, tolerance) << "joint " << i << " at " << t;
+        }
+      }
+
+      last_positions = positions;
+      last_velocities = velocities;
+    }
+  }
+};
+
+TEST_F(TrapProfilesTest, Trapezoidal)
+{
+  Eigen::VectorXd start(n_dof), end(n_dof), zero(n_dof);
+  start << 0.0, 1.0, -1.0;
+  end << 3.0, -1.0, 4.0;
+  zero.setZero();
+
+  profiles.setProfiles(start_time, start, end);
+
+  // Long enough moves reach the velocity limit: d/v + v/a
+  for(size_t i=0; i<n_dof; i++) {
+    const double distance = std::abs(end[i] - start[i]);
+    EXPECT_NEAR(profiles.duration(i), distance / max_velocities[i] + max_velocities[i] / max_accelerations[i], tolerance);
+    EXPECT_DOUBLE_EQ(profiles.startTime(i), start_time);
+  }
+
+  this->CheckProfiles(start, zero, end);
+}
+
+TEST_F(TrapProfilesTest, Triangular)
+{
+  Eigen::VectorXd start(n_dof), end(n_dof), zero(n_dof), positions(n_dof), velocities(n_dof);
+  start << 0.0, 0.0, 0.0;
+  end << 0.2, -0.1, 0.05;
+  zero.setZero();
+
+  profiles.setProfiles(start_time, start, end);
+
+  // Short moves never reach the velocity limit: 2 sqrt(d/a)
+  for(size_t i=0; i<n_dof; i++) {
+    const double distance = std::abs(end[i] - start[i]);
+    EXPECT_NEAR(profiles.duration(i), 2.0 * std::sqrt(distance / max_accelerations[i]), tolerance);
+
+    // Peak velocity at the midpoint
+    profiles.sample(start_time + 0.5 * profiles.duration(i), positions, velocities);
+    EXPECT_NEAR(std::abs(velocities[i]), std::sqrt(distance * max_accelerations[i]), tolerance);
+    EXPECT_LT(std::abs(velocities[i]), max_velocities[i]);
+  }
+
+  this->CheckProfiles(start, zero, end);
+}
+
+TEST_F(TrapProfilesTest, ZeroDistance)
+{
+  Eigen::VectorXd start(n_dof), zero(n_dof);
+  start << 0.5, -0.5, 0.0;
+  zero.setZero();
+
+  profiles.setProfiles(start_time, start, start);
+
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_NEAR(profiles.duration(i), 0.0, tolerance);
+  }
+
+  this->CheckProfiles(start, zero, start);
+}
+
+TEST_F(TrapProfilesTest, InitialVelocityTowardsGoal)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof);
+  start << 0.0, 0.0, 0.0;
+  velocity << 0.5, -0.25, 1.0;
+  end << 2.0, -1.0, 3.0;
+
+  profiles.setProfiles(start_time, start, velocity, end);
+
+  // A head start makes the move faster than from rest
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_LT(profiles.duration(i), profiles.minimumDuration(i, start[i], end[i]));
+  }
+
+  this->CheckProfiles(start, velocity, end);
+}
+
+TEST_F(TrapProfilesTest, Reversal)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof), positions(n_dof), velocities(n_dof);
+  start << 0.0, 0.0, 0.0;
+  // Moving away from the goal
+  velocity << -0.8, 0.4, -1.5;
+  end << 1.0, -0.5, 0.5;
+
+  profiles.setProfiles(start_time, start, velocity, end);
+
+  // Each joint stops at the acceleration limit, then moves back towards the goal
+  for(size_t i=0; i<n_dof; i++) {
+    const double stop_time = std::abs(velocity[i]) / max_accelerations[i];
+    profiles.sample(start_time + stop_time, positions, velocities);
+    EXPECT_NEAR(velocities[i], 0.0, tolerance) << "joint " << i;
+    EXPECT_NEAR(
+        positions[i],
+        start[i] + 0.5 * velocity[i] * stop_time, tolerance) << "joint " << i;
+  }
+
+  this->CheckProfiles(start, velocity, end);
+}
+
+TEST_F(TrapProfilesTest, Overshoot)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof), positions(n_dof), velocities(n_dof);
+  start << 0.0, 0.0, 0.0;
+  // Too fast to stop before the goal
+  velocity << 1.0, -0.5, 2.0;
+  end << 0.1, -0.05, 0.1;
+
+  profiles.setProfiles(start_time, start, velocity, end);
+
+  // Each joint passes the goal before coming back to it
+  for(size_t i=0; i<n_dof; i++) {
+    const double stop_time = std::abs(velocity[i]) / max_accelerations[i];
+    profiles.sample(start_time + stop_time, positions, velocities);
+    EXPECT_NEAR(velocities[i], 0.0, tolerance) << "joint " << i;
+    EXPECT_GT(std::abs(positions[i] - start[i]), std::abs(end[i] - start[i])) << "joint " << i;
+  }
+
+  this->CheckProfiles(start, velocity, end);
+}
+
+TEST_F(TrapProfilesTest, ClampedInitialVelocity)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof);
+  start << 0.0, 0.0, 0.0;
+  velocity << 3.0, -2.0, 10.0;
+  end << 4.0, -2.0, 8.0;
+
+  profiles.setProfiles(start_time, start, velocity, end);
+
+  this->CheckProfiles(start, velocity, end);
+}
+
+TEST_F(TrapProfilesTest, SynchronizedDurations)
+{
+  Eigen::VectorXd start(n_dof), zero(n_dof), end(n_dof);
+  start << 0.0, 0.0, 0.0;
+  zero.setZero();
+  end << 0.3, -2.0, 1.0;
+
+  const double duration = profiles.setProfiles(start_time, start, end, true);
+
+  // Every joint takes as long as the slowest one
+  double slowest = 0.0;
+  for(size_t i=0; i<n_dof; i++) {
+    slowest = std::max(slowest, profiles.minimumDuration(i, start[i], end[i]));
+  }
+  EXPECT_NEAR(duration, slowest, tolerance);
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_NEAR(profiles.endTime(i), start_time + duration, tolerance) << "joint " << i;
+  }
+
+  this->CheckProfiles(start, zero, end);
+}
+
+TEST_F(TrapProfilesTest, SynchronizedFromMotion)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof);
+  start << 0.0, 0.0, 0.0;
+  // Fast towards the goal, away from the goal, and too fast to stop
+  velocity << 1.0, 0.3, 2.0;
+  end << 1.5, -1.5, 0.2;
+
+  const double duration = profiles.setProfiles(start_time, start, velocity, end, true);
+
+  for(size_t i=0; i<n_dof; i++) {
+    EXPECT_NEAR(profiles.endTime(i), start_time + duration, tolerance) << "joint " << i;
+  }
+
+  this->CheckProfiles(start, velocity, end);
+}
+
+TEST_F(TrapProfilesTest, StretchedDuration)
+{
+  Eigen::VectorXd start(n_dof), velocity(n_dof), end(n_dof);
+  start << 0.0, 0.0, 0.0;
+  velocity << 0.9, 0.0, -1.0;
+  end << 0.5, 0.5, -0.5;
+
+  // Much longer than needed, so the first joint has to slow down to cruise
+  for(size_t i=0; i<n_dof; i++) {
+    profiles.setProfileDuration(i, start_time, start[i], end[i], 4.0, velocity[i]);
+    EXPECT_NEAR(profiles.duration(i), 4.0, tolerance) << "joint " << i;
+  }
+
+  this->CheckProfiles(start, velocity, end);
+
+  // A duration shorter than the minimum is lengthened to it
+  profiles.setProfileDuration(0, start_time, start[0], end[0], 0.0, velocity[0]);
+  EXPECT_NEAR(profiles.duration(0), profiles.minimumDuration(0, start[0], end[0], velocity[0]), tolerance);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,228 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "trap_profiles.h"
+
+using namespace lcsr_controllers;
+
+TrapProfiles::TrapProfiles()
+{
+  this->resize(0);
+}
+
+TrapProfiles::TrapProfiles(const size_t n_dof)
+{
+  this->resize(n_dof);
+}
+
+void TrapProfiles::resize(const size_t n_dof)
+{
+  max_velocities_.setZero(n_dof);
+  max_accelerations_.setZero(n_dof);
+  zero_velocities_.setZero(n_dof);
+
+  start_times_.setZero(n_dof);
+  start_positions_.setZero(n_dof);
+  start_velocities_.setZero(n_dof);
+  end_positions_.setZero(n_dof);
+  accelerations_.setZero(n_dof);
+  decelerations_.setZero(n_dof);
+  velocities_.setZero(n_dof);
+  accel_end_times_.setZero(n_dof);
+  decel_start_times_.setZero(n_dof);
+  durations_.setZero(n_dof);
+
+  times_.setZero(n_dof);
+  accel_times_.setZero(n_dof);
+  cruise_times_.setZero(n_dof);
+  decel_times_.setZero(n_dof);
+}
+
+void TrapProfiles::setLimits(
+    const Eigen::VectorXd &max_velocities,
+    const Eigen::VectorXd &max_accelerations)
+{
+  max_velocities_ = max_velocities.array().abs();
+  max_accelerations_ = max_accelerations.array().abs();
+}
+
+/* Express a profile in the direction the joint finally travels in
+ *
+ * If the joint can't stop before reaching the goal, or is moving away from
+ * it, it has to come to a stop and then move in the opposite direction.
+ * Returns the direction, and the (non-negative) distance and the initial
+ * speed (which is negative when the joint has to reverse) along it.
+ */
+static double Direction(
+    const double max_velocity,
+    const double max_acceleration,
+    const double start_position,
+    const double end_position,
+    const double start_velocity,
+    double &distance,
+    double &speed)
+{
+  const double
+    velocity = std::max(-max_velocity, std::min(start_velocity, max_velocity)),
+    displacement = end_position - start_position,
+    // Signed distance travelled while stopping at the acceleration limit
+    stopping_displacement = velocity * std::abs(velocity) / (2.0 * max_acceleration),
+    remainder = displacement - stopping_displacement;
+
+  double direction = 1.0;
+  if(remainder < 0.0 || (remainder == 0.0 && velocity < 0.0)) {
+    direction = -1.0;
+  }
+
+  distance = direction * displacement;
+  speed = direction * velocity;
+
+  return direction;
+}
+
+double TrapProfiles::minimumDuration(
+    const size_t i,
+    const double start_position,
+    const double end_position,
+    const double start_velocity) const
+{
+  const double
+    v_max = max_velocities_[i],
+    a_max = max_accelerations_[i];
+
+  double distance, speed;
+  Direction(v_max, a_max, start_position, end_position, start_velocity, distance, speed);
+
+  // Peak speed of a triangular profile, unless the velocity limit is reached
+  const double peak = std::min(std::sqrt(a_max * distance + 0.5 * speed * speed), v_max);
+
+  // Cruise for the distance not covered while accelerating and decelerating
+  const double cruise_time = (peak > 0.0) ?
+    std::max(0.0, distance - (2.0 * peak * peak - speed * speed) / (2.0 * a_max)) / peak :
+    0.0;
+
+  return (peak - speed) / a_max + cruise_time + peak / a_max;
+}
+
+void TrapProfiles::setProfile(
+    const size_t i,
+    const double start_time,
+    const double start_position,
+    const double end_position,
+    const double start_velocity)
+{
+  this->setProfileDuration(i, start_time, start_position, end_position, 0.0, start_velocity);
+}
+
+void TrapProfiles::setProfileDuration(
+    const size_t i,
+    const double start_time,
+    const double start_position,
+    const double end_position,
+    const double duration,
+    const double start_velocity)
+{
+  const double
+    v_max = max_velocities_[i],
+    a_max = max_accelerations_[i],
+    min_duration = this->minimumDuration(i, start_position, end_position, start_velocity),
+    total_duration = std::max(duration, min_duration);
+
+  double distance, speed;
+  const double direction = Direction(v_max, a_max, start_position, end_position, start_velocity, distance, speed);
+
+  // Find the cruise speed which covers the distance in the total duration
+  // when accelerating and decelerating at the limit
+  double peak;
+  if(total_duration <= min_duration) {
+    // Fastest profile
+    peak = std::min(std::sqrt(a_max * distance + 0.5 * speed * speed), v_max);
+  } else if(speed > 0.0 && total_duration * speed > distance + speed * speed / (2.0 * a_max)) {
+    // Even without accelerating, the joint would arrive too early, so it has
+    // to slow down to the cruise speed first:
+    //   distance = (speed^2 - peak^2)/(2 a_max) + peak (total_duration - speed/a_max) + peak^2/(2 a_max)
+    peak = (distance - speed * speed / (2.0 * a_max)) / (total_duration - speed / a_max);
+  } else {
+    // Accelerate up to the cruise speed:
+    //   distance = (peak^2 - speed^2)/(2 a_max) + peak cruise_time + peak^2/(2 a_max)
+    const double
+      b = speed + a_max * total_duration,
+      c = a_max * distance + 0.5 * speed * speed;
+    peak = 0.5 * (b - std::sqrt(std::max(0.0, b * b - 4.0 * c)));
+  }
+
+  start_times_[i] = start_time;
+  start_positions_[i] = start_position;
+  start_velocities_[i] = direction * speed;
+  end_positions_[i] = end_position;
+  accelerations_[i] = (peak >= speed) ? direction * a_max : -direction * a_max;
+  decelerations_[i] = -direction * a_max;
+  velocities_[i] = direction * peak;
+  accel_end_times_[i] = std::abs(peak - speed) / a_max;
+  decel_start_times_[i] = total_duration - peak / a_max;
+  durations_[i] = total_duration;
+}
+
+double TrapProfiles::setProfiles(
+    const double start_time,
+    const Eigen::VectorXd &start_positions,
+    const Eigen::VectorXd &end_positions,
+    const bool synchronize)
+{
+  return this->setProfiles(start_time, start_positions, zero_velocities_, end_positions, synchronize);
+}
+
+double TrapProfiles::setProfiles(
+    const double start_time,
+    const Eigen::VectorXd &start_positions,
+    const Eigen::VectorXd &start_velocities,
+    const Eigen::VectorXd &end_positions,
+    const bool synchronize)
+{
+  double duration = 0.0;
+
+  if(synchronize) {
+    // All joints take as long as the slowest one
+    for(size_t i=0; i<this->size(); i++) {
+      duration = std::max(
+          duration,
+          this->minimumDuration(i, start_positions[i], end_positions[i], start_velocities[i]));
+    }
+    for(size_t i=0; i<this->size(); i++) {
+      this->setProfileDuration(i, start_time, start_positions[i], end_positions[i], duration, start_velocities[i]);
+    }
+  } else {
+    for(size_t i=0; i<this->size(); i++) {
+      this->setProfile(i, start_time, start_positions[i], end_positions[i], start_velocities[i]);
+      duration = std::max(duration, durations_[i]);
+    }
+  }
+
+  return duration;
+}
+
+void TrapProfiles::sample(
+    const double time,
+    Eigen::VectorXd &positions,
+    Eigen::VectorXd &velocities) const
+{
+  // Time spent in each phase, clamped so that finished phases contribute
+  // fully and future ones don't contribute at all
+  times_ = (time - start_times_).max(0.0).min(durations_);
+  accel_times_ = times_.min(accel_end_times_);
+  cruise_times_ = (times_ - accel_end_times_).max(0.0).min(decel_start_times_ - accel_end_times_);
+  decel_times_ = (times_ - decel_start_times_).max(0.0);
+
+  positions = (
+      start_positions_
+      + start_velocities_ * accel_times_
+      + 0.5 * accelerations_ * accel_times_.square()
+      + velocities_ * (cruise_times_ + decel_times_)
+      + 0.5 * decelerations_ * decel_times_.square()).matrix();
+
+  velocities = (
+      start_velocities_
+      + accelerations_ * accel_times_
+      + decelerations_ * decel_times_).matrix();
+}
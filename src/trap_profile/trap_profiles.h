@@ -0,0 +1,132 @@
+#ifndef __LCSR_CONTROLLERS_TRAP_PROFILES_H
+#define __LCSR_CONTROLLERS_TRAP_PROFILES_H
+
+#include <Eigen/Dense>
+
+namespace lcsr_controllers {
+
+  /** \brief Trapezoidal velocity profiles for a set of joints
+   *
+   * This is a structure-of-arrays replacement for a vector of
+   * KDL::VelocityProfile_Trap. Each joint's profile is stored as its start
+   * time, start position and velocity, the signed accelerations of its first
+   * and last phases, its cruise velocity, and the times at which it stops
+   * accelerating, starts decelerating, and ends. Planning is done per joint,
+   * but sampling evaluates every joint at once with clamped phase times
+   * instead of branching on the phase, so it vectorizes and doesn't allocate.
+   *
+   * Profiles can start with a non-zero velocity so that they can be
+   * re-planned in the middle of a motion. If the joint is moving away from
+   * the goal, or is too fast to stop before reaching it, the first phase
+   * brings it to a stop and reverses it. Initial velocities are clamped to the
+   * velocity limits. Profiles always end at rest.
+   */
+  class TrapProfiles {
+  public:
+    TrapProfiles();
+    TrapProfiles(const size_t n_dof);
+
+    //! Set the number of joints (this resets all profiles)
+    void resize(const size_t n_dof);
+    size_t size() const { return start_positions_.size(); }
+
+    //! Set the velocity and acceleration limits
+    void setLimits(
+        const Eigen::VectorXd &max_velocities,
+        const Eigen::VectorXd &max_accelerations);
+
+    //! Plan the fastest profile for a single joint
+    void setProfile(
+        const size_t i,
+        const double start_time,
+        const double start_position,
+        const double end_position,
+        const double start_velocity = 0.0);
+
+    //! Plan a single joint's profile to take a given duration (at least its minimum)
+    void setProfileDuration(
+        const size_t i,
+        const double start_time,
+        const double start_position,
+        const double end_position,
+        const double duration,
+        const double start_velocity = 0.0);
+
+    /** \brief Plan all joints at once
+     *
+     * If synchronize is true, every joint is stretched to the duration of the
+     * slowest one, so they all finish at the same time.
+     * Each profile keeps its own phase times, so the joints don't move in a
+     * straight line in joint space.
+     *
+     * Returns: the longest duration
+     */
+    double setProfiles(
+        const double start_time,
+        const Eigen::VectorXd &start_positions,
+        const Eigen::VectorXd &end_positions,
+        const bool synchronize = false);
+
+    //! Plan all joints at once, starting with the given velocities
+    double setProfiles(
+        const double start_time,
+        const Eigen::VectorXd &start_positions,
+        const Eigen::VectorXd &start_velocities,
+        const Eigen::VectorXd &end_positions,
+        const bool synchronize = false);
+
+    //! Sample every joint's profile at a given time
+    void sample(
+        const double time,
+        Eigen::VectorXd &positions,
+        Eigen::VectorXd &velocities) const;
+
+    //! Get the minimum duration of a profile with the current limits
+    double minimumDuration(
+        const size_t i,
+        const double start_position,
+        const double end_position,
+        const double start_velocity = 0.0) const;
+
+    double startTime(const size_t i) const { return start_times_[i]; }
+    double endTime(const size_t i) const { return start_times_[i] + durations_[i]; }
+    //! Get the latest end time of all the profiles
+    double endTime() const { return (start_times_ + durations_).maxCoeff(); }
+    double duration(const size_t i) const { return durations_[i]; }
+    double endPosition(const size_t i) const { return end_positions_[i]; }
+
+    const Eigen::ArrayXd& startTimes() const { return start_times_; }
+    const Eigen::ArrayXd& durations() const { return durations_; }
+
+  private:
+    // Limits
+    Eigen::ArrayXd
+      max_velocities_,
+      max_accelerations_;
+
+    // Start velocities for profiles which start at rest
+    Eigen::VectorXd zero_velocities_;
+
+    // Profiles
+    Eigen::ArrayXd
+      start_times_,
+      start_positions_,
+      start_velocities_,
+      end_positions_,
+      accelerations_,
+      decelerations_,
+      velocities_,
+      accel_end_times_,
+      decel_start_times_,
+      durations_;
+
+    // Scratch space for sampling
+    mutable Eigen::ArrayXd
+      times_,
+      accel_times_,
+      cruise_times_,
+      decel_times_;
+  };
+}
+
+#endif // ifndef __LCSR_CONTROLLERS_TRAP_PROFILES_H